@@ -28,12 +28,53 @@ along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
 #include "rave_alloc.h"
 #include "rave_utilities.h"
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
 #include <rave_data2d.h>
 #include <polarvolume.h>
-#include <time.h>
-#include <sys/time.h>
+#include <raveobject_list.h>
 #include "ppc_radar_options.h"
+#include "pdp_workspace.h"
+
+/**
+ * Name of the environment variable that can be used to override the number of threads in the radar options
+ */
+#define PPC_NUMBER_OF_THREADS_ENV "PPC_NUMBER_OF_THREADS"
+
+/**
+ * Max number of membership tables that are cached in the processor, the least recently used table is evicted when a new one is added
+ */
+#define PdpProcessorInternal_MAX_MEMBERSHIP_TABLES 16
+
+/**
+ * A membership function evaluated for every raw value of an 8 or 16 bit parameter,
+ * see \ref PdpProcessorInternal_getMembershipTable.
+ */
+typedef struct PdpProcessorInternal_MembershipTable {
+  RaveDataType rawType; /**< the raw data type, RaveDataType_UCHAR or RaveDataType_USHORT */
+  double gain; /**< gain of the param */
+  double offset; /**< offset of the param */
+  double nodata; /**< raw nodata of the param */
+  double undetect; /**< raw undetect of the param */
+  RaveDataType fieldType; /**< data type of the converted field */
+  int usingNodata; /**< if the converted field is using nodata */
+  double fieldNodata; /**< nodata of the converted field */
+  int roundToFloat; /**< if the memberships are rounded to float precision */
+  double a; /**< trapezoid a */
+  double b; /**< trapezoid b */
+  double s; /**< trapezoid s */
+  double t; /**< trapezoid t */
+  double* table; /**< the membership for each raw value */
+  long users; /**< number of processings using the table */
+  int cached; /**< if the table is in the cache, an evicted table is freed by its last user */
+  struct PdpProcessorInternal_MembershipTable* next; /**< next table in the cache, most recently used first */
+} PdpProcessorInternal_MembershipTable;
+
+/**
+ * Persistent worker threads that ray blocks are dispatched to, see \ref PdpProcessorInternal_dispatch.
+ */
+typedef struct PdpProcessorInternal_ThreadPool PdpProcessorInternal_ThreadPool;
 
 /**
  * Represents one transformator
@@ -42,9 +83,23 @@ struct _PdpProcessor_t {
   RAVE_OBJECT_HEAD /** Always on top */
   double meltingLayerBottomHeight;
   PpcRadarOptions_t* options; /**< the processing options */
+  PdpWorkspace_t* workspace; /**< the workspace for scratch buffers, may be NULL */
+  PdpStats_t* lastStats; /**< statistics from the last processing, may be NULL */
+  int printStats; /**< if the statistics should be printed to stderr after each processing */
+  PdpMedfiltAlgorithm medfiltAlgorithm; /**< the median filter used by \ref PdpProcessor_medfilt */
+  pthread_mutex_t statsLock; /**< protects lastStats since scans can be processed concurrently */
+  PdpProcessorInternal_MembershipTable* membershipTables; /**< cached membership tables */
+  int nmembershipTables; /**< number of cached membership tables */
+  pthread_mutex_t tableLock; /**< protects the membership tables */
+  PdpProcessorInternal_ThreadPool* pool; /**< the worker threads, created when first needed */
+  pthread_mutex_t poolLock; /**< protects the pool */
 };
 
 /*@{ Private functions */
+/* Defined further down */
+static void PdpProcessorInternal_destroyPool(PdpProcessorInternal_ThreadPool* pool);
+static void PdpProcessorInternal_freeMembershipTable(PdpProcessorInternal_MembershipTable* table);
+
 /**
  * Constructor
  */
@@ -52,10 +107,20 @@ static int PdpProcessor_constructor(RaveCoreObject* obj)
 {
 	PdpProcessor_t* pdp = (PdpProcessor_t*)obj;
 	pdp->meltingLayerBottomHeight = -1.0;
+	pdp->workspace = NULL;
+	pdp->lastStats = NULL;
+	pdp->printStats = 0;
+	pdp->medfiltAlgorithm = PdpMedfiltAlgorithm_COUNT;
+	pdp->membershipTables = NULL;
+	pdp->nmembershipTables = 0;
+	pdp->pool = NULL;
 	pdp->options = RAVE_OBJECT_NEW(&PpcRadarOptions_TYPE);
 	if (pdp->options == NULL) {
 	  return 0;
 	}
+  pthread_mutex_init(&pdp->statsLock, NULL);
+  pthread_mutex_init(&pdp->tableLock, NULL);
+  pthread_mutex_init(&pdp->poolLock, NULL);
   return 1;
 }
 
@@ -64,7 +129,19 @@ static int PdpProcessor_constructor(RaveCoreObject* obj)
  */
 static void PdpProcessor_destructor(RaveCoreObject* obj)
 {
-  RAVE_OBJECT_RELEASE(((PdpProcessor_t*)obj)->options);
+  PdpProcessor_t* this = (PdpProcessor_t*)obj;
+  PdpProcessorInternal_destroyPool(this->pool);
+  while (this->membershipTables != NULL) {
+    PdpProcessorInternal_MembershipTable* next = this->membershipTables->next;
+    PdpProcessorInternal_freeMembershipTable(this->membershipTables);
+    this->membershipTables = next;
+  }
+  RAVE_OBJECT_RELEASE(this->options);
+  RAVE_OBJECT_RELEASE(this->workspace);
+  RAVE_OBJECT_RELEASE(this->lastStats);
+  pthread_mutex_destroy(&this->statsLock);
+  pthread_mutex_destroy(&this->tableLock);
+  pthread_mutex_destroy(&this->poolLock);
 }
 
 /**
@@ -76,805 +153,2853 @@ static int PdpProcessor_copyconstructor(RaveCoreObject* obj, RaveCoreObject* src
   PdpProcessor_t* src = (PdpProcessor_t*)srcobj;
   int result = 0;
   this->meltingLayerBottomHeight = src->meltingLayerBottomHeight;
+  this->workspace = RAVE_OBJECT_COPY(src->workspace);
+  this->lastStats = NULL;
+  this->printStats = src->printStats;
+  this->medfiltAlgorithm = src->medfiltAlgorithm;
+  this->membershipTables = NULL;
+  this->nmembershipTables = 0;
+  this->pool = NULL;
   this->options = RAVE_OBJECT_CLONE(src->options);
   if (this->options == NULL) {
     goto fail;
   }
+  pthread_mutex_init(&this->statsLock, NULL);
+  pthread_mutex_init(&this->tableLock, NULL);
+  pthread_mutex_init(&this->poolLock, NULL);
   result = 1;
 fail:
-  RAVE_OBJECT_RELEASE(this->options);
+  if (result == 0) {
+    RAVE_OBJECT_RELEASE(this->options);
+    RAVE_OBJECT_RELEASE(this->workspace);
+  }
   return result;
 }
 
 /**
- * Creates a polar scan param from a data 2d field.
- * @param[in] data2d - the 2d data field
- * @param[in] quantity - the quantity for this field
- * @param[in] touchar - if 1, then data will be scaled to 0-255
- * @param[in] nodata - the nodata value that the param should get
- * @param[in] undetect - the undetect value that the param should get
- * @returns the polar scan parameter
+ * Key to the statistics that the current thread is collecting, see \ref PdpProcessorInternal_getCurrentStats.
+ */
+static pthread_key_t PdpProcessorInternal_statsKey;
+
+/**
+ * Makes sure that \ref PdpProcessorInternal_statsKey only is created once.
+ */
+static pthread_once_t PdpProcessorInternal_statsKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Creates the statistics key.
  */
-static PolarScanParam_t* PdpProcessorInternal_createPolarScanParamFromData2D(RaveData2D_t* data2d, const char* quantity, int touchar, double nodata, double undetect)
+static void PdpProcessorInternal_createStatsKey(void)
 {
-  PolarScanParam_t* param = NULL;
-  PolarScanParam_t* result = NULL;
+  pthread_key_create(&PdpProcessorInternal_statsKey, NULL);
+}
 
-  if (data2d == NULL || quantity == NULL) {
-    RAVE_ERROR0("data2d or quantity is NULL");
-    goto done;
+/**
+ * Sets the statistics that the current thread should collect to. The statistics are kept per thread so that
+ * the kernels that are called from the processing can report without passing the statistics around and so that
+ * several scans can be processed concurrently.
+ * @param[in] stats - the statistics, NULL to stop collecting
+ */
+static void PdpProcessorInternal_setCurrentStats(PdpStats_t* stats)
+{
+  pthread_once(&PdpProcessorInternal_statsKeyOnce, PdpProcessorInternal_createStatsKey);
+  pthread_setspecific(PdpProcessorInternal_statsKey, stats);
+}
+
+/**
+ * @returns the statistics that the current thread is collecting to or NULL if there are none (not a new reference).
+ */
+static PdpStats_t* PdpProcessorInternal_getCurrentStats(void)
+{
+  pthread_once(&PdpProcessorInternal_statsKeyOnce, PdpProcessorInternal_createStatsKey);
+  return (PdpStats_t*)pthread_getspecific(PdpProcessorInternal_statsKey);
+}
+
+/**
+ * Starts timing a stage in the current statistics if there are any.
+ * @param[in] stage - the stage
+ */
+static void PdpProcessorInternal_startStage(PdpStatsStage stage)
+{
+  PdpStats_t* stats = PdpProcessorInternal_getCurrentStats();
+  if (stats != NULL) {
+    PdpStats_startStage(stats, stage);
   }
+}
 
-  param = RAVE_OBJECT_NEW(&PolarScanParam_TYPE);
-  if (param == NULL) {
-    goto done;
+/**
+ * Stops timing the innermost stage in the current statistics if there are any.
+ */
+static void PdpProcessorInternal_stopStage(void)
+{
+  PdpStats_t* stats = PdpProcessorInternal_getCurrentStats();
+  if (stats != NULL) {
+    PdpStats_stopStage(stats);
   }
+}
 
-  if (touchar) {
-    double minv, maxv, spread, gain, offset, v;
-    long bi, ri, nbins, nrays;
-    int usingNodata = 0;
-    double fieldNodata;
-    nbins = RaveData2D_getXsize(data2d);
-    nrays = RaveData2D_getYsize(data2d);
-    if (!PolarScanParam_createData(param, nbins, nrays, RaveDataType_UCHAR)) {
-      goto done;
-    }
-    minv = RaveData2D_min(data2d);
-    maxv = RaveData2D_max(data2d);
+/**
+ * Adds pixel counts to the current statistics if there are any.
+ * @param[in] stage - the stage
+ * @param[in] processed - number of processed pixels
+ * @param[in] flagged - number of flagged pixels
+ */
+static void PdpProcessorInternal_addPixels(PdpStatsStage stage, long processed, long flagged)
+{
+  PdpStats_t* stats = PdpProcessorInternal_getCurrentStats();
+  if (stats != NULL) {
+    PdpStats_addPixels(stats, stage, processed, flagged);
+  }
+}
 
-    spread = (maxv - minv) / 254;
-    offset = minv;
-    gain = spread;
-    if (gain == 0.0) {
-      RAVE_ERROR0("Gain = 0.0");
-      goto done;
+/**
+ * Function that processes the rays startray <= ray < endray in a kernel.
+ */
+typedef void (*PdpProcessorInternal_rayBlockFunction)(void* arg, long startray, long endray);
+
+/**
+ * Returns the number of threads to use. If the environment variable PPC_NUMBER_OF_THREADS is set to
+ * a positive value, it will override the number of threads in the radar options.
+ * @param[in] self - self
+ * @returns the number of threads to use
+ */
+static long PdpProcessorInternal_getNumberOfThreads(PdpProcessor_t* self)
+{
+  long nthreads = PpcRadarOptions_getNumberOfThreads(self->options);
+  const char* env = getenv(PPC_NUMBER_OF_THREADS_ENV);
+  if (env != NULL) {
+    long v = 0;
+    if (sscanf(env, "%ld", &v) == 1 && v > 0) {
+      nthreads = v;
     }
-    PolarScanParam_setNodata(param, nodata);
-    PolarScanParam_setUndetect(param, 0.0);
-    PolarScanParam_setOffset(param, offset);
-    PolarScanParam_setGain(param, gain);
-    fieldNodata = RaveData2D_getNodata(data2d);
-    usingNodata = RaveData2D_usingNodata(data2d);
+  }
+  return nthreads;
+}
 
-    for (bi = 0; bi < nbins; bi++) {
-      for (ri = 0; ri < nrays; ri++) {
-        RaveData2D_getValueUnchecked(data2d, bi, ri, &v);
-        if (!usingNodata || fieldNodata != v) {
-          PolarScanParam_setValue(param, bi, ri, (v - offset)/gain);
-        } else {
-          PolarScanParam_setValue(param, bi, ri, nodata);
-        }
-      }
+/**
+ * A call to a kernel that is split into blocks. The job lives on the stack of the thread that submitted it and
+ * is queued in the pool until all blocks have been claimed.
+ */
+typedef struct PdpProcessorInternal_Job {
+  PdpProcessorInternal_rayBlockFunction fun; /**< the function processing the rays */
+  void* arg; /**< the kernel arguments */
+  long n; /**< the number of items (rays or scans) */
+  long nblocks; /**< the number of blocks */
+  long nextblock; /**< the next block that hasn't been claimed */
+  long running; /**< number of claimed blocks that haven't finished */
+  struct PdpProcessorInternal_Job* next; /**< next job in the queue */
+} PdpProcessorInternal_Job;
+
+struct PdpProcessorInternal_ThreadPool {
+  pthread_mutex_t lock; /**< protects the pool and the queued jobs */
+  pthread_cond_t workAvailable; /**< signaled when a job is queued or the pool is shut down */
+  pthread_cond_t blockDone; /**< signaled when the last running block of a job has finished */
+  pthread_t* threads; /**< the worker threads */
+  long nthreads; /**< the wanted number of threads including the submitting thread */
+  long nworkers; /**< the number of started worker threads */
+  PdpProcessorInternal_Job* jobs; /**< jobs with blocks that haven't been claimed */
+  int shutdown; /**< set when the workers should exit */
+  long users; /**< number of processings currently using the pool */
+  int retired; /**< set when the pool should be destroyed by the last user */
+};
+
+/**
+ * Claims the next block of a job and removes the job from the queue when all its blocks have been claimed.
+ * Must be called with the pool locked.
+ * @param[in] pool - the pool
+ * @param[in] job - the job, must have unclaimed blocks
+ * @returns the claimed block
+ */
+static long PdpProcessorInternal_claimBlock(PdpProcessorInternal_ThreadPool* pool, PdpProcessorInternal_Job* job)
+{
+  long block = job->nextblock++;
+  job->running++;
+  if (job->nextblock >= job->nblocks) {
+    PdpProcessorInternal_Job** pjob = &pool->jobs;
+    while (*pjob != NULL && *pjob != job) {
+      pjob = &(*pjob)->next;
     }
-  } else {
-    if (!PolarScanParam_setData2D(param, data2d)) {
-      goto done;
+    if (*pjob != NULL) {
+      *pjob = job->next;
     }
-    PolarScanParam_setNodata(param, nodata);
-    PolarScanParam_setUndetect(param, undetect);
-    PolarScanParam_setOffset(param, 0.0);
-    PolarScanParam_setGain(param, 1.0);
   }
+  return block;
+}
 
-  if (!PolarScanParam_setQuantity(param, quantity)) {
-    goto done;
+/**
+ * Runs a claimed block with the pool unlocked. Must be called with the pool locked.
+ * @param[in] pool - the pool
+ * @param[in] job - the job
+ * @param[in] block - the claimed block
+ */
+static void PdpProcessorInternal_runBlock(PdpProcessorInternal_ThreadPool* pool, PdpProcessorInternal_Job* job, long block)
+{
+  pthread_mutex_unlock(&pool->lock);
+  job->fun(job->arg, (block * job->n) / job->nblocks, ((block + 1) * job->n) / job->nblocks);
+  pthread_mutex_lock(&pool->lock);
+  job->running--;
+  if (job->running == 0 && job->nextblock >= job->nblocks) {
+    pthread_cond_broadcast(&pool->blockDone);
   }
-
-  result = RAVE_OBJECT_COPY(param);
-done:
-  RAVE_OBJECT_RELEASE(param);
-  return result;
 }
 
 /**
- * Adds a data 2d field as a quality field to provided scan
- * @param[in] scan - the scan that should get the quality field associated
- * @param[in] data2d - the 2d data field
- * @param[in] qualityName - the how/task name
- * @returns 1 on success otherwise 0
+ * The worker thread function. Processes blocks from the queued jobs until the pool is shut down.
+ * @param[in] arg - the pool
+ * @returns NULL
  */
-static int PdpProcessorInternal_addRaveQualityFieldToScanFromData2D(PolarScan_t* scan, RaveData2D_t* data2d, const char* qualityName)
+static void* PdpProcessorInternal_poolWorker(void* arg)
 {
-  int result = 0;
-  RaveField_t* field = NULL;
-  RaveAttribute_t *attr = NULL, *gainAttr = NULL, *offsetAttr = NULL;
-  long nrays, nbins, bi, ri;
-  double minv, maxv;
-  double spread = 0.0, gain = 0.0, offset = 0.0;
-  int usingNodata = 0;
-  double nodata;
+  PdpProcessorInternal_ThreadPool* pool = (PdpProcessorInternal_ThreadPool*)arg;
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    PdpProcessorInternal_Job* job = NULL;
+    while (!pool->shutdown && pool->jobs == NULL) {
+      pthread_cond_wait(&pool->workAvailable, &pool->lock);
+    }
+    if (pool->jobs == NULL) {
+      break;
+    }
+    job = pool->jobs;
+    PdpProcessorInternal_runBlock(pool, job, PdpProcessorInternal_claimBlock(pool, job));
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
 
-  if (scan == NULL || data2d == NULL) {
-    RAVE_ERROR0("scan or data2d is NULL");
-    goto done;
+/**
+ * Creates a pool with nthreads - 1 workers since the submitting thread always processes blocks as well. If not all
+ * workers can be started the pool is used with the ones that could.
+ * @param[in] nthreads - the number of threads
+ * @returns the pool or NULL if memory couldn't be allocated
+ */
+static PdpProcessorInternal_ThreadPool* PdpProcessorInternal_createPool(long nthreads)
+{
+  PdpProcessorInternal_ThreadPool* pool = RAVE_MALLOC(sizeof(PdpProcessorInternal_ThreadPool));
+  if (pool == NULL) {
+    return NULL;
   }
-  field = RAVE_OBJECT_NEW(&RaveField_TYPE);
-  if (field == NULL) {
-    goto done;
+  memset(pool, 0, sizeof(PdpProcessorInternal_ThreadPool));
+  pool->threads = RAVE_MALLOC(sizeof(pthread_t) * (nthreads - 1));
+  if (pool->threads == NULL) {
+    RAVE_FREE(pool);
+    return NULL;
   }
-  if (!RaveField_createData(field, RaveData2D_getXsize(data2d), RaveData2D_getYsize(data2d), RaveDataType_UCHAR)) {
-    goto done;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->workAvailable, NULL);
+  pthread_cond_init(&pool->blockDone, NULL);
+  pool->nthreads = nthreads;
+  while (pool->nworkers < nthreads - 1 &&
+         pthread_create(&pool->threads[pool->nworkers], NULL, PdpProcessorInternal_poolWorker, pool) == 0) {
+    pool->nworkers++;
   }
-
-  minv = RaveData2D_min(data2d);
-  maxv = RaveData2D_max(data2d);
-
-  spread = (maxv - minv) / 254;
-  offset = minv;
-  gain = spread;
-
-  if (gain == 0.0) {
-    RAVE_ERROR0("gain = 0.0");
-    goto done;
+  if (pool->nworkers < nthreads - 1) {
+    RAVE_WARNING2("Could only start %ld of %ld worker threads", pool->nworkers, nthreads - 1);
   }
-  attr = RaveAttributeHelp_createString("how/task", qualityName);
-  gainAttr = RaveAttributeHelp_createDouble("what/gain", gain);
-  offsetAttr = RaveAttributeHelp_createDouble("what/offset", offset);
+  return pool;
+}
 
-  if (attr == NULL || gainAttr == NULL || offsetAttr == NULL) {
-    goto done;
+/**
+ * Shuts down the workers and destroys the pool. The pool must not be used by anyone.
+ * @param[in] pool - the pool, may be NULL
+ */
+static void PdpProcessorInternal_destroyPool(PdpProcessorInternal_ThreadPool* pool)
+{
+  long i = 0;
+  if (pool == NULL) {
+    return;
   }
-  if (!RaveField_addAttribute(field, attr) || !RaveField_addAttribute(field, gainAttr) || !RaveField_addAttribute(field, offsetAttr)) {
-    goto done;
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->workAvailable);
+  pthread_mutex_unlock(&pool->lock);
+  for (i = 0; i < pool->nworkers; i++) {
+    pthread_join(pool->threads[i], NULL);
   }
-  nrays = PolarScan_getNrays(scan);
-  nbins = PolarScan_getNbins(scan);
-  nodata = RaveData2D_getNodata(data2d);
-  usingNodata = RaveData2D_usingNodata(data2d);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->workAvailable);
+  pthread_cond_destroy(&pool->blockDone);
+  RAVE_FREE(pool->threads);
+  RAVE_FREE(pool);
+}
 
-  for (bi = 0; bi < nbins; bi++) {
-    for (ri = 0; ri < nrays; ri++) {
-      double v = 0.0;
-      RaveData2D_getValueUnchecked(data2d, bi, ri, &v);
-      if (!usingNodata || nodata != v) {
-        RaveField_setValue(field, bi, ri, (v - offset)/gain);
-      } else {
-        RaveField_setValue(field, bi, ri, 255);
-      }
+/**
+ * Returns the pool of the processor for the current number of threads (see \ref PdpProcessorInternal_getNumberOfThreads).
+ * The pool is created when first needed and replaced when the number of threads has changed. A replaced pool is
+ * destroyed when the last processing using it releases it.
+ * @param[in] self - self
+ * @param[in] nthreads - the number of threads, must be > 1
+ * @returns the pool that must be released with \ref PdpProcessorInternal_releasePool or NULL if it couldn't be created
+ */
+static PdpProcessorInternal_ThreadPool* PdpProcessorInternal_acquirePool(PdpProcessor_t* self, long nthreads)
+{
+  PdpProcessorInternal_ThreadPool *result = NULL, *retired = NULL;
+  pthread_mutex_lock(&self->poolLock);
+  if (self->pool != NULL && self->pool->nthreads != nthreads) {
+    self->pool->retired = 1;
+    if (self->pool->users == 0) {
+      retired = self->pool;
     }
+    self->pool = NULL;
   }
-  if (!PolarScan_addQualityField(scan, field)) {
-    goto done;
+  if (self->pool == NULL) {
+    self->pool = PdpProcessorInternal_createPool(nthreads);
   }
-  result = 1;
-done:
-  RAVE_OBJECT_RELEASE(field);
-  RAVE_OBJECT_RELEASE(attr);
-  RAVE_OBJECT_RELEASE(gainAttr);
-  RAVE_OBJECT_RELEASE(offsetAttr);
-
+  if (self->pool != NULL) {
+    self->pool->users++;
+    result = self->pool;
+  }
+  pthread_mutex_unlock(&self->poolLock);
+  PdpProcessorInternal_destroyPool(retired);
   return result;
 }
 
 /**
- * Returns the parameter data field as a converted data 2d field
- * @param[in] param - the scan param
- * @param[in] nodata - the nodata value that should be used for the returned data 2d field
- * @returns the data 2d field on success otherwise NULL
- */
-RaveData2D_t* PdpProcessorInternal_getData2DFromParam(PolarScanParam_t* param, double nodata)
-{
-  RaveData2D_t *result = NULL, *data2d = NULL;
-  if (param != NULL) {
-    long nrays = PolarScanParam_getNrays(param);
-    long nbins = PolarScanParam_getNbins(param);
-
-    data2d = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
-    if (data2d != NULL) {
-      long ri, bi;
-      RaveData2D_setNodata(data2d, nodata);
-      RaveData2D_useNodata(data2d, 1);
-      for (ri = 0; ri < nrays; ri++) {
-        for (bi = 0; bi < nbins; bi++) {
-          double v = 0.0;
-          RaveValueType t = PolarScanParam_getConvertedValue(param, bi, ri, &v);
-          if (t == RaveValueType_DATA) {
-            RaveData2D_setValueUnchecked(data2d, bi, ri, v);
-          } else if (t == RaveValueType_UNDETECT) {
-            RaveData2D_setValueUnchecked(data2d, bi, ri, PolarScanParam_getUndetect(param)*PolarScanParam_getGain(param) + PolarScanParam_getOffset(param));
-          } else {
-            RaveData2D_setValueUnchecked(data2d, bi, ri, nodata);
-          }
-        }
-      }
-      result = RAVE_OBJECT_COPY(data2d);
-    }
+ * Releases a pool returned by \ref PdpProcessorInternal_acquirePool.
+ * @param[in] self - self
+ * @param[in] pool - the pool, may be NULL
+ */
+static void PdpProcessorInternal_releasePool(PdpProcessor_t* self, PdpProcessorInternal_ThreadPool* pool)
+{
+  int destroy = 0;
+  if (pool == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&self->poolLock);
+  pool->users--;
+  destroy = (pool->retired && pool->users == 0);
+  pthread_mutex_unlock(&self->poolLock);
+  if (destroy) {
+    PdpProcessorInternal_destroyPool(pool);
   }
-  RAVE_OBJECT_RELEASE(data2d);
-  return result;
 }
 
 /**
- * @returns the current time in milliseconds since epoch
+ * Splits the n items (rays or scans) into nblocks blocks and processes them with the workers of the pool. The calling
+ * thread processes blocks of its own job as well and returns when all blocks have finished. Since the caller never
+ * waits for anything but blocks that are already running, kernels are allowed to dispatch jobs themselves, which is
+ * how the scans of a volume dispatch their ray blocks. The kernel function must only write to the items in the provided
+ * block but it is allowed to read from any item (like neighbouring rays in the texture) as long as the data is not
+ * modified by the same kernel. If there is no pool the items are processed serially so this function never fails.
+ * @param[in] pool - the pool, may be NULL
+ * @param[in] nblocks - the wanted number of blocks
+ * @param[in] n - the number of items
+ * @param[in] fun - the kernel function
+ * @param[in] arg - the kernel arguments
  */
-static long long PdpProcessorInternal_timestamp(void) {
-    struct timeval te;
-    gettimeofday(&te, NULL);
-    long long milliseconds = te.tv_sec*1000LL + te.tv_usec/1000;
-    return milliseconds;
+static void PdpProcessorInternal_dispatch(PdpProcessorInternal_ThreadPool* pool, long nblocks, long n, PdpProcessorInternal_rayBlockFunction fun, void* arg)
+{
+  PdpProcessorInternal_Job job;
+  PdpProcessorInternal_Job** pjob = NULL;
+
+  if (nblocks > n) {
+    nblocks = n;
+  }
+  if (pool == NULL || pool->nworkers == 0 || nblocks <= 1) {
+    fun(arg, 0, n);
+    return;
+  }
+
+  job.fun = fun;
+  job.arg = arg;
+  job.n = n;
+  job.nblocks = nblocks;
+  job.nextblock = 0;
+  job.running = 0;
+  job.next = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  for (pjob = &pool->jobs; *pjob != NULL; pjob = &(*pjob)->next);
+  *pjob = &job;
+  pthread_cond_broadcast(&pool->workAvailable);
+  while (job.nextblock < job.nblocks) {
+    PdpProcessorInternal_runBlock(pool, &job, PdpProcessorInternal_claimBlock(pool, &job));
+  }
+  while (job.running > 0) {
+    pthread_cond_wait(&pool->blockDone, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
 }
 
-/*@} End of Private functions */
+/**
+ * How the ray blocks of the current thread are dispatched when processing a volume, see \ref PdpProcessorInternal_setDispatch.
+ */
+typedef struct PdpProcessorInternal_Dispatch {
+  PdpProcessorInternal_ThreadPool* pool; /**< the pool of the volume processing */
+  long nthreads; /**< the number of threads each scan may use for its rays */
+} PdpProcessorInternal_Dispatch;
 
-/*@{ Interface functions */
-//void PdpProcessor_setRequestedFields(PdpProcessor_t* self, int fieldmask)
-//{
-//  RAVE_ASSERT((self != NULL), "self == NULL");
-//  PpcRadarOptions_setRequestedFields(self->options, fieldmask);
-//  //self->requestedFieldMask = fieldmask;
-//
-//int PdpProcessor_getRequestedFields(PdpProcessor_t* self)
-//{
-//  RAVE_ASSERT((self != NULL), "self == NULL");
-//  return PpcRadarOptions_getRequestedFields(self->options);
-//}
+/**
+ * Key to the dispatch of the current thread.
+ */
+static pthread_key_t PdpProcessorInternal_dispatchKey;
 
-int PdpProcessor_setRadarOptions(PdpProcessor_t* self, PpcRadarOptions_t* options)
+/**
+ * Makes sure that \ref PdpProcessorInternal_dispatchKey only is created once.
+ */
+static pthread_once_t PdpProcessorInternal_dispatchKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Creates the dispatch key.
+ */
+static void PdpProcessorInternal_createDispatchKey(void)
 {
-  RAVE_ASSERT((self != NULL), "self == NULL");
-  if (options == NULL) {
-    return 0;
-  }
-  RAVE_OBJECT_RELEASE(self->options);
-  self->options = RAVE_OBJECT_COPY(options);
-  return 1;
+  pthread_key_create(&PdpProcessorInternal_dispatchKey, NULL);
 }
 
-PpcRadarOptions_t* PdpProcessor_getRadarOptions(PdpProcessor_t* self)
+/**
+ * Sets how the current thread should dispatch its ray blocks. Used by the scans of a volume so that they use the pool
+ * and the share of the threads that the volume processing has given them instead of acquiring the pool themselves.
+ * @param[in] dispatch - the dispatch, NULL to acquire the pool of the processor for each kernel
+ */
+static void PdpProcessorInternal_setDispatch(PdpProcessorInternal_Dispatch* dispatch)
 {
-  return RAVE_OBJECT_COPY(self->options);
+  pthread_once(&PdpProcessorInternal_dispatchKeyOnce, PdpProcessorInternal_createDispatchKey);
+  pthread_setspecific(PdpProcessorInternal_dispatchKey, dispatch);
 }
 
-static void disp_int(RaveData2D_t* field, int bmin_limit, int rmin_limit, int bmax_limit, int rmax_limit)
+/**
+ * Splits the rays into one block per thread (see \ref PdpProcessorInternal_getNumberOfThreads) and processes
+ * the blocks in parallel using \ref PdpProcessorInternal_dispatch. When the current thread is processing a scan
+ * of a volume the rays are split according to the dispatch of the volume instead.
+ * @param[in] self - self
+ * @param[in] nrays - the number of rays
+ * @param[in] fun - the kernel function
+ * @param[in] arg - the kernel arguments
+ */
+static void PdpProcessorInternal_processRayBlocks(PdpProcessor_t* self, long nrays, PdpProcessorInternal_rayBlockFunction fun, void* arg)
 {
-  int bi, ri, nbins, nrays;
-  nbins = RaveData2D_getXsize(field);
-  nrays = RaveData2D_getYsize(field);
-  for (bi = 0; bi < nbins; bi++) {
-    for (ri = 0; ri < nrays; ri++) {
-      double v = 0.0;
-      RaveData2D_getValueUnchecked(field, bi, ri, &v);
-      if (bi>=bmin_limit && bi <bmax_limit && ri>=rmin_limit&&ri<rmax_limit) {
-        fprintf(stderr, "%f   ", v);
-      }
-    }
-    if (bi>=bmin_limit && bi <bmax_limit) { fprintf(stderr, "\n"); }
+  PdpProcessorInternal_Dispatch* dispatch = NULL;
+  long nthreads = 0;
+
+  pthread_once(&PdpProcessorInternal_dispatchKeyOnce, PdpProcessorInternal_createDispatchKey);
+  dispatch = (PdpProcessorInternal_Dispatch*)pthread_getspecific(PdpProcessorInternal_dispatchKey);
+  if (dispatch != NULL) {
+    PdpProcessorInternal_dispatch(dispatch->pool, dispatch->nthreads, nrays, fun, arg);
+    return;
+  }
+
+  nthreads = PdpProcessorInternal_getNumberOfThreads(self);
+  if (nthreads <= 1 || nrays <= 1) {
+    fun(arg, 0, nrays);
+  } else {
+    PdpProcessorInternal_ThreadPool* pool = PdpProcessorInternal_acquirePool(self, nthreads);
+    PdpProcessorInternal_dispatch(pool, nthreads, nrays, fun, arg);
+    PdpProcessorInternal_releasePool(self, pool);
   }
-  fprintf(stderr, "\n");
 }
 
-static void disp_sint(const char* msg, RaveData2D_t* field, int bmin_limit, int rmin_limit, int bmax_limit, int rmax_limit)
+/**
+ * @param[in] self - self
+ * @returns the data type of the fields in the processing chain
+ */
+static RaveDataType PdpProcessorInternal_getDataType(PdpProcessor_t* self)
 {
-  fprintf(stderr, "%s\n", msg);
-  disp_int(field, bmin_limit, rmin_limit, bmax_limit, rmax_limit);
+  return (RaveDataType)PpcRadarOptions_getProcessingPrecision(self->options);
 }
 
-PolarScan_t* PdpProcessor_process(PdpProcessor_t* self, PolarScan_t* scan, RaveData2D_t* sclutterMap)
+/**
+ * Rounds a value to the processing precision. Nodata and flag values must be rounded when the fields
+ * are stored as float, otherwise the values read from the fields never compares equal to them.
+ * @param[in] self - self
+ * @param[in] v - the value
+ * @returns the value as it will be stored in a field
+ */
+static double PdpProcessorInternal_toPrecision(PdpProcessor_t* self, double v)
 {
-  PolarScan_t *result = NULL, *tmpresult = NULL;
-  double elangle = 0.0;
-  double range = 0.0, rangeKm = 0.0;
-  long nbins = 0, nrays = 0;
-  long bi = 0, ri = 0;
-  double nodataPHIDP = 0.0, nodataTH = 0.0, nodataZDR = 0.0, nodataDBZH = 0.0, nodataRHOHV = 0.0;
-  double flag = -999.9;
-  double undetectTH = 0.0;
-  RaveData2D_t *dataTH = NULL, *dataZDR = NULL, *dataDV = NULL, *texturePHIDP = NULL, *dataDBZH = NULL;
-  RaveData2D_t *dataRHOHV = NULL, *textureZ = NULL, *dataPHIDP = NULL, *dataPDP = NULL;
-  RaveData2D_t *clutterMap = NULL, *residualClutterMask = NULL;
-  RaveData2D_t *outZ = NULL, *outQuality = NULL, *outClutterMask = NULL;
-  RaveData2D_t *outPDP = NULL, *outKDP = NULL, *attenuationMask = NULL;
-  RaveData2D_t *outAttenuationZ = NULL, *outAttenuationZDR = NULL, *outAttenuationPIA = NULL, *outAttenuationDBZH = NULL;
-  RaveData2D_t *outZPHI = NULL, *outAH = NULL;
-  RaveData2D_t *thThresholdIndex = NULL;
-  RaveField_t* pdpQualityField = NULL;
-  PolarScanParam_t *correctedZ = NULL, *correctedZDR = NULL, *attCorrectedZDR = NULL, *correctedZPHI = NULL, *attenuatedZ = NULL, *correctedDBZH = NULL, *attenuatedDBZH = NULL;
-  PolarScanParam_t *paramKDP = NULL, *paramRHOHV = NULL, *correctedPDP = NULL;
-  PolarNavigator_t* navigator = NULL;
-  PolarScanParam_t *TH = NULL, *ZDR = NULL, *DV = NULL, *PHIDP = NULL, *RHOHV = NULL, *DBZH = NULL;
-  double nodata, qualityThreshold, residualClutterMaskNodata, minAttenuationMaskRHOHV, minAttenuationMaskKDP, minAttenuationMaskTH;
-
-  long starttime = PdpProcessorInternal_timestamp();
-
-  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (PdpProcessorInternal_getDataType(self) == RaveDataType_FLOAT) {
+    return (double)(float)v;
+  }
+  return v;
+}
 
-  if (scan == NULL) {
-    RAVE_ERROR0("No scan provided");
-    goto done;
+/**
+ * Reads raw values as doubles.
+ * @param[in] data - the raw data
+ * @param[in] type - the type of the raw data
+ * @param[in] offset - index of the first value
+ * @param[in] n - number of values
+ * @param[out] out - the values, must be able to hold n values
+ * @returns 1 on success or 0 if the type isn't supported
+ */
+static int PdpProcessorInternal_getRawValues(const void* data, RaveDataType type, long offset, long n, double* out)
+{
+  long x;
+
+  switch (type) {
+  case RaveDataType_CHAR:
+    for (x = 0; x < n; x++) out[x] = (double)((const char*)data)[offset + x];
+    break;
+  case RaveDataType_UCHAR:
+    for (x = 0; x < n; x++) out[x] = (double)((const unsigned char*)data)[offset + x];
+    break;
+  case RaveDataType_SHORT:
+    for (x = 0; x < n; x++) out[x] = (double)((const short*)data)[offset + x];
+    break;
+  case RaveDataType_USHORT:
+    for (x = 0; x < n; x++) out[x] = (double)((const unsigned short*)data)[offset + x];
+    break;
+  case RaveDataType_INT:
+    for (x = 0; x < n; x++) out[x] = (double)((const int*)data)[offset + x];
+    break;
+  case RaveDataType_UINT:
+    for (x = 0; x < n; x++) out[x] = (double)((const unsigned int*)data)[offset + x];
+    break;
+  case RaveDataType_LONG:
+    for (x = 0; x < n; x++) out[x] = (double)((const long*)data)[offset + x];
+    break;
+  case RaveDataType_ULONG:
+    for (x = 0; x < n; x++) out[x] = (double)((const unsigned long*)data)[offset + x];
+    break;
+  case RaveDataType_FLOAT:
+    for (x = 0; x < n; x++) out[x] = (double)((const float*)data)[offset + x];
+    break;
+  case RaveDataType_DOUBLE:
+    memcpy(out, (const double*)data + offset, sizeof(double) * n);
+    break;
+  default:
+    return 0;
   }
+  return 1;
+}
 
-  nodata = PpcRadarOptions_getNodata(self->options);
-  navigator = PolarScan_getNavigator(scan);
+/**
+ * Reads one ray of a field as doubles. The values are the same as returned by RaveData2D_getValueUnchecked.
+ * @param[in] field - the field
+ * @param[in] y - the ray
+ * @param[out] out - the values, must be able to hold xsize values
+ */
+static void PdpProcessorInternal_getRay(RaveData2D_t* field, long y, double* out)
+{
+  long xsize = RaveData2D_getXsize(field);
+  long x;
 
-  elangle = PolarScan_getElangle(scan);
+  if (!PdpProcessorInternal_getRawValues(RaveData2D_getData(field), RaveData2D_getType(field), y * xsize, xsize, out)) {
+    for (x = 0; x < xsize; x++) RaveData2D_getValueUnchecked(field, x, y, &out[x]);
+  }
+}
 
-  range = PolarScan_getRscale(scan);
-  rangeKm =  range / 1000.0;
-  nbins = PolarScan_getNbins(scan);
-  nrays = PolarScan_getNrays(scan);
-
-  TH = PolarScan_getParameter(scan, "TH");
-  ZDR = PolarScan_getParameter(scan, "ZDR");
-  DV = PolarScan_getParameter(scan, "VRADH");
-  PHIDP = PolarScan_getParameter(scan, "PHIDP");
-  RHOHV = PolarScan_getParameter(scan, "RHOHV");
-  DBZH = PolarScan_getParameter(scan, "DBZH");
-  if (TH == NULL || ZDR == NULL || DV == NULL || PHIDP == NULL || RHOHV == NULL || DBZH == NULL) {
-    RAVE_ERROR0("Can not generate PPC product since one or more of TH, ZDR, DV, PHIDP, RHOHV and DBZH is missing");
-    goto done;
-  }
-
-  dataTH = PdpProcessorInternal_getData2DFromParam(TH, nodata);
-  dataZDR = PdpProcessorInternal_getData2DFromParam(ZDR, nodata);
-  dataDV = PdpProcessorInternal_getData2DFromParam(DV, nodata);
-  dataPHIDP = PdpProcessorInternal_getData2DFromParam(PHIDP, nodata);
-  dataRHOHV = PdpProcessorInternal_getData2DFromParam(RHOHV, nodata);
-  dataDBZH = PdpProcessorInternal_getData2DFromParam(DBZH, PolarScanParam_getNodata(DBZH));
-  if (dataTH == NULL || dataZDR == NULL || dataDV == NULL || dataPHIDP == NULL || dataRHOHV == NULL || dataDBZH == NULL) {
-    RAVE_ERROR0("Can not generate PPC product since one or more of data fields for TH, ZDR, DV, PHIDP, RHOHV and DBZH not could be retrieved");
-    goto done;
-  }
-
-  if (sclutterMap != NULL) {
-    if (RaveData2D_getXsize(sclutterMap) != nbins || RaveData2D_getYsize(sclutterMap) != nrays) {
-      RAVE_ERROR0("Clutter Map dimension doesn't match number of rays/bins rays == ysize, bins = xsize");
-      goto done;
-    }
-    clutterMap = RAVE_OBJECT_COPY(sclutterMap);
+/**
+ * Writes one ray of a field from doubles.
+ * @param[in] field - the field
+ * @param[in] y - the ray
+ * @param[in] in - the values, xsize values
+ */
+static void PdpProcessorInternal_setRay(RaveData2D_t* field, long y, const double* in)
+{
+  long xsize = RaveData2D_getXsize(field);
+  void* data = RaveData2D_getData(field);
+  long x;
+
+  if (RaveData2D_getType(field) == RaveDataType_DOUBLE) {
+    memcpy((double*)data + y * xsize, in, sizeof(double) * xsize);
+  } else if (RaveData2D_getType(field) == RaveDataType_FLOAT) {
+    for (x = 0; x < xsize; x++) ((float*)data)[y * xsize + x] = (float)in[x];
   } else {
-    clutterMap = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
-    if (clutterMap == NULL) {
-      RAVE_ERROR0("Could not create clutter map");
-      goto done;
-    }
-    RaveData2D_useNodata(clutterMap, 1);
-    RaveData2D_setNodata(clutterMap, 0.0);
+    for (x = 0; x < xsize; x++) RaveData2D_setValueUnchecked(field, x, y, in[x]);
   }
+}
 
-  if (PpcRadarOptions_getInvertPHIDP(self->options) == 1) {
-    dataPDP = RaveData2D_mulNumber(dataPHIDP, -1.0); /** RSP produces inverted data */
-  } else {
-    dataPDP = RaveData2D_mulNumber(dataPHIDP, 1.0); /* Really don't do anything.*/
+/**
+ * Returns a zero filled field, reusing a buffer from the workspace if there is one attached.
+ * The size of the field is added to the current statistics.
+ * @param[in] self - self
+ * @param[in] xsize - number of bins
+ * @param[in] ysize - number of rays
+ * @param[in] type - the data type
+ * @return the field or NULL on failure
+ */
+static RaveData2D_t* PdpProcessorInternal_zeros(PdpProcessor_t* self, long xsize, long ysize, RaveDataType type)
+{
+  PdpStats_t* stats = PdpProcessorInternal_getCurrentStats();
+  if (stats != NULL) {
+    PdpStats_addBytes(stats, get_ravetype_size(type) * xsize * ysize);
   }
-  if (dataPDP == NULL) {
-    RAVE_ERROR0("Failed to multiplicate PHIDP");
-    goto done;
+  if (self->workspace != NULL) {
+    return PdpWorkspace_zeros(self->workspace, xsize, ysize, type);
   }
-  nodataPHIDP = nodata;
-  nodataTH = nodata;
-  nodataDBZH = PolarScanParam_getNodata(DBZH);
-  nodataZDR = nodata;
-  nodataRHOHV = nodata;
-  undetectTH = PolarScanParam_getUndetect(TH)*PolarScanParam_getGain(TH) + PolarScanParam_getOffset(TH);
+  return RaveData2D_zeros(xsize, ysize, type);
+}
 
-  thThresholdIndex = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
-  if (thThresholdIndex == NULL) {
-    goto done;
+/**
+ * Returns a field filled with 1, reusing a buffer from the workspace if there is one attached.
+ * The size of the field is added to the current statistics.
+ * @param[in] self - self
+ * @param[in] xsize - number of bins
+ * @param[in] ysize - number of rays
+ * @param[in] type - the data type
+ * @return the field or NULL on failure
+ */
+static RaveData2D_t* PdpProcessorInternal_ones(PdpProcessor_t* self, long xsize, long ysize, RaveDataType type)
+{
+  PdpStats_t* stats = PdpProcessorInternal_getCurrentStats();
+  if (stats != NULL) {
+    PdpStats_addBytes(stats, get_ravetype_size(type) * xsize * ysize);
   }
-  for (bi = 0; bi < nbins; bi++) {
-    for (ri = 0; ri < nrays; ri++) {
-      double v;
-      RaveData2D_getValueUnchecked(dataTH, bi, ri, &v);
-      if (v < PpcRadarOptions_getPreprocessZThreshold(self->options)) {
-        RaveData2D_setValueUnchecked(thThresholdIndex, bi, ri, 1.0);
-        RaveData2D_setValueUnchecked(dataTH, bi, ri, nodataTH);
-        RaveData2D_setValueUnchecked(dataZDR, bi, ri, nodataZDR);
-        RaveData2D_setValueUnchecked(dataPDP, bi, ri, nodataPHIDP);
-        RaveData2D_setValueUnchecked(dataPHIDP, bi, ri, nodataPHIDP);
-        RaveData2D_setValueUnchecked(dataRHOHV, bi, ri, nodataRHOHV);
-      }
-    }
+  if (self->workspace != NULL) {
+    return PdpWorkspace_ones(self->workspace, xsize, ysize, type);
   }
+  return RaveData2D_ones(xsize, ysize, type);
+}
 
-  texturePHIDP = PdpProcessor_texture(self, dataPDP);
+/**
+ * Releases the field and gives it back to the workspace if there is one attached.
+ * @param[in] self - self
+ * @param[in,out] field - the field, will be NULL after call
+ */
+static void PdpProcessorInternal_recycle(PdpProcessor_t* self, RaveData2D_t** field)
+{
+  if (self->workspace != NULL) {
+    PdpWorkspace_recycle(self->workspace, field);
+  } else {
+    RAVE_OBJECT_RELEASE(*field);
+  }
+}
 
-  textureZ = PdpProcessor_texture(self, dataTH);
+/**
+ * Conversion of one scan param to a field, see \ref PdpProcessorInternal_getData2DFromParams.
+ */
+typedef struct PdpProcessorInternal_Conversion {
+  const void* raw; /**< the raw data, NULL if the param has no data */
+  RaveDataType rawType; /**< type of the raw data */
+  double gain; /**< gain of the param */
+  double offset; /**< offset of the param */
+  double nodata; /**< raw nodata of the param */
+  double undetect; /**< raw undetect of the param */
+  double undetectValue; /**< the converted undetect value */
+  double fieldNodata; /**< nodata of the field */
+  double* table; /**< converted value for every raw value of 8 and 16 bit params, otherwise NULL */
+  RaveData2D_t* field; /**< the resulting field */
+} PdpProcessorInternal_Conversion;
 
-  /**************************************************************
-   * Clutter removal by using a Fuzzy Logic Approach
-   **************************************************************/
-  qualityThreshold = PpcRadarOptions_getQualityThreshold(self->options);
+/**
+ * Arguments used when converting scan params to fields
+ */
+typedef struct PdpProcessorInternal_ConvertArgs {
+  long nbins; /**< number of bins */
+  long nconversions; /**< number of conversions */
+  PdpProcessorInternal_Conversion* conversions; /**< the conversions */
+  int failed; /**< set to 1 if a kernel failed to allocate memory */
+} PdpProcessorInternal_ConvertArgs;
 
-  RAVE_DEBUG1("clutterMap: %d", RaveData2D_usingNodata(clutterMap));
-  if (!RaveData2D_usingNodata(clutterMap)) {
-    RAVE_ERROR0("Static clutter map doesn't specify nodata!");
-  }
-  if (!PdpProcessor_clutterCorrection(self, dataTH, dataDV, texturePHIDP, dataRHOHV, textureZ, clutterMap,
-        PolarScanParam_getNodata(TH), PolarScanParam_getNodata(DV), qualityThreshold,
-        &outZ, &outQuality, &outClutterMask)) {
-    goto done;
+/**
+ * Converts raw values to physical values in place. Values equal to nodata gets the nodata of the field and
+ * values equal to undetect gets the converted undetect value, the same as \ref PolarScanParam_getConvertedValue.
+ * @param[in] conversion - the conversion
+ * @param[in,out] values - the raw values
+ * @param[in] n - number of values
+ */
+static void PdpProcessorInternal_convertValues(PdpProcessorInternal_Conversion* conversion, double* values, long n)
+{
+  double gain = conversion->gain, offset = conversion->offset, nodata = conversion->nodata, undetect = conversion->undetect;
+  double undetectValue = conversion->undetectValue, fieldNodata = conversion->fieldNodata;
+  long x;
+  /* Branch free so that the loop can be vectorized */
+  for (x = 0; x < n; x++) {
+    double v = values[x];
+    values[x] = (v == nodata) ? fieldNodata : ((v == undetect) ? undetectValue : offset + v * gain);
   }
-  RAVE_OBJECT_RELEASE(outZ); /* Not used in matlab */
-
-  //disp_sint("QualityMap:", outQuality, 14, 153, 18, 158);
-  //disp_sint("QualityMap:", outQuality, 153, 14, 158, 18);
+}
 
-  for (bi = 0; bi < nbins; bi++) {
-    for (ri = 0; ri < nrays; ri++) {
-      double v = 0.0;
-      RaveData2D_getValueUnchecked(outQuality, bi, ri, &v);
-      if (v < qualityThreshold) {
-        RaveData2D_setValueUnchecked(dataTH, bi, ri, undetectTH);
-        RaveData2D_setValueUnchecked(dataZDR, bi, ri, nodataZDR);
-        RaveData2D_setValueUnchecked(dataPHIDP, bi, ri, nodataPHIDP);
-        RaveData2D_setValueUnchecked(dataPDP, bi, ri, nodataPHIDP);
-        RaveData2D_setValueUnchecked(dataRHOHV, bi, ri, nodataRHOHV);
-        RaveData2D_setValueUnchecked(dataDBZH, bi, ri, nodataDBZH);
+/**
+ * Converts the params for the provided rays. All params are converted in the same sweep over the rays.
+ */
+static void PdpProcessorInternal_convertRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_ConvertArgs* args = (PdpProcessorInternal_ConvertArgs*)arg;
+  long nbins = args->nbins, x, y, i;
+  double* row = NULL;
+
+  row = RAVE_MALLOC(sizeof(double) * nbins);
+  if (row == NULL) {
+    args->failed = 1;
+    return;
+  }
+  for (y = startray; y < endray; y++) {
+    for (i = 0; i < args->nconversions; i++) {
+      PdpProcessorInternal_Conversion* conversion = &args->conversions[i];
+      if (conversion->raw == NULL) {
+        for (x = 0; x < nbins; x++) row[x] = conversion->fieldNodata;
+      } else if (conversion->table != NULL && conversion->rawType == RaveDataType_UCHAR) {
+        const unsigned char* raw = (const unsigned char*)conversion->raw + y * nbins;
+        for (x = 0; x < nbins; x++) row[x] = conversion->table[raw[x]];
+      } else if (conversion->table != NULL) {
+        const unsigned short* raw = (const unsigned short*)conversion->raw + y * nbins;
+        for (x = 0; x < nbins; x++) row[x] = conversion->table[raw[x]];
+      } else {
+        PdpProcessorInternal_getRawValues(conversion->raw, conversion->rawType, y * nbins, nbins, row);
+        PdpProcessorInternal_convertValues(conversion, row, nbins);
       }
+      PdpProcessorInternal_setRay(conversion->field, y, row);
     }
   }
+  RAVE_FREE(row);
+}
 
-  /**************************************************************
-   * MEDIAN FILTERING TO REMOVE RESIDUAL ISOLATED PIXELS AFFECTED BY CLUTTER
-   **************************************************************/
-  residualClutterMask = PdpProcessor_residualClutterFilter(self, dataTH,
-      PpcRadarOptions_getResidualThresholdZ(self->options),
-      PpcRadarOptions_getResidualThresholdTexture(self->options),
-      PpcRadarOptions_getResidualFilterBinSize(self->options),
-      PpcRadarOptions_getResidualFilterRaySize(self->options));
-  if (residualClutterMask == NULL) {
-    goto done;
-  }
-
-  /**************************************************************
-   * PHIDP Filtering and Kdp retrieval
-   **************************************************************/
+/**
+ * Converts the scan params to data 2d fields with physical values in one sweep over the rays. Undetect is converted
+ * with gain and offset and nodata gets the nodata of the field. 8 bit params, and 16 bit params with more pixels than
+ * raw values, are converted with a lookup table, other types are converted with gain and offset directly.
+ * All params must have the same geometry.
+ * @param[in] self - self
+ * @param[in] nparams - number of params
+ * @param[in] params - the scan params
+ * @param[in] nodata - the nodata value of each field
+ * @param[in] type - the data type of the fields, RaveDataType_DOUBLE or RaveDataType_FLOAT
+ * @param[out] fields - the resulting fields
+ * @returns 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_getData2DFromParams(PdpProcessor_t* self, long nparams, PolarScanParam_t** params,
+    const double* nodata, RaveDataType type, RaveData2D_t** fields)
+{
+  PdpProcessorInternal_Conversion* conversions = NULL;
+  PdpProcessorInternal_ConvertArgs args;
+  long nbins = 0, nrays = 0, i = 0, r = 0;
+  int result = 0;
 
-  if (!PdpProcessor_pdpScript(self, dataPDP, rangeKm,
-      PpcRadarOptions_getPdpRWin1(self->options),
-      PpcRadarOptions_getPdpRWin2(self->options),
-      PpcRadarOptions_getPdpNrIterations(self->options), &outPDP, &outKDP)) {
-    goto done;
+  if (nparams <= 0) {
+    return 1;
   }
-  residualClutterMaskNodata = PpcRadarOptions_getResidualClutterMaskNodata(self->options);
-
-  for (bi = 0; bi < nbins; bi++) {
-    for (ri = 0; ri < nrays; ri++) {
-      double v = 0.0, tv = 0.0;
-      RaveData2D_getValueUnchecked(residualClutterMask, bi, ri, &v);
-      if (v == 0.0 || v == residualClutterMaskNodata) {
-        RaveData2D_setValueUnchecked(dataTH, bi, ri, undetectTH);
-        RaveData2D_setValueUnchecked(dataZDR, bi, ri, flag);
-        RaveData2D_setValueUnchecked(dataRHOHV, bi, ri, flag);
-        RaveData2D_setValueUnchecked(dataDV, bi, ri, flag);
-      }
-
-      RaveData2D_getValueUnchecked(thThresholdIndex, bi, ri, &tv);
-      RaveData2D_getValueUnchecked(dataTH, bi, ri, &v);
-      if (tv == 1.0 || v < -900.0) {
-        RaveData2D_setValueUnchecked(outPDP, bi, ri, undetectTH);
-      }
+  nbins = PolarScanParam_getNbins(params[0]);
+  nrays = PolarScanParam_getNrays(params[0]);
+  for (i = 0; i < nparams; i++) {
+    fields[i] = NULL;
+    if (PolarScanParam_getNbins(params[i]) != nbins || PolarScanParam_getNrays(params[i]) != nrays) {
+      RAVE_ERROR0("All params must have the same geometry when converting them");
+      return 0;
     }
   }
-  //disp_sint("PDP after filter:", outPDP, 350, 20, 370, 40);
 
-  /**************************************************************
-   * Attenuation correction using a linear approach (Bringi et al., 1990)
-   **************************************************************/
-  attenuationMask = RaveData2D_zeros(bi, ri, RaveDataType_DOUBLE);
-  if (attenuationMask == NULL) {
-    RAVE_ERROR0("Failed to create attenuation mask");
-    goto done;
+  conversions = RAVE_MALLOC(sizeof(PdpProcessorInternal_Conversion) * nparams);
+  if (conversions == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for conversions");
+    return 0;
   }
-  minAttenuationMaskRHOHV = PpcRadarOptions_getMinAttenuationMaskRHOHV(self->options);
-  minAttenuationMaskKDP = PpcRadarOptions_getMinAttenuationMaskKDP(self->options);
-  minAttenuationMaskTH = PpcRadarOptions_getMinAttenuationMaskTH(self->options);
-
+  memset(conversions, 0, sizeof(PdpProcessorInternal_Conversion) * nparams);
+
+  for (i = 0; i < nparams; i++) {
+    PdpProcessorInternal_Conversion* conversion = &conversions[i];
+    long ntable = 0;
+    conversion->raw = PolarScanParam_getData(params[i]);
+    conversion->rawType = PolarScanParam_getDataType(params[i]);
+    conversion->gain = PolarScanParam_getGain(params[i]);
+    conversion->offset = PolarScanParam_getOffset(params[i]);
+    conversion->nodata = PolarScanParam_getNodata(params[i]);
+    conversion->undetect = PolarScanParam_getUndetect(params[i]);
+    conversion->undetectValue = conversion->undetect*conversion->gain + conversion->offset;
+    conversion->fieldNodata = (type == RaveDataType_FLOAT) ? (double)(float)nodata[i] : nodata[i];
+
+    if (conversion->raw != NULL && conversion->rawType != RaveDataType_CHAR && conversion->rawType != RaveDataType_UCHAR &&
+        conversion->rawType != RaveDataType_SHORT && conversion->rawType != RaveDataType_USHORT &&
+        conversion->rawType != RaveDataType_INT && conversion->rawType != RaveDataType_UINT &&
+        conversion->rawType != RaveDataType_LONG && conversion->rawType != RaveDataType_ULONG &&
+        conversion->rawType != RaveDataType_FLOAT && conversion->rawType != RaveDataType_DOUBLE) {
+      RAVE_ERROR0("Unsupported data type when converting param");
+      goto done;
+    }
 
-  for (bi = 0; bi < nbins; bi++) {
-    double d = 0.0, h = 0.0;
-    double vRHOHV = 0, vKDP = 0, vTH = 0;
-    PolarNavigator_reToDh(navigator, range * ((double)bi+0.5), elangle, &d, &h);
-    h = h / 1000.0;
-    if (h < PdpProcessor_getMeltingLayerBottomHeight(self)) {
-      for (ri = 0; ri < nrays; ri++) {
-        RaveData2D_getValueUnchecked(dataRHOHV, bi, ri, &vRHOHV);
-        RaveData2D_getValueUnchecked(outKDP, bi, ri, &vKDP);
-        RaveData2D_getValueUnchecked(dataTH, bi, ri, &vTH);
-        if (vRHOHV > minAttenuationMaskRHOHV && vKDP > minAttenuationMaskKDP && vTH > minAttenuationMaskTH) {
-          RaveData2D_setValueUnchecked(attenuationMask, bi, ri, 1.0);
-        }
+    if (conversion->rawType == RaveDataType_UCHAR) {
+      ntable = 256;
+    } else if (conversion->rawType == RaveDataType_USHORT && nbins * nrays > 65536) {
+      ntable = 65536;
+    }
+    if (conversion->raw != NULL && ntable > 0) {
+      conversion->table = RAVE_MALLOC(sizeof(double) * ntable);
+      if (conversion->table == NULL) {
+        RAVE_ERROR0("Failed to allocate memory for conversion table");
+        goto done;
       }
+      /* The table is converted in the same way as the other types so the result is the same */
+      for (r = 0; r < ntable; r++) {
+        conversion->table[r] = (double)r;
+      }
+      PdpProcessorInternal_convertValues(conversion, conversion->table, ntable);
+    }
+
+    fields[i] = PdpProcessorInternal_zeros(self, nbins, nrays, type);
+    if (fields[i] == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for converted param");
+      goto done;
     }
+    RaveData2D_setNodata(fields[i], conversion->fieldNodata);
+    RaveData2D_useNodata(fields[i], 1);
+    conversion->field = fields[i];
   }
-  if (!PdpProcessor_attenuation(self, dataTH, dataZDR, dataDBZH, outPDP, attenuationMask,
-      PpcRadarOptions_getAttenuationGammaH(self->options),
-      PpcRadarOptions_getAttenuationAlpha(self->options),
-	  PolarScanParam_getUndetect(TH)*PolarScanParam_getGain(TH) + PolarScanParam_getOffset(TH),
-	  PolarScanParam_getUndetect(DBZH)*PolarScanParam_getGain(DBZH) + PolarScanParam_getOffset(DBZH),
-	  &outAttenuationZ, &outAttenuationZDR, &outAttenuationPIA, &outAttenuationDBZH)) {
+
+  memset(&args, 0, sizeof(PdpProcessorInternal_ConvertArgs));
+  args.nbins = nbins;
+  args.nconversions = nparams;
+  args.conversions = conversions;
+  PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_convertRays, &args);
+  if (args.failed) {
+    RAVE_ERROR0("Failed to allocate memory when converting params");
     goto done;
   }
 
-  /**************************************************************
-   * Application of the ZPHI methodology (Testud et al, 2000) for
-   * attenuation correction
-   **************************************************************/
-  if (!PdpProcessor_zphi(self, dataTH, outPDP, attenuationMask, rangeKm,
-      PpcRadarOptions_getBB(self->options), PpcRadarOptions_getAttenuationGammaH(self->options), &outZPHI, &outAH)) {
-    goto done;
+  result = 1;
+done:
+  for (i = 0; i < nparams; i++) {
+    RAVE_FREE(conversions[i].table);
+    if (result == 0) {
+      PdpProcessorInternal_recycle(self, &fields[i]);
+    }
   }
+  RAVE_FREE(conversions);
+  return result;
+}
 
-  RaveData2D_useNodata(dataTH, 1);
-  RaveData2D_setNodata(dataTH, -999.9);
+/**
+ * A field that is quantized to 8 or 16 bit, see \ref PdpProcessorInternal_quantize.
+ */
+typedef struct PdpProcessorInternal_Quantization {
+  const char* name; /**< the quantity or how/task of the result */
+  RaveData2D_t* data2d; /**< the field to quantize */
+  double nodata; /**< the raw value that nodata in the field is quantized to */
+  int fixed; /**< if gain and offset are fixed by the options, otherwise they are given by the min and max */
+  RaveDataType type; /**< the data type of out, RaveDataType_UCHAR, _USHORT, _FLOAT or _DOUBLE */
+  void* out; /**< the quantized data, xsize * ysize values */
+  PolarScanParam_t* param; /**< the param that owns out, NULL for a quality field */
+  RaveField_t* field; /**< the quality field that owns out, NULL for a param */
+  int found; /**< if any value that isn't nodata was found */
+  double minv; /**< min value that isn't nodata */
+  double maxv; /**< max value that isn't nodata */
+  double gain; /**< the resulting gain */
+  double offset; /**< the resulting offset */
+} PdpProcessorInternal_Quantization;
 
-  RaveData2D_replace(residualClutterMask, RaveData2D_getNodata(residualClutterMask), 0.0);
+/**
+ * Arguments used when quantizing fields
+ */
+typedef struct PdpProcessorInternal_QuantizeArgs {
+  long nbins; /**< number of bins */
+  long nquantizations; /**< number of quantizations */
+  PdpProcessorInternal_Quantization* quantizations; /**< the quantizations */
+  pthread_mutex_t lock; /**< protects the ranges when the ray blocks are merged */
+  int failed; /**< set to 1 if a kernel failed to allocate memory */
+} PdpProcessorInternal_QuantizeArgs;
 
-  tmpresult = RAVE_OBJECT_CLONE(scan);
-  if (tmpresult == NULL) {
+/**
+ * Finds the min and max values of all fields for the provided rays in one sweep and merges them into the quantizations.
+ */
+static void PdpProcessorInternal_rangeRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_QuantizeArgs* args = (PdpProcessorInternal_QuantizeArgs*)arg;
+  long nbins = args->nbins, n = args->nquantizations, x, y, i;
+  double *row = NULL, *minv = NULL, *maxv = NULL;
+  int* found = NULL;
+
+  row = RAVE_MALLOC(sizeof(double) * (nbins + 2 * n));
+  found = RAVE_MALLOC(sizeof(int) * n);
+  if (row == NULL || found == NULL) {
+    args->failed = 1;
     goto done;
   }
-
-  if (PpcRadarOptions_TH_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    correctedZ = PdpProcessorInternal_createPolarScanParamFromData2D(dataTH, "TH_CORR", 1, 255.0, 0.0);
-    if (correctedZ == NULL ||
-        !PolarScan_addParameter(tmpresult, correctedZ)) {
-      RAVE_ERROR0("Failed to add corrected TH field");
-      goto done;
+  minv = row + nbins;
+  maxv = minv + n;
+  memset(found, 0, sizeof(int) * n);
+
+  for (y = startray; y < endray; y++) {
+    for (i = 0; i < n; i++) {
+      RaveData2D_t* data2d = args->quantizations[i].data2d;
+      int usingNodata = RaveData2D_usingNodata(data2d);
+      double nodata = RaveData2D_getNodata(data2d);
+      if (args->quantizations[i].fixed) {
+        continue;
+      }
+      PdpProcessorInternal_getRay(data2d, y, row);
+      for (x = 0; x < nbins; x++) {
+        double v = row[x];
+        if (!usingNodata || v != nodata) {
+          if (!found[i]) {
+            minv[i] = maxv[i] = v;
+            found[i] = 1;
+          } else if (v < minv[i]) {
+            minv[i] = v;
+          } else if (v > maxv[i]) {
+            maxv[i] = v;
+          }
+        }
+      }
     }
   }
 
-  if (PpcRadarOptions_ATT_TH_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    attenuatedZ = PdpProcessorInternal_createPolarScanParamFromData2D(outAttenuationZ, "ATT_TH_CORR", 1, 255.0, 0.0);
-    if (attenuatedZ == NULL ||
-        !PolarScan_addParameter(tmpresult, attenuatedZ)) {
-      RAVE_ERROR0("Failed to add corrected and attenuated TH field");
-      goto done;
+  pthread_mutex_lock(&args->lock);
+  for (i = 0; i < n; i++) {
+    PdpProcessorInternal_Quantization* quantization = &args->quantizations[i];
+    if (found[i]) {
+      if (!quantization->found) {
+        quantization->minv = minv[i];
+        quantization->maxv = maxv[i];
+        quantization->found = 1;
+      } else {
+        quantization->minv = (minv[i] < quantization->minv) ? minv[i] : quantization->minv;
+        quantization->maxv = (maxv[i] > quantization->maxv) ? maxv[i] : quantization->maxv;
+      }
     }
   }
+  pthread_mutex_unlock(&args->lock);
+done:
+  RAVE_FREE(row);
+  RAVE_FREE(found);
+}
 
-  if (PpcRadarOptions_DBZH_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    correctedDBZH = PdpProcessorInternal_createPolarScanParamFromData2D(dataDBZH, "DBZH_CORR", 1, 255.0, 0.0);
-    if (correctedDBZH == NULL ||
-        !PolarScan_addParameter(tmpresult, correctedDBZH)) {
-      RAVE_ERROR0("Failed to add corrected DBZH field");
-      goto done;
-    }
+/**
+ * Copies ray y of a field into a float or double buffer with the same size as the field. When the types
+ * are the same the ray is copied as it is, otherwise it is converted through row.
+ * @param[in] data2d - the field
+ * @param[in] y - the ray
+ * @param[in] type - RaveDataType_FLOAT or RaveDataType_DOUBLE
+ * @param[in] out - the buffer
+ * @param[in] row - a buffer with room for one ray
+ */
+static void PdpProcessorInternal_copyRay(RaveData2D_t* data2d, long y, RaveDataType type, void* out, double* row)
+{
+  long nbins = RaveData2D_getXsize(data2d), x = 0;
+  if (RaveData2D_getType(data2d) == type) {
+    size_t size = (type == RaveDataType_FLOAT) ? sizeof(float) : sizeof(double);
+    memcpy((unsigned char*)out + y * nbins * size, (unsigned char*)RaveData2D_getData(data2d) + y * nbins * size, nbins * size);
+  } else if (type == RaveDataType_FLOAT) {
+    float* fout = (float*)out + y * nbins;
+    PdpProcessorInternal_getRay(data2d, y, row);
+    for (x = 0; x < nbins; x++) fout[x] = (float)row[x];
+  } else {
+    PdpProcessorInternal_getRay(data2d, y, (double*)out + y * nbins);
   }
+}
 
-  if (PpcRadarOptions_ATT_DBZH_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    attenuatedDBZH = PdpProcessorInternal_createPolarScanParamFromData2D(outAttenuationDBZH, "ATT_DBZH_CORR", 1, 255.0, 0.0);
-    if (attenuatedDBZH == NULL ||
-        !PolarScan_addParameter(tmpresult, attenuatedDBZH)) {
-      RAVE_ERROR0("Failed to add corrected and attenuated DBZH field");
-      goto done;
+/**
+ * Quantizes all fields for the provided rays in one sweep, writing directly into the output buffers.
+ * Fields with a fixed scaling are rounded to the nearest raw value and valid values are clamped to 1 - (nodata - 1), raw 0
+ * is only undetect. Fields scaled by their min and max are truncated in the same way as PolarScanParam_setValue. NaN is
+ * written as nodata. Float and double outputs get the values as they are.
+ */
+static void PdpProcessorInternal_quantizeRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_QuantizeArgs* args = (PdpProcessorInternal_QuantizeArgs*)arg;
+  long nbins = args->nbins, x, y, i;
+  double* row = NULL;
+
+  row = RAVE_MALLOC(sizeof(double) * nbins);
+  if (row == NULL) {
+    args->failed = 1;
+    return;
+  }
+  for (y = startray; y < endray; y++) {
+    for (i = 0; i < args->nquantizations; i++) {
+      PdpProcessorInternal_Quantization* quantization = &args->quantizations[i];
+      RaveData2D_t* data2d = quantization->data2d;
+      int usingNodata = RaveData2D_usingNodata(data2d);
+      double nodata = RaveData2D_getNodata(data2d), gain = quantization->gain, offset = quantization->offset;
+      double rawNodata = quantization->nodata;
+      if (quantization->type == RaveDataType_FLOAT || quantization->type == RaveDataType_DOUBLE) {
+        PdpProcessorInternal_copyRay(data2d, y, quantization->type, quantization->out, row);
+        continue;
+      }
+      PdpProcessorInternal_getRay(data2d, y, row);
+      if (quantization->fixed) {
+        double maxv = rawNodata - 1.0;
+        for (x = 0; x < nbins; x++) {
+          double v = rawNodata;
+          if ((!usingNodata || row[x] != nodata) && !isnan(row[x])) {
+            v = floor((row[x] - offset)/gain + 0.5);
+            v = (v < 1.0) ? 1.0 : ((v > maxv) ? maxv : v);
+          }
+          row[x] = v;
+        }
+      } else {
+        for (x = 0; x < nbins; x++) {
+          double v = ((!usingNodata || row[x] != nodata) && !isnan(row[x])) ? (row[x] - offset)/gain : rawNodata;
+          row[x] = (v < 0.0) ? 0.0 : ((v > 255.0) ? 255.0 : v);
+        }
+      }
+      if (quantization->type == RaveDataType_USHORT) {
+        unsigned short* out = (unsigned short*)quantization->out + y * nbins;
+        for (x = 0; x < nbins; x++) out[x] = (unsigned short)row[x];
+      } else {
+        unsigned char* out = (unsigned char*)quantization->out + y * nbins;
+        for (x = 0; x < nbins; x++) out[x] = (unsigned char)row[x];
+      }
     }
   }
+  RAVE_FREE(row);
+}
 
+/**
+ * Quantizes the fields. Fields without a fixed scaling are quantized to 8 bit so that the range of each field is spread
+ * over 0 - 254, the ranges of these fields are found in one sweep over the rays. The values of all fields are then written
+ * into the output buffers in one sweep, so when all fields have a fixed scaling or are unscaled only one sweep is needed.
+ * @param[in] self - self
+ * @param[in] nquantizations - number of quantizations
+ * @param[in,out] quantizations - the quantizations, gain and offset are set on success
+ * @returns 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_quantize(PdpProcessor_t* self, long nquantizations, PdpProcessorInternal_Quantization* quantizations)
+{
+  PdpProcessorInternal_QuantizeArgs args;
+  long nrays = 0, i = 0;
+  int result = 0, ndynamic = 0;
 
-  if (PpcRadarOptions_KDP_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    paramKDP = PdpProcessorInternal_createPolarScanParamFromData2D(outKDP, "KDP_CORR", 1, 255.0, 0.0);
-    if (paramKDP == NULL ||
-        !PolarScan_addParameter(tmpresult, paramKDP)) {
-      RAVE_ERROR0("Failed to add corrected KDP field");
-      goto done;
-    }
+  if (nquantizations <= 0) {
+    return 1;
   }
-
-  if (PpcRadarOptions_RHOHV_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    paramRHOHV = PdpProcessorInternal_createPolarScanParamFromData2D(dataRHOHV, "RHOHV_CORR", 1, 255.0, 0.0);
-    if (paramRHOHV == NULL ||
-        !PolarScan_addParameter(tmpresult, paramRHOHV)) {
-      RAVE_ERROR0("Failed to add corrected RHOHV field");
-      goto done;
+  memset(&args, 0, sizeof(PdpProcessorInternal_QuantizeArgs));
+  args.nbins = RaveData2D_getXsize(quantizations[0].data2d);
+  args.nquantizations = nquantizations;
+  args.quantizations = quantizations;
+  nrays = RaveData2D_getYsize(quantizations[0].data2d);
+  for (i = 0; i < nquantizations; i++) {
+    if (RaveData2D_getXsize(quantizations[i].data2d) != args.nbins || RaveData2D_getYsize(quantizations[i].data2d) != nrays) {
+      RAVE_ERROR0("All fields must have the same geometry when quantizing");
+      return 0;
     }
-  }
-
-  if (PpcRadarOptions_PHIDP_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    correctedPDP = PdpProcessorInternal_createPolarScanParamFromData2D(outPDP, "PHIDP_CORR", 1, 255.0, 0.0);
-    if (correctedPDP == NULL ||
-        !PolarScan_addParameter(tmpresult, correctedPDP)) {
-      RAVE_ERROR0("Failed to add corrected PDP field");
-      goto done;
+    quantizations[i].found = 0;
+    if (!quantizations[i].fixed) {
+      ndynamic++;
     }
   }
+  pthread_mutex_init(&args.lock, NULL);
 
-  if (PpcRadarOptions_ZDR_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    correctedZDR = PdpProcessorInternal_createPolarScanParamFromData2D(dataZDR, "ZDR_CORR", 1, 255.0, 0.0);
-    if (correctedZDR == NULL ||
-        !PolarScan_addParameter(tmpresult, correctedZDR)) {
-      RAVE_ERROR0("Failed to add corrected ZDR field");
+  if (ndynamic > 0) {
+    PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_rangeRays, &args);
+    if (args.failed) {
+      RAVE_ERROR0("Failed to allocate memory when quantizing");
       goto done;
     }
   }
-
-  if (PpcRadarOptions_ATT_ZDR_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    attCorrectedZDR = PdpProcessorInternal_createPolarScanParamFromData2D(outAttenuationZDR, "ATT_ZDR_CORR", 1, 255.0, 0.0);
-    if (attCorrectedZDR == NULL ||
-        !PolarScan_addParameter(tmpresult, attCorrectedZDR)) {
-      RAVE_ERROR0("Failed to add corrected ZDR field");
-      goto done;
+  for (i = 0; i < nquantizations; i++) {
+    PdpProcessorInternal_Quantization* quantization = &quantizations[i];
+    if (quantization->fixed) {
+      continue;
     }
-  }
-
-  if (PpcRadarOptions_ZPHI_CORR & PpcRadarOptions_getRequestedFields(self->options)) {
-    correctedZPHI = PdpProcessorInternal_createPolarScanParamFromData2D(outZPHI, "ZPHI_CORR", 1, 255.0, 0.0);
-    if (correctedZPHI == NULL ||
-        !PolarScan_addParameter(tmpresult, correctedZPHI)) {
-      RAVE_ERROR0("Failed to add corrected >ZPHI field");
-      goto done;
+    if (!quantization->found) {
+      quantization->minv = quantization->maxv = RaveData2D_getNodata(quantization->data2d);
     }
-  }
-
-  if (PpcRadarOptions_QUALITY_RESIDUAL_CLUTTER_MASK & PpcRadarOptions_getRequestedFields(self->options)) {
-    if (!PdpProcessorInternal_addRaveQualityFieldToScanFromData2D(tmpresult, residualClutterMask, "se.baltrad.ppc.residual_clutter_mask")) {
+    quantization->offset = quantization->minv;
+    quantization->gain = (quantization->maxv - quantization->minv) / 254;
+    if (quantization->gain == 0.0) {
+      RAVE_ERROR1("Gain = 0.0 for %s", quantization->name);
       goto done;
     }
   }
 
-  if (PpcRadarOptions_QUALITY_ATTENUATION_MASK & PpcRadarOptions_getRequestedFields(self->options)) {
-    if (!PdpProcessorInternal_addRaveQualityFieldToScanFromData2D(tmpresult, attenuationMask, "se.baltrad.ppc.attenuation_mask")) {
-      goto done;
-    }
+  PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_quantizeRays, &args);
+  if (args.failed) {
+    RAVE_ERROR0("Failed to allocate memory when quantizing");
+    goto done;
   }
 
-  fprintf(stderr, "PdpProcessor_process: Total execution time for scan: %lld ms\n", PdpProcessorInternal_timestamp() - starttime);
-
-  result = RAVE_OBJECT_COPY(tmpresult);
+  result = 1;
 done:
-  RAVE_OBJECT_RELEASE(dataTH);
-  RAVE_OBJECT_RELEASE(thThresholdIndex);
-  RAVE_OBJECT_RELEASE(dataZDR);
-  RAVE_OBJECT_RELEASE(dataDV);
-  RAVE_OBJECT_RELEASE(texturePHIDP);
-  RAVE_OBJECT_RELEASE(dataRHOHV);
-  RAVE_OBJECT_RELEASE(textureZ);
-  RAVE_OBJECT_RELEASE(dataPHIDP);
-  RAVE_OBJECT_RELEASE(dataPDP);
-  RAVE_OBJECT_RELEASE(dataDBZH);
-  RAVE_OBJECT_RELEASE(clutterMap);
-  RAVE_OBJECT_RELEASE(residualClutterMask);
-  RAVE_OBJECT_RELEASE(outZ);
-  RAVE_OBJECT_RELEASE(outQuality);
-  RAVE_OBJECT_RELEASE(outClutterMask);
-  RAVE_OBJECT_RELEASE(outPDP);
-  RAVE_OBJECT_RELEASE(outKDP);
-  RAVE_OBJECT_RELEASE(attenuationMask);
-  RAVE_OBJECT_RELEASE(outAttenuationZ);
-  RAVE_OBJECT_RELEASE(outAttenuationZDR);
-  RAVE_OBJECT_RELEASE(outAttenuationPIA);
-  RAVE_OBJECT_RELEASE(outAttenuationDBZH);
-  RAVE_OBJECT_RELEASE(outZPHI);
-  RAVE_OBJECT_RELEASE(outAH);
-  RAVE_OBJECT_RELEASE(navigator);
-  RAVE_OBJECT_RELEASE(TH);
-  RAVE_OBJECT_RELEASE(ZDR);
-  RAVE_OBJECT_RELEASE(DV);
-  RAVE_OBJECT_RELEASE(PHIDP);
-  RAVE_OBJECT_RELEASE(RHOHV);
-  RAVE_OBJECT_RELEASE(DBZH);
-  RAVE_OBJECT_RELEASE(pdpQualityField);
-  RAVE_OBJECT_RELEASE(correctedZ);
-  RAVE_OBJECT_RELEASE(correctedZDR);
-  RAVE_OBJECT_RELEASE(attCorrectedZDR);
-  RAVE_OBJECT_RELEASE(correctedZPHI);
-  RAVE_OBJECT_RELEASE(correctedPDP);
-  RAVE_OBJECT_RELEASE(correctedDBZH);
-  RAVE_OBJECT_RELEASE(attenuatedZ);
-  RAVE_OBJECT_RELEASE(attenuatedDBZH);
-  RAVE_OBJECT_RELEASE(paramKDP);
-  RAVE_OBJECT_RELEASE(paramRHOHV);
-  RAVE_OBJECT_RELEASE(tmpresult);
-
+  pthread_mutex_destroy(&args.lock);
   return result;
 }
 
-void PdpProcessor_setMeltingLayerBottomHeight(PdpProcessor_t* self, double height)
-{
-  self->meltingLayerBottomHeight = height;
-}
-
-double PdpProcessor_getMeltingLayerBottomHeight(PdpProcessor_t* self)
+/**
+ * Prepares a quantization with the output scaling in the options if there is one for the name, otherwise
+ * the field is quantized to 8 bit by its min and max. Float and double outputs are not scaled and keep the nodata
+ * of the field.
+ * @param[in] options - the radar options
+ * @param[in] data2d - the 2d data field
+ * @param[in] name - the quantity or how/task
+ * @param[out] quantization - the quantization to prepare
+ */
+static void PdpProcessorInternal_initQuantization(PpcRadarOptions_t* options, RaveData2D_t* data2d, const char* name,
+    PdpProcessorInternal_Quantization* quantization)
 {
-  /* @TODO: implement proper support for this */
-  if (self->meltingLayerBottomHeight <= -1.0) {
-    return PpcRadarOptions_getMeltingLayerBottomHeight(self->options);
+  int type = RaveDataType_UCHAR;
+  memset(quantization, 0, sizeof(PdpProcessorInternal_Quantization));
+  quantization->name = name;
+  quantization->data2d = data2d;
+  quantization->type = RaveDataType_UCHAR;
+  quantization->nodata = 255.0;
+  if (PpcRadarOptions_getOutputScaling(options, name, &type, &quantization->gain, &quantization->offset)) {
+    quantization->fixed = 1;
+    quantization->type = (RaveDataType)type;
+    if (type == RaveDataType_FLOAT || type == RaveDataType_DOUBLE) {
+      quantization->gain = 1.0;
+      quantization->offset = 0.0;
+      quantization->nodata = RaveData2D_getNodata(data2d);
+    } else {
+      quantization->nodata = (type == RaveDataType_USHORT) ? 65535.0 : 255.0;
+    }
   }
-  return self->meltingLayerBottomHeight;
 }
 
-RaveData2D_t* PdpProcessor_texture(PdpProcessor_t* self, RaveData2D_t* X)
+/**
+ * Creates a polar scan param with the output type and prepares the quantization of the data 2d field into it.
+ * Unscaled float and double params use nodata as undetect since the processed fields have no undetect.
+ * @param[in] options - the radar options with the output scalings
+ * @param[in] data2d - the 2d data field
+ * @param[in] quantity - the quantity for this field
+ * @param[out] quantization - the quantization to prepare
+ * @returns the polar scan parameter, gain and offset are set by \ref PdpProcessorInternal_finishQuantization
+ */
+static PolarScanParam_t* PdpProcessorInternal_createQuantizedParam(PpcRadarOptions_t* options, RaveData2D_t* data2d, const char* quantity,
+    PdpProcessorInternal_Quantization* quantization)
 {
-  RaveData2D_t* result = NULL;
-  RaveData2D_t* texture = NULL;
-  RaveData2D_t *weight = NULL;
-  long xsize = 0, ysize = 0;
-  long x, y;
-  long i, j;
-  double nodata = 0.0;
-  RAVE_ASSERT((self != NULL), "pdp processor == NULL");
-  if (X == NULL) {
-    RAVE_ERROR0("Field to create texture from must be provided");
-    return NULL;
-  }
+  PolarScanParam_t* param = NULL;
+  PolarScanParam_t* result = NULL;
 
-  if (!RaveData2D_usingNodata(X)) {
-    RAVE_ERROR0("Nodata must be set to create texture");
-    return NULL;
+  if (data2d == NULL || quantity == NULL) {
+    RAVE_ERROR0("data2d or quantity is NULL");
+    goto done;
   }
-  nodata = RaveData2D_getNodata(X);
-  xsize = RaveData2D_getXsize(X);
-  ysize = RaveData2D_getYsize(X);
-
-  texture = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
-  weight = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
-  if (texture == NULL || weight == NULL) {
-    RAVE_ERROR0("Allocation error when creating texture");
+  PdpProcessorInternal_initQuantization(options, data2d, quantity, quantization);
+  param = RAVE_OBJECT_NEW(&PolarScanParam_TYPE);
+  if (param == NULL ||
+      !PolarScanParam_createData(param, RaveData2D_getXsize(data2d), RaveData2D_getYsize(data2d), quantization->type) ||
+      !PolarScanParam_setQuantity(param, quantity)) {
     goto done;
   }
-
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
-      double v = 0.0;
-      if (RaveData2D_getValue(X, x, y, &v) && v != nodata) { /* Everything should count, X>-900 | isnan(X)==0 is always true unless NaN */
-        RaveData2D_setValue(weight, x, y, 1.0);
-      } else {
-        RaveData2D_setValue(weight, x, y, 0.0);
-      }
-    }
+  PolarScanParam_setNodata(param, quantization->nodata);
+  if (quantization->type == RaveDataType_FLOAT || quantization->type == RaveDataType_DOUBLE) {
+    PolarScanParam_setUndetect(param, quantization->nodata);
+  } else {
+    PolarScanParam_setUndetect(param, 0.0);
   }
+  quantization->out = PolarScanParam_getData(param);
+  quantization->param = param;
+
+  result = RAVE_OBJECT_COPY(param);
+done:
+  RAVE_OBJECT_RELEASE(param);
+  return result;
+}
+
+/**
+ * Creates a quality field with the output type and prepares the quantization of the data 2d field into it.
+ * Nodata is quantized to 255 or 65535 in 8 and 16 bit fields.
+ * @param[in] options - the radar options with the output scalings
+ * @param[in] data2d - the 2d data field
+ * @param[in] qualityName - the how/task name
+ * @param[out] quantization - the quantization to prepare
+ * @returns the quality field, gain and offset are set by \ref PdpProcessorInternal_finishQuantization
+ */
+static RaveField_t* PdpProcessorInternal_createQuantizedQualityField(PpcRadarOptions_t* options, RaveData2D_t* data2d, const char* qualityName,
+    PdpProcessorInternal_Quantization* quantization)
+{
+  RaveField_t* field = NULL;
+  RaveField_t* result = NULL;
+  RaveAttribute_t* attr = NULL;
+
+  if (data2d == NULL || qualityName == NULL) {
+    RAVE_ERROR0("data2d or qualityName is NULL");
+    goto done;
+  }
+  PdpProcessorInternal_initQuantization(options, data2d, qualityName, quantization);
+  field = RAVE_OBJECT_NEW(&RaveField_TYPE);
+  if (field == NULL ||
+      !RaveField_createData(field, RaveData2D_getXsize(data2d), RaveData2D_getYsize(data2d), quantization->type)) {
+    goto done;
+  }
+  attr = RaveAttributeHelp_createString("how/task", qualityName);
+  if (attr == NULL || !RaveField_addAttribute(field, attr)) {
+    goto done;
+  }
+
+  quantization->out = RaveField_getData(field);
+  quantization->field = field;
+
+  result = RAVE_OBJECT_COPY(field);
+done:
+  RAVE_OBJECT_RELEASE(field);
+  RAVE_OBJECT_RELEASE(attr);
+  return result;
+}
+
+/**
+ * Sets the gain and offset of a quantized param or quality field and adds it to the scan.
+ * @param[in] scan - the scan
+ * @param[in] quantization - the quantization
+ * @param[in] replace - if a quality field should replace an existing quality field with the same how/task
+ * @param[in] deferred - if not NULL, the param or quality field is added to this list instead of to the scan
+ * @returns 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_finishQuantization(PolarScan_t* scan, PdpProcessorInternal_Quantization* quantization, int replace, RaveObjectList_t* deferred)
+{
+  int result = 0;
+  RaveAttribute_t *gainAttr = NULL, *offsetAttr = NULL;
+
+  if (quantization->param != NULL) {
+    PolarScanParam_setOffset(quantization->param, quantization->offset);
+    PolarScanParam_setGain(quantization->param, quantization->gain);
+    if (deferred != NULL) {
+      if (!RaveObjectList_add(deferred, (RaveCoreObject*)quantization->param)) {
+        RAVE_ERROR1("Failed to keep %s", quantization->name);
+        goto done;
+      }
+    } else if (!PolarScan_addParameter(scan, quantization->param)) {
+      RAVE_ERROR1("Failed to add %s", quantization->name);
+      goto done;
+    }
+  } else {
+    gainAttr = RaveAttributeHelp_createDouble("what/gain", quantization->gain);
+    offsetAttr = RaveAttributeHelp_createDouble("what/offset", quantization->offset);
+    if (gainAttr == NULL || offsetAttr == NULL ||
+        !RaveField_addAttribute(quantization->field, gainAttr) || !RaveField_addAttribute(quantization->field, offsetAttr)) {
+      RAVE_ERROR1("Failed to add %s", quantization->name);
+      goto done;
+    }
+    if (deferred != NULL) {
+      if (!RaveObjectList_add(deferred, (RaveCoreObject*)quantization->field)) {
+        RAVE_ERROR1("Failed to keep %s", quantization->name);
+        goto done;
+      }
+    } else if (!(replace ? PolarScan_addOrReplaceQualityField(scan, quantization->field) : PolarScan_addQualityField(scan, quantization->field))) {
+      RAVE_ERROR1("Failed to add %s", quantization->name);
+      goto done;
+    }
+  }
+  result = 1;
+done:
+  RAVE_OBJECT_RELEASE(gainAttr);
+  RAVE_OBJECT_RELEASE(offsetAttr);
+  return result;
+}
+
+/**
+ * Product parameters, in the order they are added to the result
+ */
+static const struct {
+  int field; /**< the requested field flag */
+  const char* quantity; /**< the quantity of the parameter */
+} PdpProcessorInternal_resultParameters[] = {
+  {PpcRadarOptions_TH_CORR, "TH_CORR"},
+  {PpcRadarOptions_ATT_TH_CORR, "ATT_TH_CORR"},
+  {PpcRadarOptions_DBZH_CORR, "DBZH_CORR"},
+  {PpcRadarOptions_ATT_DBZH_CORR, "ATT_DBZH_CORR"},
+  {PpcRadarOptions_KDP_CORR, "KDP_CORR"},
+  {PpcRadarOptions_RHOHV_CORR, "RHOHV_CORR"},
+  {PpcRadarOptions_PHIDP_CORR, "PHIDP_CORR"},
+  {PpcRadarOptions_ZDR_CORR, "ZDR_CORR"},
+  {PpcRadarOptions_ATT_ZDR_CORR, "ATT_ZDR_CORR"},
+  {PpcRadarOptions_ZPHI_CORR, "ZPHI_CORR"},
+  {0, NULL}
+};
+
+/**
+ * Number of product parameters
+ */
+#define PdpProcessorInternal_RESULT_PARAMETERS 10
+
+/**
+ * Number of quality fields
+ */
+#define PdpProcessorInternal_RESULT_QUALITY_FIELDS 2
+
+/**
+ * Number of product parameters and quality fields
+ */
+#define PdpProcessorInternal_RESULTS (PdpProcessorInternal_RESULT_PARAMETERS + PdpProcessorInternal_RESULT_QUALITY_FIELDS)
+
+/**
+ * Product quality fields, in the order they are added to the result
+ */
+static const struct {
+  int field; /**< the requested field flag */
+  const char* howtask; /**< the how/task of the quality field */
+} PdpProcessorInternal_resultQualityFields[] = {
+  {PpcRadarOptions_QUALITY_RESIDUAL_CLUTTER_MASK, "se.baltrad.ppc.residual_clutter_mask"},
+  {PpcRadarOptions_QUALITY_ATTENUATION_MASK, "se.baltrad.ppc.attenuation_mask"},
+  {0, NULL}
+};
+
+/**
+ * Stages in \ref PdpProcessor_process that only has to be run when one of the requested fields depends on them.
+ */
+#define PdpProcessorInternal_STAGE_CLUTTER          (1)      /**< texture and clutter correction */
+#define PdpProcessorInternal_STAGE_RESIDUAL         (1 << 1) /**< residual clutter filter */
+#define PdpProcessorInternal_STAGE_PDP              (1 << 2) /**< PHIDP filtering and KDP retrieval */
+#define PdpProcessorInternal_STAGE_ATTENUATION_MASK (1 << 3) /**< attenuation mask */
+#define PdpProcessorInternal_STAGE_ATTENUATION      (1 << 4) /**< attenuation correction */
+#define PdpProcessorInternal_STAGE_ZPHI             (1 << 5) /**< ZPHI attenuation correction */
+
+/**
+ * The stages each stage depends on directly.
+ */
+static const struct {
+  int stage; /**< the stage */
+  int dependencies; /**< the stages that must be run before this stage */
+} PdpProcessorInternal_stageDependencies[] = {
+  {PdpProcessorInternal_STAGE_CLUTTER, 0},
+  {PdpProcessorInternal_STAGE_RESIDUAL, PdpProcessorInternal_STAGE_CLUTTER},
+  {PdpProcessorInternal_STAGE_PDP, PdpProcessorInternal_STAGE_CLUTTER},
+  {PdpProcessorInternal_STAGE_ATTENUATION_MASK, PdpProcessorInternal_STAGE_RESIDUAL | PdpProcessorInternal_STAGE_PDP},
+  {PdpProcessorInternal_STAGE_ATTENUATION, PdpProcessorInternal_STAGE_ATTENUATION_MASK},
+  {PdpProcessorInternal_STAGE_ZPHI, PdpProcessorInternal_STAGE_ATTENUATION_MASK},
+  {0, 0}
+};
+
+/**
+ * The last stage that modifies each of the requested fields.
+ */
+static const struct {
+  int field; /**< the requested field flag */
+  int stages; /**< the stages producing the field */
+} PdpProcessorInternal_fieldStages[] = {
+  {PpcRadarOptions_TH_CORR, PdpProcessorInternal_STAGE_RESIDUAL},
+  {PpcRadarOptions_ATT_TH_CORR, PdpProcessorInternal_STAGE_ATTENUATION},
+  {PpcRadarOptions_DBZH_CORR, PdpProcessorInternal_STAGE_CLUTTER},
+  {PpcRadarOptions_ATT_DBZH_CORR, PdpProcessorInternal_STAGE_ATTENUATION},
+  {PpcRadarOptions_KDP_CORR, PdpProcessorInternal_STAGE_PDP},
+  {PpcRadarOptions_RHOHV_CORR, PdpProcessorInternal_STAGE_RESIDUAL},
+  {PpcRadarOptions_PHIDP_CORR, PdpProcessorInternal_STAGE_RESIDUAL | PdpProcessorInternal_STAGE_PDP},
+  {PpcRadarOptions_ZDR_CORR, PdpProcessorInternal_STAGE_RESIDUAL},
+  {PpcRadarOptions_ZPHI_CORR, PdpProcessorInternal_STAGE_ZPHI},
+  {PpcRadarOptions_QUALITY_RESIDUAL_CLUTTER_MASK, PdpProcessorInternal_STAGE_RESIDUAL},
+  {PpcRadarOptions_QUALITY_ATTENUATION_MASK, PdpProcessorInternal_STAGE_ATTENUATION_MASK},
+  {PpcRadarOptions_QUALITY_ATTENUATION, PdpProcessorInternal_STAGE_ATTENUATION},
+  {PpcRadarOptions_ATT_ZDR_CORR, PdpProcessorInternal_STAGE_ATTENUATION},
+  {0, 0}
+};
+
+/**
+ * Resolves which stages that must be run to produce the requested fields, including
+ * the stages they depend on.
+ * @param[in] requestedFields - the requested fields
+ * @returns a mask of PdpProcessorInternal_STAGE_xxx
+ */
+static int PdpProcessorInternal_getRequiredStages(int requestedFields)
+{
+  int i = 0, stages = 0, previous = -1;
+
+  for (i = 0; PdpProcessorInternal_fieldStages[i].field != 0; i++) {
+    if (requestedFields & PdpProcessorInternal_fieldStages[i].field) {
+      stages |= PdpProcessorInternal_fieldStages[i].stages;
+    }
+  }
+
+  while (stages != previous) {
+    previous = stages;
+    for (i = 0; PdpProcessorInternal_stageDependencies[i].stage != 0; i++) {
+      if (stages & PdpProcessorInternal_stageDependencies[i].stage) {
+        stages |= PdpProcessorInternal_stageDependencies[i].dependencies;
+      }
+    }
+  }
+
+  return stages;
+}
+
+/**
+ * Adds the parameters and quality fields that were kept when processing a scan of a volume to the scan.
+ * @param[in] scan - the scan that should get the result attached
+ * @param[in] products - the kept parameters and quality fields
+ * @returns 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_attachResult(PolarScan_t* scan, RaveObjectList_t* products)
+{
+  int i = 0, n = RaveObjectList_size(products), status = 1;
+
+  for (i = 0; status && i < n; i++) {
+    RaveCoreObject* product = RaveObjectList_get(products, i);
+    if (RAVE_OBJECT_CHECK_TYPE(product, &PolarScanParam_TYPE)) {
+      status = PolarScan_addParameter(scan, (PolarScanParam_t*)product);
+    } else {
+      status = PolarScan_addOrReplaceQualityField(scan, (RaveField_t*)product);
+    }
+    if (!status) {
+      RAVE_ERROR0("Failed to attach the result to scan");
+    }
+    RAVE_OBJECT_RELEASE(product);
+  }
+
+  return status;
+}
+
+/**
+ * Arguments when processing the scans of a volume
+ */
+typedef struct PdpProcessorInternal_VolumeArgs {
+  PdpProcessor_t* processor; /**< the processor */
+  PolarScan_t** scans; /**< the scans */
+  RaveData2D_t** clutterMaps; /**< the clutter map for each scan, entries may be NULL */
+  RaveObjectList_t** products; /**< the parameters and quality fields of each scan, NULL if the scan failed */
+  PdpStats_t* stats; /**< the statistics of all scans, may be NULL */
+  PdpProcessorInternal_Dispatch dispatch; /**< how the scans dispatch their rays */
+} PdpProcessorInternal_VolumeArgs;
+
+/**
+ * Number of membership functions in the clutter identification
+ */
+#define PdpProcessorInternal_CLUTTER_ID_TERMS 6
+
+/**
+ * The raw parameter that a field in the clutter identification was converted from. When the param is 8 or 16 bit
+ * the membership is looked up from the raw value instead of being evaluated on the field.
+ */
+typedef struct PdpProcessorInternal_RawSource {
+  PolarScanParam_t* param; /**< the param that the field was converted from with \ref PdpProcessorInternal_getData2DFromParams */
+  const unsigned char* mask; /**< pixels that have been set to nodata in the field after the conversion, may be NULL */
+} PdpProcessorInternal_RawSource;
+
+/* Defined further down */
+static PolarScan_t* PdpProcessorInternal_process(PdpProcessor_t* self, PolarScan_t* scan, RaveData2D_t* sclutterMap, int inPlace, RaveObjectList_t* deferred, PdpStats_t* stats);
+static int PdpProcessorInternal_updateTexture(PdpProcessor_t* self, RaveData2D_t* X, RaveData2D_t* texture, const unsigned char* changedRays);
+static int PdpProcessorInternal_pdpScript(PdpProcessor_t* self, RaveData2D_t* pdp, RaveData2D_t* pdpTexture, double dr, double rWin1, double rWin2, long nrIter, RaveData2D_t** pdpf, RaveData2D_t** kdp);
+static int PdpProcessorInternal_clutterID(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* VRADH,
+    RaveData2D_t* texturePHIDP, RaveData2D_t* RHOHV, RaveData2D_t* textureZ, RaveData2D_t* clutterMap,
+    double nodataZ, double qualityThreshold, PdpProcessorInternal_RawSource* sources,
+    RaveData2D_t** outDegree, RaveData2D_t** outZ, RaveData2D_t** outQuality, RaveData2D_t** outClutterMask);
+
+/**
+ * Processes the scans startscan <= scan < endscan.
+ * @param[in] arg - the volume arguments
+ * @param[in] startscan - first scan
+ * @param[in] endscan - scan after last scan
+ */
+static void PdpProcessorInternal_processScans(void* arg, long startscan, long endscan)
+{
+  PdpProcessorInternal_VolumeArgs* args = (PdpProcessorInternal_VolumeArgs*)arg;
+  long si = 0;
+  PdpProcessorInternal_setDispatch(&args->dispatch);
+  for (si = startscan; si < endscan; si++) {
+    PdpStats_t* stats = (args->stats != NULL) ? RAVE_OBJECT_NEW(&PdpStats_TYPE) : NULL;
+    PolarScan_t* result = NULL;
+    args->products[si] = RAVE_OBJECT_NEW(&RaveObjectList_TYPE);
+    if (args->products[si] != NULL) {
+      result = PdpProcessorInternal_process(args->processor, args->scans[si], args->clutterMaps[si], 1, args->products[si], stats);
+    }
+    if (result == NULL) {
+      RAVE_OBJECT_RELEASE(args->products[si]);
+    }
+    RAVE_OBJECT_RELEASE(result);
+    if (args->stats != NULL && stats != NULL) {
+      PdpStats_merge(args->stats, stats);
+    }
+    RAVE_OBJECT_RELEASE(stats);
+  }
+  PdpProcessorInternal_setDispatch(NULL);
+}
+
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+//void PdpProcessor_setRequestedFields(PdpProcessor_t* self, int fieldmask)
+//{
+//  RAVE_ASSERT((self != NULL), "self == NULL");
+//  PpcRadarOptions_setRequestedFields(self->options, fieldmask);
+//  //self->requestedFieldMask = fieldmask;
+//
+//int PdpProcessor_getRequestedFields(PdpProcessor_t* self)
+//{
+//  RAVE_ASSERT((self != NULL), "self == NULL");
+//  return PpcRadarOptions_getRequestedFields(self->options);
+//}
+
+int PdpProcessor_setRadarOptions(PdpProcessor_t* self, PpcRadarOptions_t* options)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (options == NULL) {
+    return 0;
+  }
+  RAVE_OBJECT_RELEASE(self->options);
+  self->options = RAVE_OBJECT_COPY(options);
+  return 1;
+}
+
+PpcRadarOptions_t* PdpProcessor_getRadarOptions(PdpProcessor_t* self)
+{
+  return RAVE_OBJECT_COPY(self->options);
+}
+
+static void disp_int(RaveData2D_t* field, int bmin_limit, int rmin_limit, int bmax_limit, int rmax_limit)
+{
+  int bi, ri, nbins, nrays;
+  nbins = RaveData2D_getXsize(field);
+  nrays = RaveData2D_getYsize(field);
+  for (bi = 0; bi < nbins; bi++) {
+    for (ri = 0; ri < nrays; ri++) {
+      double v = 0.0;
+      RaveData2D_getValueUnchecked(field, bi, ri, &v);
+      if (bi>=bmin_limit && bi <bmax_limit && ri>=rmin_limit&&ri<rmax_limit) {
+        fprintf(stderr, "%f   ", v);
+      }
+    }
+    if (bi>=bmin_limit && bi <bmax_limit) { fprintf(stderr, "\n"); }
+  }
+  fprintf(stderr, "\n");
+}
+
+static void disp_sint(const char* msg, RaveData2D_t* field, int bmin_limit, int rmin_limit, int bmax_limit, int rmax_limit)
+{
+  fprintf(stderr, "%s\n", msg);
+  disp_int(field, bmin_limit, rmin_limit, bmax_limit, rmax_limit);
+}
+
+/**
+ * Fields and thresholds used when applying the masks in \ref PdpProcessor_process.
+ */
+typedef struct PdpProcessorInternal_MaskArgs {
+  long nbins; /**< number of bins */
+  RaveData2D_t* dataTH; /**< TH */
+  RaveData2D_t* dataZDR; /**< ZDR */
+  RaveData2D_t* dataPDP; /**< PDP */
+  RaveData2D_t* dataRHOHV; /**< RHOHV */
+  RaveData2D_t* dataDBZH; /**< DBZH */
+  RaveData2D_t* outQuality; /**< the quality from the clutter correction */
+  RaveData2D_t* residualClutterMask; /**< the residual clutter mask */
+  RaveData2D_t* outPDP; /**< the filtered PDP */
+  RaveData2D_t* outKDP; /**< the KDP */
+  RaveData2D_t* attenuationMask; /**< the attenuation mask */
+  unsigned char* thThresholdIndex; /**< index of pixels below the preprocessing threshold */
+  unsigned char* pdpChangedRays; /**< if not NULL, set to 1 for the rays where PDP is changed by the quality threshold */
+  unsigned char* belowMeltingLayer; /**< if bin is below the melting layer or not */
+  double preprocessZThreshold; /**< the preprocessing threshold */
+  double qualityThreshold; /**< the quality threshold */
+  double residualClutterMaskNodata; /**< nodata for the residual clutter mask */
+  double nodataTH; /**< nodata for TH */
+  double nodataZDR; /**< nodata for ZDR */
+  double nodataPHIDP; /**< nodata for PHIDP */
+  double nodataRHOHV; /**< nodata for RHOHV */
+  double nodataDBZH; /**< nodata for DBZH */
+  double undetectTH; /**< undetect for TH */
+  double flag; /**< flag value */
+  double minAttenuationMaskRHOHV; /**< min RHOHV in attenuation mask */
+  double minAttenuationMaskKDP; /**< min KDP in attenuation mask */
+  double minAttenuationMaskTH; /**< min TH in attenuation mask */
+  PdpStats_t* stats; /**< statistics that the flagged pixels are counted in, may be NULL */
+} PdpProcessorInternal_MaskArgs;
+
+/**
+ * Sets TH, ZDR, PDP and RHOHV to nodata where TH is below the preprocessing threshold.
+ */
+static void PdpProcessorInternal_preprocessRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_MaskArgs* args = (PdpProcessorInternal_MaskArgs*)arg;
+  long bi, ri, nbins = args->nbins, nflagged = 0;
+  for (ri = startray; ri < endray; ri++) {
+    for (bi = 0; bi < nbins; bi++) {
+      double v;
+      RaveData2D_getValueUnchecked(args->dataTH, bi, ri, &v);
+      if (v < args->preprocessZThreshold) {
+        args->thThresholdIndex[ri*nbins + bi] = 1;
+        RaveData2D_setValueUnchecked(args->dataTH, bi, ri, args->nodataTH);
+        RaveData2D_setValueUnchecked(args->dataZDR, bi, ri, args->nodataZDR);
+        RaveData2D_setValueUnchecked(args->dataPDP, bi, ri, args->nodataPHIDP);
+        RaveData2D_setValueUnchecked(args->dataRHOHV, bi, ri, args->nodataRHOHV);
+        nflagged++;
+      }
+    }
+  }
+  if (args->stats != NULL) {
+    PdpStats_addPixels(args->stats, PdpStatsStage_PREPROCESS, (endray - startray) * nbins, nflagged);
+  }
+}
+
+/**
+ * Removes the pixels with a quality below the quality threshold.
+ */
+static void PdpProcessorInternal_qualityThresholdRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_MaskArgs* args = (PdpProcessorInternal_MaskArgs*)arg;
+  long bi, ri, nbins = args->nbins, nflagged = 0;
+  for (ri = startray; ri < endray; ri++) {
+    for (bi = 0; bi < nbins; bi++) {
+      double v = 0.0;
+      RaveData2D_getValueUnchecked(args->outQuality, bi, ri, &v);
+      if (v < args->qualityThreshold) {
+        if (args->pdpChangedRays != NULL) {
+          double vPDP = 0.0;
+          RaveData2D_getValueUnchecked(args->dataPDP, bi, ri, &vPDP);
+          if (vPDP != args->nodataPHIDP) {
+            args->pdpChangedRays[ri] = 1;
+          }
+        }
+        RaveData2D_setValueUnchecked(args->dataTH, bi, ri, args->undetectTH);
+        RaveData2D_setValueUnchecked(args->dataZDR, bi, ri, args->nodataZDR);
+        RaveData2D_setValueUnchecked(args->dataPDP, bi, ri, args->nodataPHIDP);
+        RaveData2D_setValueUnchecked(args->dataRHOHV, bi, ri, args->nodataRHOHV);
+        RaveData2D_setValueUnchecked(args->dataDBZH, bi, ri, args->nodataDBZH);
+        nflagged++;
+      }
+    }
+  }
+  if (args->stats != NULL) {
+    PdpStats_addPixels(args->stats, PdpStatsStage_CLUTTER_ID, (endray - startray) * nbins, nflagged);
+  }
+}
+
+/**
+ * Applies the residual clutter mask, flags PDP and creates the attenuation mask in one sweep.
+ * All of these operations only depends on the current pixel. PDP and the attenuation mask are
+ * skipped when they are NULL.
+ */
+static void PdpProcessorInternal_residualClutterMaskRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_MaskArgs* args = (PdpProcessorInternal_MaskArgs*)arg;
+  long bi, ri, nbins = args->nbins, nresidual = 0, nattenuation = 0;
+  for (ri = startray; ri < endray; ri++) {
+    for (bi = 0; bi < nbins; bi++) {
+      double v = 0.0, vTH = 0.0, vRHOHV = 0.0, vKDP = 0.0;
+      RaveData2D_getValueUnchecked(args->residualClutterMask, bi, ri, &v);
+      if (v == 0.0 || v == args->residualClutterMaskNodata) {
+        RaveData2D_setValueUnchecked(args->dataTH, bi, ri, args->undetectTH);
+        RaveData2D_setValueUnchecked(args->dataZDR, bi, ri, args->flag);
+        RaveData2D_setValueUnchecked(args->dataRHOHV, bi, ri, args->flag);
+        nresidual++;
+      }
+      if (v == args->residualClutterMaskNodata) {
+        RaveData2D_setValueUnchecked(args->residualClutterMask, bi, ri, 0.0);
+      }
+
+      RaveData2D_getValueUnchecked(args->dataTH, bi, ri, &vTH);
+      if (args->outPDP != NULL && (args->thThresholdIndex[ri*nbins + bi] == 1 || vTH < -900.0)) {
+        RaveData2D_setValueUnchecked(args->outPDP, bi, ri, args->undetectTH);
+      }
+
+      if (args->attenuationMask != NULL && args->belowMeltingLayer[bi]) {
+        RaveData2D_getValueUnchecked(args->dataRHOHV, bi, ri, &vRHOHV);
+        RaveData2D_getValueUnchecked(args->outKDP, bi, ri, &vKDP);
+        if (vRHOHV > args->minAttenuationMaskRHOHV && vKDP > args->minAttenuationMaskKDP && vTH > args->minAttenuationMaskTH) {
+          RaveData2D_setValueUnchecked(args->attenuationMask, bi, ri, 1.0);
+          nattenuation++;
+        }
+      }
+    }
+  }
+  if (args->stats != NULL) {
+    PdpStats_addPixels(args->stats, PdpStatsStage_RESIDUAL_FILTER, (endray - startray) * nbins, nresidual);
+    if (args->attenuationMask != NULL) {
+      PdpStats_addPixels(args->stats, PdpStatsStage_ATTENUATION, 0, nattenuation);
+    }
+  }
+}
+
+/**
+ * Processes the scan and collects the statistics for each stage, see \ref PdpProcessor_process.
+ * @param[in] self - self
+ * @param[in] scan - the scan
+ * @param[in] sclutterMap - the clutter map, may be NULL
+ * @param[in] inPlace - if the result should be added to the scan instead of to a clone of it
+ * @param[in] deferred - if not NULL, the result is added to this list instead of to the scan, requires inPlace
+ * @param[in] stats - the statistics to collect to, may be NULL
+ * @returns the processed scan or NULL on failure
+ */
+static PolarScan_t* PdpProcessorInternal_process(PdpProcessor_t* self, PolarScan_t* scan, RaveData2D_t* sclutterMap, int inPlace, RaveObjectList_t* deferred, PdpStats_t* stats)
+{
+  PolarScan_t *result = NULL, *tmpresult = NULL;
+  double elangle = 0.0;
+  double range = 0.0, rangeKm = 0.0;
+  long nbins = 0, nrays = 0;
+  long bi = 0;
+  double nodataPHIDP = 0.0, nodataTH = 0.0, nodataZDR = 0.0, nodataDBZH = 0.0, nodataRHOHV = 0.0;
+  double flag = -999.9;
+  double undetectTH = 0.0, undetectDBZH = 0.0;
+  RaveDataType dataType = RaveDataType_DOUBLE;
+  RaveData2D_t *dataTH = NULL, *dataZDR = NULL, *dataDV = NULL, *texturePHIDP = NULL, *dataDBZH = NULL;
+  RaveData2D_t *dataRHOHV = NULL, *textureZ = NULL, *dataPHIDP = NULL, *dataPDP = NULL;
+  RaveData2D_t *clutterMap = NULL, *residualClutterMask = NULL;
+  RaveData2D_t *outZ = NULL, *outQuality = NULL, *outClutterMask = NULL;
+  RaveData2D_t *outPDP = NULL, *outKDP = NULL, *attenuationMask = NULL;
+  RaveData2D_t *outAttenuationZ = NULL, *outAttenuationZDR = NULL, *outAttenuationPIA = NULL, *outAttenuationDBZH = NULL;
+  RaveData2D_t *outZPHI = NULL, *outAH = NULL, *thThresholdField = NULL;
+  unsigned char *thThresholdIndex = NULL, *belowMeltingLayer = NULL, *pdpChangedRays = NULL;
+  RaveData2D_t *textureFields[2], *textures[2];
+  RaveField_t* pdpQualityField = NULL;
+  RaveData2D_t *resultFields[PdpProcessorInternal_RESULT_PARAMETERS], *resultQualityFields[PdpProcessorInternal_RESULT_QUALITY_FIELDS];
+  PolarScanParam_t* resultParams[PdpProcessorInternal_RESULTS];
+  RaveField_t* resultQualities[PdpProcessorInternal_RESULTS];
+  PdpProcessorInternal_Quantization quantizations[PdpProcessorInternal_RESULTS];
+  int nquantizations = 0;
+  PolarNavigator_t* navigator = NULL;
+  PolarScanParam_t *TH = NULL, *ZDR = NULL, *DV = NULL, *PHIDP = NULL, *RHOHV = NULL, *DBZH = NULL;
+  double nodata, qualityThreshold, residualClutterMaskNodata, minAttenuationMaskRHOHV, minAttenuationMaskKDP, minAttenuationMaskTH;
+  double meltingLayerBottomHeight;
+  PdpProcessorInternal_MaskArgs margs;
+  PdpProcessorInternal_RawSource sources[PdpProcessorInternal_CLUTTER_ID_TERMS];
+  PolarScanParam_t* inputParams[6];
+  double inputNodata[6];
+  RaveData2D_t* inputFields[6];
+  int stages = 0, i = 0;
+  PdpStats_t* previousStats = PdpProcessorInternal_getCurrentStats();
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  memset(resultParams, 0, sizeof(resultParams));
+  memset(resultQualities, 0, sizeof(resultQualities));
+
+  PdpProcessorInternal_setCurrentStats(stats);
+  PdpProcessorInternal_startStage(PdpStatsStage_TOTAL);
+
+  if (scan == NULL) {
+    RAVE_ERROR0("No scan provided");
+    goto done;
+  }
+
+  dataType = PdpProcessorInternal_getDataType(self);
+  nodata = PdpProcessorInternal_toPrecision(self, PpcRadarOptions_getNodata(self->options));
+  flag = PdpProcessorInternal_toPrecision(self, flag);
+  navigator = PolarScan_getNavigator(scan);
+
+  elangle = PolarScan_getElangle(scan);
+
+  range = PolarScan_getRscale(scan);
+  rangeKm =  range / 1000.0;
+  nbins = PolarScan_getNbins(scan);
+  nrays = PolarScan_getNrays(scan);
+
+  TH = PolarScan_getParameter(scan, "TH");
+  ZDR = PolarScan_getParameter(scan, "ZDR");
+  DV = PolarScan_getParameter(scan, "VRADH");
+  PHIDP = PolarScan_getParameter(scan, "PHIDP");
+  RHOHV = PolarScan_getParameter(scan, "RHOHV");
+  DBZH = PolarScan_getParameter(scan, "DBZH");
+  if (TH == NULL || ZDR == NULL || DV == NULL || PHIDP == NULL || RHOHV == NULL || DBZH == NULL) {
+    RAVE_ERROR0("Can not generate PPC product since one or more of TH, ZDR, DV, PHIDP, RHOHV and DBZH is missing");
+    goto done;
+  }
+
+  PdpProcessorInternal_startStage(PdpStatsStage_PREPROCESS);
+  inputParams[0] = TH;
+  inputParams[1] = ZDR;
+  inputParams[2] = DV;
+  inputParams[3] = PHIDP;
+  inputParams[4] = RHOHV;
+  inputParams[5] = DBZH;
+  inputNodata[0] = inputNodata[1] = inputNodata[2] = inputNodata[3] = inputNodata[4] = nodata;
+  inputNodata[5] = PolarScanParam_getNodata(DBZH);
+  if (PdpProcessorInternal_getData2DFromParams(self, 6, inputParams, inputNodata, dataType, inputFields)) {
+    dataTH = inputFields[0];
+    dataZDR = inputFields[1];
+    dataDV = inputFields[2];
+    dataPHIDP = inputFields[3];
+    dataRHOHV = inputFields[4];
+    dataDBZH = inputFields[5];
+  }
+  if (dataTH == NULL || dataZDR == NULL || dataDV == NULL || dataPHIDP == NULL || dataRHOHV == NULL || dataDBZH == NULL) {
+    RAVE_ERROR0("Can not generate PPC product since one or more of data fields for TH, ZDR, DV, PHIDP, RHOHV and DBZH not could be retrieved");
+    goto done;
+  }
+
+  if (sclutterMap != NULL) {
+    if (RaveData2D_getXsize(sclutterMap) != nbins || RaveData2D_getYsize(sclutterMap) != nrays) {
+      RAVE_ERROR0("Clutter Map dimension doesn't match number of rays/bins rays == ysize, bins = xsize");
+      goto done;
+    }
+    clutterMap = RAVE_OBJECT_COPY(sclutterMap);
+  } else {
+    clutterMap = PdpProcessorInternal_zeros(self, nbins, nrays, PdpProcessorInternal_getDataType(self));
+    if (clutterMap == NULL) {
+      RAVE_ERROR0("Could not create clutter map");
+      goto done;
+    }
+    RaveData2D_useNodata(clutterMap, 1);
+    RaveData2D_setNodata(clutterMap, 0.0);
+  }
+
+  /* PHIDP is only needed for creating PDP so we can hand over the field instead of copying it */
+  if (PpcRadarOptions_getInvertPHIDP(self->options) == 1) {
+    dataPDP = RaveData2D_mulNumber(dataPHIDP, -1.0); /** RSP produces inverted data */
+  } else {
+    dataPDP = RAVE_OBJECT_COPY(dataPHIDP);
+  }
+  PdpProcessorInternal_recycle(self, &dataPHIDP);
+  if (dataPDP == NULL) {
+    RAVE_ERROR0("Failed to multiplicate PHIDP");
+    goto done;
+  }
+  nodataPHIDP = nodata;
+  nodataTH = nodata;
+  nodataDBZH = PdpProcessorInternal_toPrecision(self, PolarScanParam_getNodata(DBZH));
+  nodataZDR = nodata;
+  nodataRHOHV = nodata;
+  undetectTH = PdpProcessorInternal_toPrecision(self, PolarScanParam_getUndetect(TH)*PolarScanParam_getGain(TH) + PolarScanParam_getOffset(TH));
+  undetectDBZH = PdpProcessorInternal_toPrecision(self, PolarScanParam_getUndetect(DBZH)*PolarScanParam_getGain(DBZH) + PolarScanParam_getOffset(DBZH));
+
+  /* Index of the pixels below the preprocessing threshold, one byte per pixel is enough */
+  thThresholdField = PdpProcessorInternal_zeros(self, nbins, nrays, RaveDataType_UCHAR);
+  if (thThresholdField == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for threshold index");
+    goto done;
+  }
+  thThresholdIndex = (unsigned char*)RaveData2D_getData(thThresholdField);
+
+  memset(&margs, 0, sizeof(PdpProcessorInternal_MaskArgs));
+  margs.nbins = nbins;
+  margs.dataTH = dataTH;
+  margs.dataZDR = dataZDR;
+  margs.dataPDP = dataPDP;
+  margs.dataRHOHV = dataRHOHV;
+  margs.dataDBZH = dataDBZH;
+  margs.thThresholdIndex = thThresholdIndex;
+  margs.preprocessZThreshold = PpcRadarOptions_getPreprocessZThreshold(self->options);
+  margs.nodataTH = nodataTH;
+  margs.nodataZDR = nodataZDR;
+  margs.nodataPHIDP = nodataPHIDP;
+  margs.nodataRHOHV = nodataRHOHV;
+  margs.nodataDBZH = nodataDBZH;
+  margs.undetectTH = undetectTH;
+  margs.flag = flag;
+  margs.stats = stats;
+
+  PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_preprocessRays, &margs);
+  PdpProcessorInternal_stopStage();
+
+  /* Only the stages that the requested fields depends on are run */
+  stages = PdpProcessorInternal_getRequiredStages(PpcRadarOptions_getRequestedFields(self->options));
+
+  if (stages & PdpProcessorInternal_STAGE_CLUTTER) {
+    PdpProcessorInternal_startStage(PdpStatsStage_TEXTURE);
+    textureFields[0] = dataPDP;
+    textureFields[1] = dataTH;
+    if (!PdpProcessor_textures(self, 2, textureFields, textures)) {
+      goto done;
+    }
+    texturePHIDP = textures[0];
+    textureZ = textures[1];
+    PdpProcessorInternal_stopStage();
+    PdpProcessorInternal_addPixels(PdpStatsStage_TEXTURE, 2 * nbins * nrays, 0);
+
+    /**************************************************************
+     * Clutter removal by using a Fuzzy Logic Approach
+     **************************************************************/
+    qualityThreshold = PpcRadarOptions_getQualityThreshold(self->options);
+
+    RAVE_DEBUG1("clutterMap: %d", RaveData2D_usingNodata(clutterMap));
+    if (!RaveData2D_usingNodata(clutterMap)) {
+      RAVE_ERROR0("Static clutter map doesn't specify nodata!");
+    }
+    PdpProcessorInternal_startStage(PdpStatsStage_CLUTTER_ID);
+    /* TH, VRADH and RHOHV are unchanged since the conversion except for the pixels below the preprocessing threshold */
+    memset(sources, 0, sizeof(sources));
+    sources[0].param = TH;
+    sources[0].mask = thThresholdIndex;
+    sources[1].param = DV;
+    sources[3].param = RHOHV;
+    sources[3].mask = thThresholdIndex;
+    /* Only the quality is used, the corrected Z and the clutter mask are not used in matlab */
+    if (!PdpProcessorInternal_clutterID(self, dataTH, dataDV, texturePHIDP, dataRHOHV, textureZ, clutterMap,
+          PdpProcessorInternal_toPrecision(self, PolarScanParam_getNodata(TH)), qualityThreshold, sources,
+          NULL, NULL, &outQuality, NULL)) {
+      goto done;
+    }
+    /* Release the fields that not are used after the clutter correction to keep memory footprint down */
+    PdpProcessorInternal_recycle(self, &textureZ);
+    PdpProcessorInternal_recycle(self, &clutterMap);
+    PdpProcessorInternal_recycle(self, &dataDV);
+
+    /* The PHIDP texture is reused by the pdp script, only the rays changed by the quality threshold has to be updated */
+    if (stages & PdpProcessorInternal_STAGE_PDP) {
+      pdpChangedRays = RAVE_MALLOC(sizeof(unsigned char) * nrays);
+      if (pdpChangedRays == NULL) {
+        RAVE_ERROR0("Failed to allocate memory for changed rays");
+        goto done;
+      }
+      memset(pdpChangedRays, 0, sizeof(unsigned char) * nrays);
+    } else {
+      PdpProcessorInternal_recycle(self, &texturePHIDP);
+    }
+
+    //disp_sint("QualityMap:", outQuality, 14, 153, 18, 158);
+    //disp_sint("QualityMap:", outQuality, 153, 14, 158, 18);
+
+    margs.outQuality = outQuality;
+    margs.qualityThreshold = qualityThreshold;
+    margs.pdpChangedRays = pdpChangedRays;
+    PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_qualityThresholdRays, &margs);
+    margs.outQuality = NULL;
+    margs.pdpChangedRays = NULL;
+    PdpProcessorInternal_recycle(self, &outQuality);
+    PdpProcessorInternal_stopStage();
+  }
+
+  /**************************************************************
+   * MEDIAN FILTERING TO REMOVE RESIDUAL ISOLATED PIXELS AFFECTED BY CLUTTER
+   **************************************************************/
+  if (stages & PdpProcessorInternal_STAGE_RESIDUAL) {
+    PdpProcessorInternal_startStage(PdpStatsStage_RESIDUAL_FILTER);
+    residualClutterMask = PdpProcessor_residualClutterFilter(self, dataTH,
+        PpcRadarOptions_getResidualThresholdZ(self->options),
+        PpcRadarOptions_getResidualThresholdTexture(self->options),
+        PpcRadarOptions_getResidualFilterBinSize(self->options),
+        PpcRadarOptions_getResidualFilterRaySize(self->options));
+    PdpProcessorInternal_stopStage();
+    if (residualClutterMask == NULL) {
+      goto done;
+    }
+  }
+
+  /**************************************************************
+   * PHIDP Filtering and Kdp retrieval
+   **************************************************************/
+  if (stages & PdpProcessorInternal_STAGE_PDP) {
+    PdpProcessorInternal_startStage(PdpStatsStage_PDP_SCRIPT);
+    if (texturePHIDP != NULL && !PdpProcessorInternal_updateTexture(self, dataPDP, texturePHIDP, pdpChangedRays)) {
+      goto done;
+    }
+    if (!PdpProcessorInternal_pdpScript(self, dataPDP, texturePHIDP, rangeKm,
+        PpcRadarOptions_getPdpRWin1(self->options),
+        PpcRadarOptions_getPdpRWin2(self->options),
+        PpcRadarOptions_getPdpNrIterations(self->options), &outPDP, &outKDP)) {
+      goto done;
+    }
+    PdpProcessorInternal_recycle(self, &texturePHIDP);
+    PdpProcessorInternal_stopStage();
+  }
+  residualClutterMaskNodata = PdpProcessorInternal_toPrecision(self, PpcRadarOptions_getResidualClutterMaskNodata(self->options));
+
+  /**************************************************************
+   * Attenuation correction using a linear approach (Bringi et al., 1990)
+   **************************************************************/
+  if (stages & PdpProcessorInternal_STAGE_ATTENUATION_MASK) {
+    PdpProcessorInternal_startStage(PdpStatsStage_ATTENUATION);
+    attenuationMask = PdpProcessorInternal_zeros(self, nbins, nrays, PdpProcessorInternal_getDataType(self));
+    belowMeltingLayer = RAVE_MALLOC(sizeof(unsigned char) * nbins);
+    if (attenuationMask == NULL || belowMeltingLayer == NULL) {
+      RAVE_ERROR0("Failed to create attenuation mask");
+      goto done;
+    }
+    minAttenuationMaskRHOHV = PpcRadarOptions_getMinAttenuationMaskRHOHV(self->options);
+    minAttenuationMaskKDP = PpcRadarOptions_getMinAttenuationMaskKDP(self->options);
+    minAttenuationMaskTH = PpcRadarOptions_getMinAttenuationMaskTH(self->options);
+    meltingLayerBottomHeight = PdpProcessor_getMeltingLayerBottomHeight(self);
+
+    /* The height only depends on the bin so it is enough to calculate it once per bin */
+    for (bi = 0; bi < nbins; bi++) {
+      double d = 0.0, h = 0.0;
+      PolarNavigator_reToDh(navigator, range * ((double)bi+0.5), elangle, &d, &h);
+      h = h / 1000.0;
+      belowMeltingLayer[bi] = (h < meltingLayerBottomHeight) ? 1 : 0;
+    }
+    PdpProcessorInternal_stopStage();
+  }
+
+  if (stages & PdpProcessorInternal_STAGE_RESIDUAL) {
+    margs.residualClutterMask = residualClutterMask;
+    margs.outPDP = outPDP;
+    margs.outKDP = outKDP;
+    margs.attenuationMask = attenuationMask;
+    margs.belowMeltingLayer = belowMeltingLayer;
+    margs.residualClutterMaskNodata = residualClutterMaskNodata;
+    margs.minAttenuationMaskRHOHV = minAttenuationMaskRHOHV;
+    margs.minAttenuationMaskKDP = minAttenuationMaskKDP;
+    margs.minAttenuationMaskTH = minAttenuationMaskTH;
+    PdpProcessorInternal_startStage(PdpStatsStage_RESIDUAL_FILTER);
+    PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_residualClutterMaskRays, &margs);
+    PdpProcessorInternal_stopStage();
+  }
+  margs.thThresholdIndex = NULL;
+  margs.belowMeltingLayer = NULL;
+  thThresholdIndex = NULL;
+  PdpProcessorInternal_recycle(self, &thThresholdField);
+  RAVE_FREE(belowMeltingLayer);
+
+  if (stages & PdpProcessorInternal_STAGE_ATTENUATION) {
+    PdpProcessorInternal_startStage(PdpStatsStage_ATTENUATION);
+    if (!PdpProcessor_attenuation(self, dataTH, dataZDR, dataDBZH, outPDP, attenuationMask,
+        PpcRadarOptions_getAttenuationGammaH(self->options),
+        PpcRadarOptions_getAttenuationAlpha(self->options),
+        undetectTH,
+        undetectDBZH,
+        &outAttenuationZ, &outAttenuationZDR, &outAttenuationPIA, &outAttenuationDBZH)) {
+      goto done;
+    }
+    PdpProcessorInternal_stopStage();
+    PdpProcessorInternal_addPixels(PdpStatsStage_ATTENUATION, nbins * nrays, 0);
+  }
+
+  /**************************************************************
+   * Application of the ZPHI methodology (Testud et al, 2000) for
+   * attenuation correction
+   **************************************************************/
+  if (stages & PdpProcessorInternal_STAGE_ZPHI) {
+    PdpProcessorInternal_startStage(PdpStatsStage_ZPHI);
+    if (!PdpProcessor_zphi(self, dataTH, outPDP, attenuationMask, rangeKm,
+        PpcRadarOptions_getBB(self->options), PpcRadarOptions_getAttenuationGammaH(self->options), &outZPHI, &outAH)) {
+      goto done;
+    }
+    PdpProcessorInternal_stopStage();
+    PdpProcessorInternal_addPixels(PdpStatsStage_ZPHI, nbins * nrays, 0);
+  }
+
+  RaveData2D_useNodata(dataTH, 1);
+  RaveData2D_setNodata(dataTH, PdpProcessorInternal_toPrecision(self, -999.9));
+
+  PdpProcessorInternal_startStage(PdpStatsStage_QUANTIZATION);
+  tmpresult = inPlace ? RAVE_OBJECT_COPY(scan) : RAVE_OBJECT_CLONE(scan);
+  if (tmpresult == NULL) {
+    goto done;
+  }
+
+  /* Same order as PdpProcessorInternal_resultParameters and PdpProcessorInternal_resultQualityFields */
+  resultFields[0] = dataTH;
+  resultFields[1] = outAttenuationZ;
+  resultFields[2] = dataDBZH;
+  resultFields[3] = outAttenuationDBZH;
+  resultFields[4] = outKDP;
+  resultFields[5] = dataRHOHV;
+  resultFields[6] = outPDP;
+  resultFields[7] = dataZDR;
+  resultFields[8] = outAttenuationZDR;
+  resultFields[9] = outZPHI;
+  resultQualityFields[0] = residualClutterMask;
+  resultQualityFields[1] = attenuationMask;
+
+  /* All requested fields are quantized together, fields with a fixed scaling in the options in one sweep over the rays */
+  for (i = 0; PdpProcessorInternal_resultParameters[i].quantity != NULL; i++) {
+    if (PpcRadarOptions_getRequestedFields(self->options) & PdpProcessorInternal_resultParameters[i].field) {
+      resultParams[nquantizations] = PdpProcessorInternal_createQuantizedParam(self->options, resultFields[i],
+          PdpProcessorInternal_resultParameters[i].quantity, &quantizations[nquantizations]);
+      if (resultParams[nquantizations++] == NULL) {
+        RAVE_ERROR1("Failed to create %s", PdpProcessorInternal_resultParameters[i].quantity);
+        goto done;
+      }
+    }
+  }
+  for (i = 0; PdpProcessorInternal_resultQualityFields[i].howtask != NULL; i++) {
+    if (PpcRadarOptions_getRequestedFields(self->options) & PdpProcessorInternal_resultQualityFields[i].field) {
+      resultQualities[nquantizations] = PdpProcessorInternal_createQuantizedQualityField(self->options, resultQualityFields[i],
+          PdpProcessorInternal_resultQualityFields[i].howtask, &quantizations[nquantizations]);
+      if (resultQualities[nquantizations++] == NULL) {
+        RAVE_ERROR1("Failed to create %s", PdpProcessorInternal_resultQualityFields[i].howtask);
+        goto done;
+      }
+    }
+  }
+  if (!PdpProcessorInternal_quantize(self, nquantizations, quantizations)) {
+    goto done;
+  }
+  for (i = 0; i < nquantizations; i++) {
+    if (!PdpProcessorInternal_finishQuantization(tmpresult, &quantizations[i], inPlace, deferred)) {
+      goto done;
+    }
+  }
+
+  PdpProcessorInternal_stopStage();
+  PdpProcessorInternal_addPixels(PdpStatsStage_QUANTIZATION, nquantizations * nbins * nrays, 0);
+  PdpProcessorInternal_stopStage(); /* Total */
+  PdpProcessorInternal_addPixels(PdpStatsStage_TOTAL, nbins * nrays, 0);
+
+  result = RAVE_OBJECT_COPY(tmpresult);
+done:
+  PdpProcessorInternal_recycle(self, &dataTH);
+  PdpProcessorInternal_recycle(self, &thThresholdField);
+  RAVE_FREE(belowMeltingLayer);
+  RAVE_FREE(pdpChangedRays);
+  PdpProcessorInternal_recycle(self, &dataZDR);
+  PdpProcessorInternal_recycle(self, &dataDV);
+  PdpProcessorInternal_recycle(self, &texturePHIDP);
+  PdpProcessorInternal_recycle(self, &dataRHOHV);
+  PdpProcessorInternal_recycle(self, &textureZ);
+  PdpProcessorInternal_recycle(self, &dataPHIDP);
+  PdpProcessorInternal_recycle(self, &dataPDP);
+  PdpProcessorInternal_recycle(self, &dataDBZH);
+  PdpProcessorInternal_recycle(self, &clutterMap);
+  PdpProcessorInternal_recycle(self, &residualClutterMask);
+  PdpProcessorInternal_recycle(self, &outZ);
+  PdpProcessorInternal_recycle(self, &outQuality);
+  PdpProcessorInternal_recycle(self, &outClutterMask);
+  PdpProcessorInternal_recycle(self, &outPDP);
+  PdpProcessorInternal_recycle(self, &outKDP);
+  PdpProcessorInternal_recycle(self, &attenuationMask);
+  PdpProcessorInternal_recycle(self, &outAttenuationZ);
+  PdpProcessorInternal_recycle(self, &outAttenuationZDR);
+  PdpProcessorInternal_recycle(self, &outAttenuationPIA);
+  PdpProcessorInternal_recycle(self, &outAttenuationDBZH);
+  PdpProcessorInternal_recycle(self, &outZPHI);
+  PdpProcessorInternal_recycle(self, &outAH);
+  RAVE_OBJECT_RELEASE(navigator);
+  RAVE_OBJECT_RELEASE(TH);
+  RAVE_OBJECT_RELEASE(ZDR);
+  RAVE_OBJECT_RELEASE(DV);
+  RAVE_OBJECT_RELEASE(PHIDP);
+  RAVE_OBJECT_RELEASE(RHOHV);
+  RAVE_OBJECT_RELEASE(DBZH);
+  RAVE_OBJECT_RELEASE(pdpQualityField);
+  for (i = 0; i < PdpProcessorInternal_RESULTS; i++) {
+    RAVE_OBJECT_RELEASE(resultParams[i]);
+    RAVE_OBJECT_RELEASE(resultQualities[i]);
+  }
+  RAVE_OBJECT_RELEASE(tmpresult);
+  PdpProcessorInternal_setCurrentStats(previousStats);
+
+  return result;
+}
+
+/**
+ * Sets the statistics as the last statistics and prints them if requested.
+ * @param[in] self - self
+ * @param[in] stats - the statistics
+ */
+static void PdpProcessorInternal_publishStats(PdpProcessor_t* self, PdpStats_t* stats)
+{
+  if (stats == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&self->statsLock);
+  RAVE_OBJECT_RELEASE(self->lastStats);
+  self->lastStats = RAVE_OBJECT_COPY(stats);
+  pthread_mutex_unlock(&self->statsLock);
+  if (self->printStats) {
+    PdpStats_print(stats, stderr, "PdpProcessor: ");
+  }
+}
+
+PolarScan_t* PdpProcessor_process(PdpProcessor_t* self, PolarScan_t* scan, RaveData2D_t* sclutterMap)
+{
+  PolarScan_t* result = NULL;
+  PdpStats_t* stats = NULL;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  stats = RAVE_OBJECT_NEW(&PdpStats_TYPE);
+  if (stats == NULL) {
+    RAVE_WARNING0("Failed to create statistics, processing without them");
+  }
+  result = PdpProcessorInternal_process(self, scan, sclutterMap, 0, NULL, stats);
+  if (result != NULL) {
+    PdpProcessorInternal_publishStats(self, stats);
+  }
+  RAVE_OBJECT_RELEASE(stats);
+  return result;
+}
+
+int PdpProcessor_processInPlace(PdpProcessor_t* self, PolarScan_t* scan, RaveData2D_t* sclutterMap)
+{
+  PolarScan_t* result = NULL;
+  PdpStats_t* stats = NULL;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  stats = RAVE_OBJECT_NEW(&PdpStats_TYPE);
+  if (stats == NULL) {
+    RAVE_WARNING0("Failed to create statistics, processing without them");
+  }
+  result = PdpProcessorInternal_process(self, scan, sclutterMap, 1, NULL, stats);
+  if (result != NULL) {
+    PdpProcessorInternal_publishStats(self, stats);
+  }
+  RAVE_OBJECT_RELEASE(stats);
+  RAVE_OBJECT_RELEASE(result);
+  return (result != NULL) ? 1 : 0;
+}
+
+PdpStats_t* PdpProcessor_getLastStats(PdpProcessor_t* self)
+{
+  PdpStats_t* result = NULL;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->statsLock);
+  result = RAVE_OBJECT_COPY(self->lastStats);
+  pthread_mutex_unlock(&self->statsLock);
+  return result;
+}
+
+void PdpProcessor_setPrintStats(PdpProcessor_t* self, int print)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->printStats = print;
+}
+
+int PdpProcessor_getPrintStats(PdpProcessor_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->printStats;
+}
+
+int PdpProcessor_setMedfiltAlgorithm(PdpProcessor_t* self, PdpMedfiltAlgorithm algorithm)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (algorithm != PdpMedfiltAlgorithm_COUNT && algorithm != PdpMedfiltAlgorithm_SORT && algorithm != PdpMedfiltAlgorithm_HISTOGRAM) {
+    RAVE_ERROR0("Unknown median filter algorithm");
+    return 0;
+  }
+  self->medfiltAlgorithm = algorithm;
+  return 1;
+}
+
+PdpMedfiltAlgorithm PdpProcessor_getMedfiltAlgorithm(PdpProcessor_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->medfiltAlgorithm;
+}
+
+void PdpProcessor_setWorkspace(PdpProcessor_t* self, PdpWorkspace_t* workspace)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_OBJECT_RELEASE(self->workspace);
+  self->workspace = RAVE_OBJECT_COPY(workspace);
+}
+
+PdpWorkspace_t* PdpProcessor_getWorkspace(PdpProcessor_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return RAVE_OBJECT_COPY(self->workspace);
+}
+
+int PdpProcessor_processVolume(PdpProcessor_t* self, PolarVolume_t* pvol, RaveObjectList_t* clutterMaps)
+{
+  int result = 0;
+  long nscans = 0, si = 0, nmaps = 0, nthreads = 0;
+  PdpProcessorInternal_VolumeArgs vargs;
+  PdpProcessorInternal_ThreadPool* pool = NULL;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  memset(&vargs, 0, sizeof(PdpProcessorInternal_VolumeArgs));
+
+  if (pvol == NULL) {
+    RAVE_ERROR0("No volume provided");
+    goto done;
+  }
+
+  nscans = PolarVolume_getNumberOfScans(pvol);
+  if (nscans <= 0) {
+    result = 1;
+    goto done;
+  }
+  if (clutterMaps != NULL) {
+    nmaps = RaveObjectList_size(clutterMaps);
+  }
+
+  vargs.processor = self;
+  vargs.stats = RAVE_OBJECT_NEW(&PdpStats_TYPE);
+  vargs.scans = RAVE_MALLOC(sizeof(PolarScan_t*) * nscans);
+  vargs.clutterMaps = RAVE_MALLOC(sizeof(RaveData2D_t*) * nscans);
+  vargs.products = RAVE_MALLOC(sizeof(RaveObjectList_t*) * nscans);
+  if (vargs.scans == NULL || vargs.clutterMaps == NULL || vargs.products == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for volume processing");
+    goto done;
+  }
+  memset(vargs.scans, 0, sizeof(PolarScan_t*) * nscans);
+  memset(vargs.clutterMaps, 0, sizeof(RaveData2D_t*) * nscans);
+  memset(vargs.products, 0, sizeof(RaveObjectList_t*) * nscans);
+
+  for (si = 0; si < nscans; si++) {
+    vargs.scans[si] = PolarVolume_getScan(pvol, si);
+    if (si < nmaps) {
+      vargs.clutterMaps[si] = (RaveData2D_t*)RaveObjectList_get(clutterMaps, si);
+      if (!RAVE_OBJECT_CHECK_TYPE(vargs.clutterMaps[si], &RaveData2D_TYPE)) {
+        RAVE_ERROR1("Clutter map for scan %ld is not a RaveData2D", si);
+        goto done;
+      }
+    }
+  }
+
+  /* The scans are processed by the workers of the pool, each one with the same processor and melting layer height.
+   * At most nthreads scans run at the same time and the threads are shared between them for the rays. */
+  nthreads = PdpProcessorInternal_getNumberOfThreads(self);
+  if (nthreads > 1) {
+    pool = PdpProcessorInternal_acquirePool(self, nthreads);
+  }
+  vargs.dispatch.pool = pool;
+  vargs.dispatch.nthreads = nthreads / ((nscans < nthreads) ? nscans : nthreads);
+  if (vargs.dispatch.nthreads < 1) {
+    vargs.dispatch.nthreads = 1;
+  }
+  PdpProcessorInternal_dispatch(pool, nscans, nscans, PdpProcessorInternal_processScans, &vargs);
+  PdpProcessorInternal_releasePool(self, pool);
+
+  for (si = 0; si < nscans; si++) {
+    if (vargs.products[si] == NULL) {
+      RAVE_ERROR1("Failed to process scan %ld in volume", si);
+      goto done;
+    }
+  }
+
+  for (si = 0; si < nscans; si++) {
+    if (!PdpProcessorInternal_attachResult(vargs.scans[si], vargs.products[si])) {
+      goto done;
+    }
+  }
+  PdpProcessorInternal_publishStats(self, vargs.stats);
+
+  result = 1;
+done:
+  for (si = 0; si < nscans; si++) {
+    if (vargs.scans != NULL) {
+      RAVE_OBJECT_RELEASE(vargs.scans[si]);
+    }
+    if (vargs.clutterMaps != NULL) {
+      RAVE_OBJECT_RELEASE(vargs.clutterMaps[si]);
+    }
+    if (vargs.products != NULL) {
+      RAVE_OBJECT_RELEASE(vargs.products[si]);
+    }
+  }
+  RAVE_FREE(vargs.scans);
+  RAVE_FREE(vargs.clutterMaps);
+  RAVE_FREE(vargs.products);
+  RAVE_OBJECT_RELEASE(vargs.stats);
+  return result;
+}
+
+void PdpProcessor_setMeltingLayerBottomHeight(PdpProcessor_t* self, double height)
+{
+  self->meltingLayerBottomHeight = height;
+}
+
+double PdpProcessor_getMeltingLayerBottomHeight(PdpProcessor_t* self)
+{
+  /* @TODO: implement proper support for this */
+  if (self->meltingLayerBottomHeight <= -1.0) {
+    return PpcRadarOptions_getMeltingLayerBottomHeight(self->options);
+  }
+  return self->meltingLayerBottomHeight;
+}
+
+/**
+ * Arguments used by the texture kernel
+ */
+typedef struct PdpProcessorInternal_TextureArgs {
+  long nfields; /**< number of fields */
+  RaveData2D_t** X; /**< the fields */
+  double** halo; /**< the fields as doubles padded with one wrapped bin and ray on each side */
+  RaveData2D_t** textures; /**< the resulting textures */
+  double* nodata; /**< nodata for each field */
+  const unsigned char* rays; /**< if not NULL, only the rays set to 1 are calculated */
+  long xsize; /**< xsize */
+  long ysize; /**< ysize */
+} PdpProcessorInternal_TextureArgs;
+
+/**
+ * Copies the rays into the halos, ray y is stored in halo row y + 1 and bin x in halo column x + 1.
+ * The first and last column are wrapped around in range. The first and last row are filled in
+ * by \ref PdpProcessorInternal_textures when all rays have been copied.
+ */
+static void PdpProcessorInternal_textureHaloRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_TextureArgs* args = (PdpProcessorInternal_TextureArgs*)arg;
+  long xsize = args->xsize, hxsize = args->xsize + 2;
+  long y, f;
+  for (y = startray; y < endray; y++) {
+    for (f = 0; f < args->nfields; f++) {
+      double* row = args->halo[f] + (y + 1) * hxsize;
+      PdpProcessorInternal_getRay(args->X[f], y, row + 1);
+      row[0] = row[xsize];
+      row[xsize + 1] = row[1];
+    }
+  }
+}
+
+/**
+ * Calculates the texture of one ray from the halo. A neighbour only counts if both the bin and the neighbour differs
+ * from nodata and at least 3 neighbours are needed. The terms are added in the same order as the original circshift
+ * implementation so the result is exactly the same. The loop has no branches or index wrapping so it can be vectorized
+ * by the compiler.
+ * @param[in] halo - the halo
+ * @param[in] hxsize - number of columns in the halo
+ * @param[in] xsize - number of bins
+ * @param[in] y - the ray
+ * @param[in] nodata - nodata
+ * @param[in] texture - the resulting texture
+ */
+static void PdpProcessorInternal_textureRay(const double* halo, long hxsize, long xsize, long y, double nodata, RaveData2D_t* texture)
+{
+  const double* up = halo + (y + 2) * hxsize + 1;
+  const double* mid = halo + (y + 1) * hxsize + 1;
+  const double* down = halo + y * hxsize + 1;
+  RaveDataType type = RaveData2D_getType(texture);
+  void* data = RaveData2D_getData(texture);
+  double* dout = (type == RaveDataType_DOUBLE) ? (double*)data + y * xsize : NULL;
+  float* fout = (type == RaveDataType_FLOAT) ? (float*)data + y * xsize : NULL;
+  long x;
 
   for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
-      double valueTexture = 0.0;
-      double valueSumWeight = 0.0;
-      double valueX = 0.0;
-      double valueWeight = 0.0;
+    double v = mid[x];
+    double w = (v != nodata) ? 1.0 : 0.0;
+    double n[8], t = 0.0, sw = 0.0, value;
+    int k;
+    n[0] = up[x+1]; n[1] = up[x]; n[2] = up[x-1];
+    n[3] = mid[x+1]; n[4] = mid[x-1];
+    n[5] = down[x+1]; n[6] = down[x]; n[7] = down[x-1];
+    for (k = 0; k < 8; k++) {
+      double wn = (n[k] != nodata) ? 1.0 : 0.0;
+      t = t + w * wn * (n[k] - v) * (n[k] - v);
+      sw = sw + w * wn;
+    }
+    value = (sw >= 3.0 && t >= 0) ? sqrt(t) / sw : nodata;
+    if (dout != NULL) {
+      dout[x] = value;
+    } else if (fout != NULL) {
+      fout[x] = (float)value;
+    } else {
+      RaveData2D_setValueUnchecked(texture, x, y, value);
+    }
+  }
+}
+
+/**
+ * Calculates the textures, all fields are handled for each ray. The neighbouring rays are only read so the rays
+ * can be processed in any order.
+ */
+static void PdpProcessorInternal_textureRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_TextureArgs* args = (PdpProcessorInternal_TextureArgs*)arg;
+  long y, f;
+  for (y = startray; y < endray; y++) {
+    if (args->rays != NULL && !args->rays[y]) {
+      continue;
+    }
+    for (f = 0; f < args->nfields; f++) {
+      PdpProcessorInternal_textureRay(args->halo[f], args->xsize + 2, args->xsize, y, args->nodata[f], args->textures[f]);
+    }
+  }
+}
+
+/**
+ * Number of steps before the running box sums are summed up again from scratch to avoid accumulating rounding errors.
+ */
+#define PdpProcessorInternal_BOX_RESYNC 64
+
+/**
+ * Arguments used by the box texture kernels
+ */
+typedef struct PdpProcessorInternal_BoxTextureArgs {
+  RaveData2D_t* X; /**< the field */
+  RaveData2D_t* texture; /**< the resulting texture */
+  double* s1; /**< sum of the valid values in the bin window, one row per ray */
+  double* s2; /**< sum of the squared valid values in the bin window, one row per ray */
+  double* count; /**< number of valid values in the bin window, one row per ray */
+  double* invalid; /**< number of non finite values (not nodata) in the bin window, one row per ray */
+  const unsigned char* rays; /**< if not NULL, only the rays set to 1 are calculated */
+  long xsize; /**< xsize */
+  long ysize; /**< ysize */
+  long hx; /**< half window size in bins */
+  long hy; /**< half window size in rays */
+  double nodata; /**< nodata */
+  int failed; /**< set to 1 if a kernel failed to allocate memory */
+} PdpProcessorInternal_BoxTextureArgs;
+
+/**
+ * Calculates the box sums along each ray with running sums. The window is wrapped around in range.
+ */
+static void PdpProcessorInternal_boxTextureBinRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_BoxTextureArgs* args = (PdpProcessorInternal_BoxTextureArgs*)arg;
+  long xsize = args->xsize, hx = args->hx;
+  double *row = NULL, *c1 = NULL, *c2 = NULL, *cc = NULL, *cp = NULL;
+  long x, y, i;
+
+  row = RAVE_MALLOC(sizeof(double) * xsize * 5);
+  if (row == NULL) {
+    args->failed = 1;
+    return;
+  }
+  c1 = row + xsize;
+  c2 = c1 + xsize;
+  cc = c2 + xsize;
+  cp = cc + xsize;
+
+  for (y = startray; y < endray; y++) {
+    double *s1 = args->s1 + y * xsize, *s2 = args->s2 + y * xsize;
+    double *count = args->count + y * xsize, *invalid = args->invalid + y * xsize;
+    double r1 = 0.0, r2 = 0.0, rc = 0.0, rp = 0.0;
+
+    PdpProcessorInternal_getRay(args->X, y, row);
+    for (x = 0; x < xsize; x++) {
+      double v = row[x];
+      int valid = (v != args->nodata) && isfinite(v);
+      c1[x] = valid ? v : 0.0;
+      c2[x] = valid ? v * v : 0.0;
+      cc[x] = valid ? 1.0 : 0.0;
+      cp[x] = (v != args->nodata && !isfinite(v)) ? 1.0 : 0.0;
+    }
+
+    for (x = 0; x < xsize; x++) {
+      if (x % PdpProcessorInternal_BOX_RESYNC == 0) {
+        r1 = r2 = rc = rp = 0.0;
+        for (i = x - hx; i <= x + hx; i++) {
+          long xi = ((i % xsize) + xsize) % xsize;
+          r1 += c1[xi]; r2 += c2[xi]; rc += cc[xi]; rp += cp[xi];
+        }
+      } else {
+        long xa = (x + hx) % xsize;
+        long xr = (((x - hx - 1) % xsize) + xsize) % xsize;
+        r1 += c1[xa] - c1[xr];
+        r2 += c2[xa] - c2[xr];
+        rc += cc[xa] - cc[xr];
+        rp += cp[xa] - cp[xr];
+      }
+      s1[x] = r1;
+      s2[x] = r2;
+      count[x] = rc;
+      invalid[x] = rp;
+    }
+  }
+  RAVE_FREE(row);
+}
+
+/**
+ * Adds the bin box sums over the ray window with running sums and calculates the texture. The window is
+ * wrapped around in azimuth. The bin box sums are only read so the rays can be processed in any order.
+ */
+static void PdpProcessorInternal_boxTextureRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_BoxTextureArgs* args = (PdpProcessorInternal_BoxTextureArgs*)arg;
+  long xsize = args->xsize, ysize = args->ysize, hy = args->hy;
+  double *row = NULL, *out = NULL, *r1 = NULL, *r2 = NULL, *rc = NULL, *rp = NULL;
+  long x, y, j;
+
+  row = RAVE_MALLOC(sizeof(double) * xsize * 6);
+  if (row == NULL) {
+    args->failed = 1;
+    return;
+  }
+  out = row + xsize;
+  r1 = out + xsize;
+  r2 = r1 + xsize;
+  rc = r2 + xsize;
+  rp = rc + xsize;
+
+  for (y = startray; y < endray; y++) {
+    if ((y - startray) % PdpProcessorInternal_BOX_RESYNC == 0) {
+      memset(r1, 0, sizeof(double) * xsize * 4);
+      for (j = y - hy; j <= y + hy; j++) {
+        long o = (((j % ysize) + ysize) % ysize) * xsize;
+        for (x = 0; x < xsize; x++) {
+          r1[x] += args->s1[o + x]; r2[x] += args->s2[o + x]; rc[x] += args->count[o + x]; rp[x] += args->invalid[o + x];
+        }
+      }
+    } else {
+      long oa = ((y + hy) % ysize) * xsize;
+      long oremove = ((((y - hy - 1) % ysize) + ysize) % ysize) * xsize;
+      for (x = 0; x < xsize; x++) {
+        r1[x] += args->s1[oa + x] - args->s1[oremove + x];
+        r2[x] += args->s2[oa + x] - args->s2[oremove + x];
+        rc[x] += args->count[oa + x] - args->count[oremove + x];
+        rp[x] += args->invalid[oa + x] - args->invalid[oremove + x];
+      }
+    }
+    if (args->rays != NULL && !args->rays[y]) {
+      continue;
+    }
+
+    PdpProcessorInternal_getRay(args->X, y, row);
+    for (x = 0; x < xsize; x++) {
+      double c = row[x];
+      /* The bin itself is part of the box sums but not a neighbour */
+      double n = rc[x] - 1.0;
+      double sum1 = r1[x] - c, sum2 = r2[x] - c * c;
+      double t = sum2 - 2.0 * c * sum1 + n * c * c;
+      if (c == args->nodata || !isfinite(c) || rp[x] > 0.0 || n < 3.0) {
+        out[x] = args->nodata;
+      } else {
+        out[x] = sqrt((t > 0.0) ? t : 0.0) / n;
+      }
+    }
+    PdpProcessorInternal_setRay(args->texture, y, out);
+  }
+  RAVE_FREE(row);
+}
+
+/**
+ * Calculates a texture with an arbitrary window using box sums of the values, the squared values and the number
+ * of valid values, so the cost doesn't depend on the window size. The texture is the same as for the 3x3 window,
+ * sqrt(sum((neighbour - value)^2)) / number of neighbours, but since it's calculated from sums it's only equal within
+ * rounding errors. Non finite values gives nodata in the whole window.
+ * @param[in] self - self
+ * @param[in] X - the field
+ * @param[in] texture - the texture
+ * @param[in] hx - half window size in bins
+ * @param[in] hy - half window size in rays
+ * @param[in] rays - if not NULL, only the rays set to 1 are calculated
+ * @return 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_boxTexture(PdpProcessor_t* self, RaveData2D_t* X, RaveData2D_t* texture, long hx, long hy, const unsigned char* rays)
+{
+  RaveData2D_t *s1 = NULL, *s2 = NULL, *count = NULL, *invalid = NULL;
+  PdpProcessorInternal_BoxTextureArgs bargs;
+  long xsize = RaveData2D_getXsize(X), ysize = RaveData2D_getYsize(X);
+  int result = 0;
+
+  s1 = PdpProcessorInternal_zeros(self, xsize, ysize, RaveDataType_DOUBLE);
+  s2 = PdpProcessorInternal_zeros(self, xsize, ysize, RaveDataType_DOUBLE);
+  count = PdpProcessorInternal_zeros(self, xsize, ysize, RaveDataType_DOUBLE);
+  invalid = PdpProcessorInternal_zeros(self, xsize, ysize, RaveDataType_DOUBLE);
+  if (s1 == NULL || s2 == NULL || count == NULL || invalid == NULL) {
+    RAVE_ERROR0("Allocation error when creating texture");
+    goto done;
+  }
+
+  memset(&bargs, 0, sizeof(PdpProcessorInternal_BoxTextureArgs));
+  bargs.X = X;
+  bargs.texture = texture;
+  bargs.s1 = (double*)RaveData2D_getData(s1);
+  bargs.s2 = (double*)RaveData2D_getData(s2);
+  bargs.count = (double*)RaveData2D_getData(count);
+  bargs.invalid = (double*)RaveData2D_getData(invalid);
+  bargs.rays = rays;
+  bargs.xsize = xsize;
+  bargs.ysize = ysize;
+  bargs.hx = hx;
+  bargs.hy = hy;
+  bargs.nodata = RaveData2D_getNodata(X);
+
+  /* All bin sums must be available before the ray window is added since neighbouring rays are used */
+  PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_boxTextureBinRays, &bargs);
+  if (!bargs.failed) {
+    PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_boxTextureRays, &bargs);
+  }
+  if (bargs.failed) {
+    RAVE_ERROR0("Allocation error when creating texture");
+    goto done;
+  }
+
+  result = 1;
+done:
+  PdpProcessorInternal_recycle(self, &s1);
+  PdpProcessorInternal_recycle(self, &s2);
+  PdpProcessorInternal_recycle(self, &count);
+  PdpProcessorInternal_recycle(self, &invalid);
+  return result;
+}
+
+/**
+ * Returns the half texture window sizes from the options. Even sizes are increased by one.
+ * @param[in] self - self
+ * @param[out] hx - half window size in bins
+ * @param[out] hy - half window size in rays
+ */
+static void PdpProcessorInternal_getTextureWindow(PdpProcessor_t* self, long* hx, long* hy)
+{
+  long binSize = PpcRadarOptions_getTextureBinSize(self->options);
+  long raySize = PpcRadarOptions_getTextureRaySize(self->options);
+  *hx = (binSize > 1) ? binSize / 2 : 0;
+  *hy = (raySize > 1) ? raySize / 2 : 0;
+}
 
-      RaveData2D_getValueUnchecked(weight, x, y, &valueWeight);
-      RaveData2D_getValueUnchecked(X, x, y, &valueX);
+/**
+ * Calculates the textures of several fields with the same geometry in one sweep.
+ * @param[in] self - self
+ * @param[in] nfields - number of fields
+ * @param[in] X - the fields, all must use nodata
+ * @param[in,out] textures - the textures. If a texture is NULL it will be created, otherwise the existing texture is updated.
+ * @param[in] rays - if not NULL, only the rays set to 1 are calculated. Should only be used when updating textures.
+ * @return 1 on success otherwise 0, the created textures are released on failure
+ */
+static int PdpProcessorInternal_textures(PdpProcessor_t* self, long nfields, RaveData2D_t** X, RaveData2D_t** textures, const unsigned char* rays)
+{
+  RaveData2D_t** halos = NULL;
+  double** hdata = NULL;
+  double* nodata = NULL;
+  int* created = NULL;
+  long xsize = 0, ysize = 0, hxsize = 0, f = 0, hx = 1, hy = 1;
+  int result = 0;
+  PdpProcessorInternal_TextureArgs targs;
 
-      for (j = 1; j >= -1; j--) {
-        for (i = 1; i >= -1; i--) {
-          long xi = (x + i)%xsize;
-          long yj = (y + j)%ysize;
-          double valueCircshiftWeight = 0.0;
-          double valueCircshiftX = 0.0;
+  if (nfields <= 0) {
+    return 1;
+  }
+  PdpProcessorInternal_getTextureWindow(self, &hx, &hy);
+  xsize = RaveData2D_getXsize(X[0]);
+  ysize = RaveData2D_getYsize(X[0]);
+  hxsize = xsize + 2;
+
+  halos = RAVE_MALLOC(sizeof(RaveData2D_t*) * nfields);
+  hdata = RAVE_MALLOC(sizeof(double*) * nfields);
+  nodata = RAVE_MALLOC(sizeof(double) * nfields);
+  created = RAVE_MALLOC(sizeof(int) * nfields);
+  if (halos == NULL || hdata == NULL || nodata == NULL || created == NULL) {
+    RAVE_ERROR0("Allocation error when creating textures");
+    goto done;
+  }
+  for (f = 0; f < nfields; f++) {
+    halos[f] = NULL;
+    created[f] = 0;
+  }
 
-          if (i==0 && j==0) continue;
+  for (f = 0; f < nfields; f++) {
+    if (RaveData2D_getXsize(X[f]) != xsize || RaveData2D_getYsize(X[f]) != ysize) {
+      RAVE_ERROR0("All fields must have the same geometry to create textures");
+      goto done;
+    }
+    nodata[f] = RaveData2D_getNodata(X[f]);
+    if (textures[f] == NULL) {
+      textures[f] = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
+      created[f] = 1;
+    }
+    if (textures[f] == NULL) {
+      RAVE_ERROR0("Allocation error when creating texture");
+      goto done;
+    }
+    if (hx != 1 || hy != 1) {
+      /* Other windows than the default 3x3 uses box sums, one field at a time */
+      if (!PdpProcessorInternal_boxTexture(self, X[f], textures[f], hx, hy, rays)) {
+        goto done;
+      }
+      continue;
+    }
+    halos[f] = PdpProcessorInternal_zeros(self, hxsize, ysize + 2, RaveDataType_DOUBLE);
+    if (halos[f] == NULL) {
+      RAVE_ERROR0("Allocation error when creating texture");
+      goto done;
+    }
+    hdata[f] = (double*)RaveData2D_getData(halos[f]);
+  }
+  if (hx != 1 || hy != 1) {
+    result = 1;
+    goto done;
+  }
 
-          while (xi < 0) {
-            xi += xsize;
-          }
-          while (yj < 0) {
-            yj += ysize;
-          }
+  targs.nfields = nfields;
+  targs.X = X;
+  targs.halo = hdata;
+  targs.textures = textures;
+  targs.nodata = nodata;
+  targs.rays = rays;
+  targs.xsize = xsize;
+  targs.ysize = ysize;
+
+  /* All rays must be in the halos before the textures are calculated since neighbouring rays are used */
+  PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_textureHaloRays, &targs);
+  for (f = 0; f < nfields; f++) {
+    memcpy(hdata[f], hdata[f] + ysize * hxsize, sizeof(double) * hxsize);
+    memcpy(hdata[f] + (ysize + 1) * hxsize, hdata[f] + hxsize, sizeof(double) * hxsize);
+  }
+  PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_textureRays, &targs);
 
-          RAVE_ASSERT((xi >= 0 && xi <xsize && yj >= 0 && yj < ysize), "BAD PROGRAMMING");
+  result = 1;
+done:
+  for (f = 0; halos != NULL && f < nfields; f++) {
+    PdpProcessorInternal_recycle(self, &halos[f]);
+    if (!result && created != NULL && created[f]) {
+      PdpProcessorInternal_recycle(self, &textures[f]);
+    }
+  }
+  RAVE_FREE(halos);
+  RAVE_FREE(hdata);
+  RAVE_FREE(nodata);
+  RAVE_FREE(created);
+  return result;
+}
 
-          RaveData2D_getValueUnchecked(weight, xi, yj, &valueCircshiftWeight);
-          RaveData2D_getValueUnchecked(X, xi, yj, &valueCircshiftX);
+/**
+ * Updates a texture after some of the rays in the field has been modified. Only the rays that has a modified
+ * ray within their neighbourhood are calculated again so the result is the same as calculating a new texture.
+ * @param[in] self - self
+ * @param[in] X - the modified field
+ * @param[in] texture - the texture of the field before it was modified
+ * @param[in] changedRays - one item per ray, set to 1 for the modified rays
+ * @return 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_updateTexture(PdpProcessor_t* self, RaveData2D_t* X, RaveData2D_t* texture, const unsigned char* changedRays)
+{
+  unsigned char* rays = NULL;
+  long y, j, hx = 1, hy = 1, ysize = RaveData2D_getYsize(X);
+  int result = 0, changed = 0;
+
+  PdpProcessorInternal_getTextureWindow(self, &hx, &hy);
+  rays = RAVE_MALLOC(sizeof(unsigned char) * ysize);
+  if (rays == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for texture update");
+    return 0;
+  }
+  for (y = 0; y < ysize; y++) {
+    rays[y] = 0;
+    for (j = y - hy; j <= y + hy && !rays[y]; j++) {
+      rays[y] = changedRays[((j % ysize) + ysize) % ysize];
+    }
+    changed |= rays[y];
+  }
+  result = changed ? PdpProcessorInternal_textures(self, 1, &X, &texture, rays) : 1;
+  RAVE_FREE(rays);
+  return result;
+}
 
-          valueTexture = valueTexture + valueWeight * valueCircshiftWeight * (valueCircshiftX - valueX)*(valueCircshiftX - valueX);
-          valueSumWeight = valueSumWeight + valueWeight * valueCircshiftWeight;
-        }
-      }
-      if (valueSumWeight >= 3.0) {
-        if (valueTexture >= 0) {
-          RaveData2D_setValueUnchecked(texture, x, y, sqrt(valueTexture) / valueSumWeight);
-        } else {
-          RaveData2D_setValueUnchecked(texture, x, y, nodata);
-        }
-      } else {
-        RaveData2D_setValueUnchecked(texture, x, y, nodata);
-      }
+int PdpProcessor_textures(PdpProcessor_t* self, long nfields, RaveData2D_t** fields, RaveData2D_t** textures)
+{
+  long f = 0;
+  RAVE_ASSERT((self != NULL), "pdp processor == NULL");
+  if (nfields <= 0 || fields == NULL || textures == NULL) {
+    RAVE_ERROR0("Fields to create textures from must be provided");
+    return 0;
+  }
+  for (f = 0; f < nfields; f++) {
+    textures[f] = NULL;
+  }
+  for (f = 0; f < nfields; f++) {
+    if (fields[f] == NULL) {
+      RAVE_ERROR0("Field to create texture from must be provided");
+      return 0;
+    }
+    if (!RaveData2D_usingNodata(fields[f])) {
+      RAVE_ERROR0("Nodata must be set to create texture");
+      return 0;
     }
   }
+  return PdpProcessorInternal_textures(self, nfields, fields, textures, NULL);
+}
 
-  result = RAVE_OBJECT_COPY(texture);
-done:
-  RAVE_OBJECT_RELEASE(texture);
-  RAVE_OBJECT_RELEASE(weight);
-  RaveData2D_useNodata(X, 1);
+RaveData2D_t* PdpProcessor_texture(PdpProcessor_t* self, RaveData2D_t* X)
+{
+  RaveData2D_t* result = NULL;
+  if (!PdpProcessor_textures(self, 1, &X, &result)) {
+    return NULL;
+  }
   return result;
 }
 
+/**
+ * Trapezoidal membership function, see \ref PdpProcessor_trap.
+ * @param[in] x - the value
+ * @param[in] a - a
+ * @param[in] b - b
+ * @param[in] s - s
+ * @param[in] t - t
+ * @returns the membership degree
+ */
+static double PdpProcessorInternal_trapValue(double x, double a, double b, double s, double t)
+{
+  double out = 0.0;
+  if ((x <= a - s) || (x > b + t)) {
+    out = 0;
+  }
+  if ((x >= a) && (x <= b)) {
+    out = 1;
+  }
+  if ((x > a - s) && (x < a)) {
+    if (s != 0.0) // Just to avoid NaN
+      out = (x - a + s) / s;
+    else
+      out = TRAP_UNDEF_VALUE;
+  }
+  if ((x >= b) && (x < b + t)) {
+    if (t != 0.0)
+      out = (b + t - x) / t;
+    else
+      out = TRAP_UNDEF_VALUE;
+  }
+  return out;
+}
+
+/**
+ * Arguments used by the trap kernel
+ */
+typedef struct PdpProcessorInternal_TrapArgs {
+  RaveData2D_t* xarr; /**< the field */
+  RaveData2D_t* field; /**< the membership result */
+  long xsize; /**< xsize */
+  int usingNodata; /**< if xarr is using nodata */
+  double nodataV; /**< nodata value */
+  double a; /**< a */
+  double b; /**< b */
+  double s; /**< s */
+  double t; /**< t */
+} PdpProcessorInternal_TrapArgs;
+
+/**
+ * Calculates the trapezoidal membership for the provided rays
+ */
+static void PdpProcessorInternal_trapRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_TrapArgs* args = (PdpProcessorInternal_TrapArgs*)arg;
+  long xi, yi;
+
+  for (yi = startray; yi < endray; yi++) {
+    for (xi = 0; xi < args->xsize; xi++) {
+      double x = 0.0;
+      RaveData2D_getValueUnchecked(args->xarr, xi, yi, &x);
+      if (args->usingNodata && x == args->nodataV)  {
+        continue;
+      }
+      RaveData2D_setValueUnchecked(args->field, xi, yi, PdpProcessorInternal_trapValue(x, args->a, args->b, args->s, args->t));
+    }
+  }
+}
+
 RaveData2D_t* PdpProcessor_trap(PdpProcessor_t* self, RaveData2D_t* xarr, double a, double b, double s, double t)
 {
-  long xi, yi, xsize, ysize;
-  int usingNodata = 0;
-  double nodataV = 0.0;
+  long xsize, ysize;
+  PdpProcessorInternal_TrapArgs args;
 
   RaveData2D_t* field = NULL;
 
@@ -885,212 +3010,843 @@ RaveData2D_t* PdpProcessor_trap(PdpProcessor_t* self, RaveData2D_t* xarr, double
   }
   xsize = RaveData2D_getXsize(xarr);
   ysize = RaveData2D_getYsize(xarr);
-  field = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
+  field = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
   if (field == NULL) {
     return NULL;
   }
-  usingNodata = RaveData2D_usingNodata(xarr);
-  nodataV = RaveData2D_getNodata(xarr);
+  args.xarr = xarr;
+  args.field = field;
+  args.xsize = xsize;
+  args.usingNodata = RaveData2D_usingNodata(xarr);
+  args.nodataV = RaveData2D_getNodata(xarr);
+  args.a = a;
+  args.b = b;
+  args.s = s;
+  args.t = t;
+
+  PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_trapRays, &args);
 
-  for (xi = 0; xi < xsize; xi++) {
-    for (yi = 0; yi < ysize; yi++) {
-      double x = 0.0, out = 0.0;
-      RaveData2D_getValueUnchecked(xarr, xi, yi, &x);
-      if (usingNodata && x == nodataV)  {
-        continue;
+  return field;
+}
+
+/**
+ * Creates a membership table for a raw 8 or 16 bit param. The raw values are converted the same way as in
+ * \ref PdpProcessorInternal_getData2DFromParams and stored with the precision of the field so the memberships are
+ * the same as when the trapezoid is evaluated on the converted field.
+ * @param[in] key - the table with everything except the table set
+ * @returns 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_createMembershipTable(PdpProcessorInternal_MembershipTable* key)
+{
+  long n = (key->rawType == RaveDataType_UCHAR) ? 256 : 65536, r;
+  key->table = RAVE_MALLOC(sizeof(double) * n);
+  if (key->table == NULL) {
+    return 0;
+  }
+  for (r = 0; r < n; r++) {
+    double v = 0.0, m = 0.0;
+    if ((double)r == key->nodata) {
+      v = key->fieldNodata;
+    } else if ((double)r == key->undetect) {
+      v = key->undetect*key->gain + key->offset;
+    } else {
+      v = key->offset + (double)r * key->gain;
+    }
+    if (key->fieldType == RaveDataType_FLOAT) {
+      v = (double)(float)v;
+    }
+    if (!key->usingNodata || v != key->fieldNodata) {
+      m = PdpProcessorInternal_trapValue(v, key->a, key->b, key->s, key->t);
+      if (key->roundToFloat) {
+        m = (double)(float)m;
+      }
+    }
+    key->table[r] = m;
+  }
+  return 1;
+}
+
+/**
+ * Frees a membership table.
+ * @param[in] table - the table
+ */
+static void PdpProcessorInternal_freeMembershipTable(PdpProcessorInternal_MembershipTable* table)
+{
+  RAVE_FREE(table->table);
+  RAVE_FREE(table);
+}
+
+/**
+ * Returns the membership table for the param and trapezoid. The tables are cached in the processor so they are
+ * only built when the trapezoid or the conversion of the param changes. When the cache is full the least recently
+ * used table is evicted, it is freed when the last processing using it has released it.
+ * @param[in] self - self
+ * @param[in] param - the raw param, must be RaveDataType_UCHAR or RaveDataType_USHORT
+ * @param[in] field - the field that the param was converted to
+ * @param[in] roundToFloat - if the memberships should be rounded to float precision
+ * @param[in] a - trapezoid a
+ * @param[in] b - trapezoid b
+ * @param[in] s - trapezoid s
+ * @param[in] t - trapezoid t
+ * @returns the table that must be released with \ref PdpProcessorInternal_releaseMembershipTable or NULL on failure
+ */
+static PdpProcessorInternal_MembershipTable* PdpProcessorInternal_getMembershipTable(PdpProcessor_t* self, PolarScanParam_t* param, RaveData2D_t* field,
+    int roundToFloat, double a, double b, double s, double t)
+{
+  PdpProcessorInternal_MembershipTable key, *table = NULL, **ptable = NULL;
+
+  memset(&key, 0, sizeof(PdpProcessorInternal_MembershipTable));
+  key.rawType = PolarScanParam_getDataType(param);
+  key.gain = PolarScanParam_getGain(param);
+  key.offset = PolarScanParam_getOffset(param);
+  key.nodata = PolarScanParam_getNodata(param);
+  key.undetect = PolarScanParam_getUndetect(param);
+  key.fieldType = RaveData2D_getType(field);
+  key.usingNodata = RaveData2D_usingNodata(field);
+  key.fieldNodata = RaveData2D_getNodata(field);
+  key.roundToFloat = roundToFloat;
+  key.a = a;
+  key.b = b;
+  key.s = s;
+  key.t = t;
+
+  pthread_mutex_lock(&self->tableLock);
+  for (ptable = &self->membershipTables; *ptable != NULL; ptable = &(*ptable)->next) {
+    table = *ptable;
+    if (table->rawType == key.rawType && table->gain == key.gain && table->offset == key.offset &&
+        table->nodata == key.nodata && table->undetect == key.undetect && table->fieldType == key.fieldType &&
+        table->usingNodata == key.usingNodata && table->fieldNodata == key.fieldNodata && table->roundToFloat == key.roundToFloat &&
+        table->a == key.a && table->b == key.b && table->s == key.s && table->t == key.t) {
+      *ptable = table->next; /* Moved to the front below */
+      self->nmembershipTables--;
+      break;
+    }
+    table = NULL;
+  }
+  if (table == NULL && PdpProcessorInternal_createMembershipTable(&key)) {
+    table = RAVE_MALLOC(sizeof(PdpProcessorInternal_MembershipTable));
+    if (table != NULL) {
+      *table = key;
+      table->users = 0;
+    } else {
+      RAVE_FREE(key.table);
+    }
+  }
+  if (table != NULL) {
+    table->users++;
+    table->cached = 1;
+    table->next = self->membershipTables;
+    self->membershipTables = table;
+    self->nmembershipTables++;
+    if (self->nmembershipTables > PdpProcessorInternal_MAX_MEMBERSHIP_TABLES) {
+      PdpProcessorInternal_MembershipTable* lru = NULL;
+      for (ptable = &self->membershipTables; (*ptable)->next != NULL; ptable = &(*ptable)->next);
+      lru = *ptable;
+      *ptable = NULL;
+      self->nmembershipTables--;
+      lru->cached = 0;
+      if (lru->users == 0) {
+        PdpProcessorInternal_freeMembershipTable(lru);
+      }
+    }
+  }
+  pthread_mutex_unlock(&self->tableLock);
+
+  return table;
+}
+
+/**
+ * Releases a table returned by \ref PdpProcessorInternal_getMembershipTable.
+ * @param[in] self - self
+ * @param[in] table - the table, may be NULL
+ */
+static void PdpProcessorInternal_releaseMembershipTable(PdpProcessor_t* self, PdpProcessorInternal_MembershipTable* table)
+{
+  int destroy = 0;
+  if (table == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&self->tableLock);
+  table->users--;
+  destroy = (!table->cached && table->users == 0);
+  pthread_mutex_unlock(&self->tableLock);
+  if (destroy) {
+    PdpProcessorInternal_freeMembershipTable(table);
+  }
+}
+
+/**
+ * Looks up the memberships of one ray from the raw data.
+ * @param[in] table - the membership table
+ * @param[in] raw - the raw data, RaveDataType_UCHAR or RaveDataType_USHORT
+ * @param[in] rawType - the type of the raw data
+ * @param[in] mask - pixels where the membership is 0, may be NULL
+ * @param[in] xsize - number of bins
+ * @param[in] y - the ray
+ * @param[out] out - the memberships, xsize values
+ */
+static void PdpProcessorInternal_lookupRay(const double* table, const void* raw, RaveDataType rawType,
+    const unsigned char* mask, long xsize, long y, double* out)
+{
+  long x;
+  if (rawType == RaveDataType_UCHAR) {
+    const unsigned char* row = (const unsigned char*)raw + y * xsize;
+    for (x = 0; x < xsize; x++) {
+      out[x] = table[row[x]];
+    }
+  } else {
+    const unsigned short* row = (const unsigned short*)raw + y * xsize;
+    for (x = 0; x < xsize; x++) {
+      out[x] = table[row[x]];
+    }
+  }
+  if (mask != NULL) {
+    mask += y * xsize;
+    for (x = 0; x < xsize; x++) {
+      if (mask[x]) {
+        out[x] = 0.0;
       }
-      if ((x <= a - s) || (x > b + t)) {
-        out = 0;
+    }
+  }
+}
+
+/**
+ * Arguments used by the fused clutter identification kernel. Only the terms with a weight are kept.
+ */
+typedef struct PdpProcessorInternal_ClutterIDArgs {
+  long xsize; /**< xsize */
+  RaveData2D_t* Z; /**< Z */
+  int nterms; /**< number of terms with a weight */
+  RaveData2D_t* fields[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< the field of each term */
+  int usingNodata[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< if the field of each term is using nodata */
+  double fieldNodata[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< nodata of the field of each term */
+  double weight[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< weight of each term */
+  double a[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< trapezoid a (x2) of each term */
+  double b[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< trapezoid b (x3) of each term */
+  double s[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< trapezoid s (delta1) of each term */
+  double t[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< trapezoid t (delta2) of each term */
+  const double* tables[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< membership table of each term, NULL if the membership is evaluated on the field */
+  const void* raw[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< raw data that the table of each term is indexed with */
+  RaveDataType rawType[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< type of the raw data of each term */
+  const unsigned char* mask[PdpProcessorInternal_CLUTTER_ID_TERMS]; /**< pixels where the membership of each term is 0, may be NULL */
+  double sumWeight; /**< sum of all weights */
+  double nodataZ; /**< nodata for Z */
+  int roundToFloat; /**< if the memberships and results should be rounded to float precision */
+  RaveData2D_t* degree; /**< the resulting degree, may be NULL */
+  RaveData2D_t* quality; /**< the resulting quality (1 - degree), may be NULL */
+  RaveData2D_t* Z2; /**< the corrected Z, may be NULL */
+  RaveData2D_t* clutterMask; /**< the clutter mask, may be NULL */
+  double minDBZ; /**< min DBZ for the clutter mask */
+  double qualityThreshold; /**< the quality threshold for the clutter mask */
+  int failed; /**< set to 1 if a kernel failed to allocate memory */
+} PdpProcessorInternal_ClutterIDArgs;
+
+/**
+ * Calculates the clutter degree for the provided rays. The memberships are evaluated inline and combined directly
+ * into the degree, the quality and the clutter mask without any intermediate fields. The memberships are rounded to
+ * the processing precision so the result is the same as when the membership fields were created with \ref PdpProcessor_trap.
+ * Terms with a membership table are looked up from the raw data instead.
+ */
+static void PdpProcessorInternal_clutterIDRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_ClutterIDArgs* args = (PdpProcessorInternal_ClutterIDArgs*)arg;
+  long xsize = args->xsize, x, y;
+  int k, nterms = args->nterms;
+  double *zrow = NULL, *degreeRow = NULL, *qualityRow = NULL, *rows[PdpProcessorInternal_CLUTTER_ID_TERMS];
+
+  zrow = RAVE_MALLOC(sizeof(double) * xsize * (3 + nterms));
+  if (zrow == NULL) {
+    args->failed = 1;
+    return;
+  }
+  degreeRow = zrow + xsize;
+  qualityRow = degreeRow + xsize;
+  for (k = 0; k < nterms; k++) {
+    rows[k] = qualityRow + (k + 1) * xsize;
+  }
+
+  for (y = startray; y < endray; y++) {
+    PdpProcessorInternal_getRay(args->Z, y, zrow);
+    for (k = 0; k < nterms; k++) {
+      if (args->tables[k] != NULL) {
+        PdpProcessorInternal_lookupRay(args->tables[k], args->raw[k], args->rawType[k], args->mask[k], xsize, y, rows[k]);
+      } else {
+        PdpProcessorInternal_getRay(args->fields[k], y, rows[k]);
       }
-      if ((x >= a) && (x <= b)) {
-        out = 1;
+    }
+    for (x = 0; x < xsize; x++) {
+      double vDegree = 0.0, vQuality = 0.0;
+      if (zrow[x] != args->nodataZ) {
+        for (k = 0; k < nterms; k++) {
+          double v = rows[k][x], m = 0.0;
+          if (args->tables[k] != NULL) {
+            m = v;
+          } else if (!args->usingNodata[k] || v != args->fieldNodata[k]) {
+            m = PdpProcessorInternal_trapValue(v, args->a[k], args->b[k], args->s[k], args->t[k]);
+            if (args->roundToFloat) {
+              m = (double)(float)m;
+            }
+          }
+          vDegree += args->weight[k] * m;
+        }
+        vDegree /= args->sumWeight;
       }
-      if ((x > a - s) && (x < a)) {
-        if (s != 0.0) // Just to avoid NaN
-          out = (x - a + s) / s;
-        else
-          out = TRAP_UNDEF_VALUE;
+      if (args->roundToFloat) {
+        vDegree = (double)(float)vDegree;
+        vQuality = (double)(float)(1.0 - vDegree);
+      } else {
+        vQuality = 1.0 - vDegree;
       }
-      if ((x >= b) && (x < b + t)) {
-        if (t != 0.0)
-          out = (b + t - x) / t;
-        else
-          out = TRAP_UNDEF_VALUE;
+      degreeRow[x] = vDegree;
+      qualityRow[x] = vQuality;
+      if (zrow[x] >= args->minDBZ && zrow[x] != args->nodataZ && vQuality < args->qualityThreshold) {
+        if (args->Z2 != NULL) {
+          RaveData2D_setValueUnchecked(args->Z2, x, y, args->nodataZ);
+        }
+        if (args->clutterMask != NULL) {
+          RaveData2D_setValueUnchecked(args->clutterMask, x, y, 1.0);
+        }
       }
-      RaveData2D_setValueUnchecked(field, xi, yi, out);
+    }
+    if (args->degree != NULL) {
+      PdpProcessorInternal_setRay(args->degree, y, degreeRow);
+    }
+    if (args->quality != NULL) {
+      PdpProcessorInternal_setRay(args->quality, y, qualityRow);
     }
   }
+  RAVE_FREE(zrow);
+}
 
-  return field;
+/**
+ * Runs the fused clutter identification. Any of the outputs can be NULL if it isn't needed.
+ * @param[in] self - self
+ * @param[in] Z - Z
+ * @param[in] VRADH - VRADH
+ * @param[in] texturePHIDP - the PHIDP texture
+ * @param[in] RHOHV - RHOHV
+ * @param[in] textureZ - the Z texture
+ * @param[in] clutterMap - the clutter map
+ * @param[in] nodataZ - nodata for Z
+ * @param[in] qualityThreshold - quality threshold for the clutter mask
+ * @param[out] outDegree - the clutter degree
+ * @param[out] outZ - Z with the clutter removed
+ * @param[out] outQuality - the quality (1 - degree)
+ * @param[out] outClutterMask - the clutter mask
+ * @returns 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_clutterID(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* VRADH,
+    RaveData2D_t* texturePHIDP, RaveData2D_t* RHOHV, RaveData2D_t* textureZ, RaveData2D_t* clutterMap,
+    double nodataZ, double qualityThreshold, PdpProcessorInternal_RawSource* sources,
+    RaveData2D_t** outDegree, RaveData2D_t** outZ, RaveData2D_t** outQuality, RaveData2D_t** outClutterMask)
+{
+  long xsize = 0, ysize = 0;
+  int result = 0, k = 0, n = 0;
+  RaveData2D_t *degree = NULL, *Z2 = NULL, *quality = NULL, *clutterMask = NULL;
+  RaveData2D_t* fields[PdpProcessorInternal_CLUTTER_ID_TERMS];
+  double weight[PdpProcessorInternal_CLUTTER_ID_TERMS], a[PdpProcessorInternal_CLUTTER_ID_TERMS], b[PdpProcessorInternal_CLUTTER_ID_TERMS];
+  double s[PdpProcessorInternal_CLUTTER_ID_TERMS], t[PdpProcessorInternal_CLUTTER_ID_TERMS];
+  PdpProcessorInternal_MembershipTable* usedTables[PdpProcessorInternal_CLUTTER_ID_TERMS];
+  PdpProcessorInternal_ClutterIDArgs args;
+
+  if (Z == NULL || VRADH == NULL || texturePHIDP == NULL || RHOHV == NULL || textureZ == NULL || clutterMap == NULL) {
+    RAVE_ERROR0("Z, VRADH, texturePHIDP, RHOHV, textureZ and clutterMap must be NON NULL");
+    return 0;
+  }
+
+  fields[0] = Z;
+  fields[1] = VRADH;
+  fields[2] = texturePHIDP;
+  fields[3] = RHOHV;
+  fields[4] = textureZ;
+  fields[5] = clutterMap;
+  PpcRadarOptions_getParametersUZ(self->options, &weight[0], &a[0], &b[0], &s[0], &t[0]);
+  PpcRadarOptions_getParametersVEL(self->options, &weight[1], &a[1], &b[1], &s[1], &t[1]);
+  PpcRadarOptions_getParametersTEXT_PHIDP(self->options, &weight[2], &a[2], &b[2], &s[2], &t[2]);
+  PpcRadarOptions_getParametersRHV(self->options, &weight[3], &a[3], &b[3], &s[3], &t[3]);
+  PpcRadarOptions_getParametersTEXT_UZ(self->options, &weight[4], &a[4], &b[4], &s[4], &t[4]);
+  PpcRadarOptions_getParametersCLUTTER_MAP(self->options, &weight[5], &a[5], &b[5], &s[5], &t[5]);
+
+  memset(&args, 0, sizeof(PdpProcessorInternal_ClutterIDArgs));
+  memset(usedTables, 0, sizeof(usedTables));
+  for (k = 0; k < PdpProcessorInternal_CLUTTER_ID_TERMS; k++) {
+    args.sumWeight += weight[k];
+    /* Terms without weight doesn't contribute to the degree */
+    if (weight[k] != 0.0) {
+      args.fields[n] = fields[k];
+      args.usingNodata[n] = RaveData2D_usingNodata(fields[k]);
+      args.fieldNodata[n] = RaveData2D_getNodata(fields[k]);
+      args.weight[n] = weight[k];
+      args.a[n] = a[k];
+      args.b[n] = b[k];
+      args.s[n] = s[k];
+      args.t[n] = t[k];
+      n++;
+    }
+  }
+  args.nterms = n;
+
+  if (args.sumWeight == 0.0) {
+    RAVE_ERROR0("Sum of parameter weights == 0.0");
+    return 0;
+  }
+
+  xsize = RaveData2D_getXsize(Z);
+  ysize = RaveData2D_getYsize(Z);
+  for (k = 1; k < PdpProcessorInternal_CLUTTER_ID_TERMS; k++) {
+    if (RaveData2D_getXsize(fields[k]) != xsize || RaveData2D_getYsize(fields[k]) != ysize) {
+      RAVE_ERROR0("All fields must have the same geometry when identifying clutter");
+      return 0;
+    }
+  }
+
+  args.roundToFloat = (PdpProcessorInternal_getDataType(self) == RaveDataType_FLOAT);
+
+  /* Memberships of 8 and 16 bit params are looked up from the raw data, other terms are evaluated on the field */
+  if (sources != NULL) {
+    for (k = 0, n = 0; k < PdpProcessorInternal_CLUTTER_ID_TERMS; k++) {
+      PolarScanParam_t* param = sources[k].param;
+      if (weight[k] == 0.0) {
+        continue;
+      }
+      if (param != NULL && PolarScanParam_getNbins(param) == xsize && PolarScanParam_getNrays(param) == ysize &&
+          (PolarScanParam_getDataType(param) == RaveDataType_UCHAR || PolarScanParam_getDataType(param) == RaveDataType_USHORT)) {
+        usedTables[k] = PdpProcessorInternal_getMembershipTable(self, param, fields[k], args.roundToFloat,
+            a[k], b[k], s[k], t[k]);
+        args.tables[n] = (usedTables[k] != NULL) ? usedTables[k]->table : NULL;
+        args.raw[n] = PolarScanParam_getData(param);
+        args.rawType[n] = PolarScanParam_getDataType(param);
+        args.mask[n] = sources[k].mask;
+        if (args.tables[n] == NULL || args.raw[n] == NULL) {
+          args.tables[n] = NULL; /* Falls back on evaluating the trapezoid on the field */
+        }
+      }
+      n++;
+    }
+  }
+
+  if (outDegree != NULL) {
+    degree = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
+    if (degree == NULL) goto done;
+  }
+  if (outQuality != NULL) {
+    quality = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
+    if (quality == NULL) goto done;
+  }
+  if (outZ != NULL) {
+    Z2 = RAVE_OBJECT_CLONE(Z);
+    if (Z2 == NULL) goto done;
+  }
+  if (outClutterMask != NULL) {
+    clutterMask = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
+    if (clutterMask == NULL) goto done;
+  }
+
+  args.xsize = xsize;
+  args.Z = Z;
+  args.nodataZ = nodataZ;
+  args.degree = degree;
+  args.quality = quality;
+  args.Z2 = Z2;
+  args.clutterMask = clutterMask;
+  args.minDBZ = PpcRadarOptions_getMinDBZ(self->options);
+  args.qualityThreshold = qualityThreshold;
+
+  PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_clutterIDRays, &args);
+  if (args.failed) {
+    RAVE_ERROR0("Failed to allocate memory when identifying clutter");
+    goto done;
+  }
+
+  if (outDegree != NULL) *outDegree = RAVE_OBJECT_COPY(degree);
+  if (outQuality != NULL) *outQuality = RAVE_OBJECT_COPY(quality);
+  if (outZ != NULL) *outZ = RAVE_OBJECT_COPY(Z2);
+  if (outClutterMask != NULL) *outClutterMask = RAVE_OBJECT_COPY(clutterMask);
+
+  result = 1;
+done:
+  PdpProcessorInternal_recycle(self, &degree);
+  PdpProcessorInternal_recycle(self, &quality);
+  PdpProcessorInternal_recycle(self, &Z2);
+  PdpProcessorInternal_recycle(self, &clutterMask);
+  for (k = 0; k < PdpProcessorInternal_CLUTTER_ID_TERMS; k++) {
+    PdpProcessorInternal_releaseMembershipTable(self, usedTables[k]);
+  }
+  return result;
 }
 
 RaveData2D_t* PdpProcessor_clutterID(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* VRADH,
     RaveData2D_t* texturePHIDP, RaveData2D_t* RHOHV, RaveData2D_t* textureZ, RaveData2D_t* clutterMap, double nodataZ, double nodataVRADH)
 {
-  long xsize = 0, ysize = 0;
-  long x, y;
+  RaveData2D_t* degree = NULL;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  /* The degree only depends on if Z is nodata, nodataVRADH is handled by the membership of VRADH */
+  if (!PdpProcessorInternal_clutterID(self, Z, VRADH, texturePHIDP, RHOHV, textureZ, clutterMap, nodataZ, 0.0, NULL,
+      &degree, NULL, NULL, NULL)) {
+    return NULL;
+  }
+  return degree;
+}
+
+int PdpProcessor_clutterCorrection(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* VRADH,
+    RaveData2D_t* texturePHIDP, RaveData2D_t* RHOHV, RaveData2D_t* textureZ, RaveData2D_t* clutterMap,
+    double nodataZ, double nodataVRADH, double qualityThreshold,
+    RaveData2D_t** outZ, RaveData2D_t** outQuality, RaveData2D_t** outClutterMask)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
 
-  double uzWeight, uzX2, uzX3, uzDelta1, uzDelta2;
-  double velWeight, velX2, velX3, velDelta1, velDelta2;
-  double textPhidpWeight, textPhidpX2, textPhidpX3, textPhidpDelta1, textPhidpDelta2;
-  double rhvWeight, rhvX2, rhvX3, rhvDelta1, rhvDelta2;
-  double textUzWeight, textUzX2, textUzX3, textUzDelta1, textUzDelta2;
-  double clutterMapWeight, clutterMapX2, clutterMapX3, clutterMapDelta1, clutterMapDelta2;
+  if (outZ == NULL || outQuality == NULL || outClutterMask == NULL) {
+    RAVE_ERROR0("All ravedata2d fields, both in and out must be != NULL");
+    return 0;
+  }
+  if (!PdpProcessorInternal_clutterID(self, Z, VRADH, texturePHIDP, RHOHV, textureZ, clutterMap, nodataZ, qualityThreshold, NULL,
+      NULL, outZ, outQuality, outClutterMask)) {
+    RAVE_ERROR0("Failed to process clutterID");
+    return 0;
+  }
+  return 1;
+}
 
+/**
+ * Arguments used by the binary median filter kernel
+ */
+typedef struct PdpProcessorInternal_BinaryMedfiltArgs {
+  const unsigned char* mask; /**< the mask, 0 or 1 for each pixel */
+  RaveData2D_t* filtmask; /**< the filtered mask */
+  long xsize; /**< xsize */
+  long ysize; /**< ysize */
+  long filtXsize; /**< window size in x, odd */
+  long filtYsize; /**< window size in y, odd */
+  int failed; /**< set if memory could not be allocated */
+} PdpProcessorInternal_BinaryMedfiltArgs;
 
-  //double sumWeight = self->parUZ[0] + self->parVel[0] + self->parTextPHIDP[0] + self->parRHV[0] + self->parTextUZ[0] + self->parClutterMap[0];
-  double sumWeight;
+/**
+ * Median filters a 0/1 mask for the provided rays. The median of a window with an odd number of 0/1 values is 1 if
+ * more than half of the values are 1, so only the number of ones in the window is needed. The number of ones in each
+ * column of the window is kept and updated when moving to the next ray and the columns are summed with a sliding window
+ * along the ray, which gives the same cost per pixel regardless of the window size. Pixels outside the field are 0
+ * in the same way as in RaveData2D_medfilt2.
+ */
+static void PdpProcessorInternal_binaryMedfiltRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_BinaryMedfiltArgs* args = (PdpProcessorInternal_BinaryMedfiltArgs*)arg;
+  long xsize = args->xsize, ysize = args->ysize;
+  long rx = args->filtXsize / 2, ry = args->filtYsize / 2;
+  long half = (args->filtXsize * args->filtYsize) / 2;
+  long *columns = NULL, x, y, wy, count;
+  double* row = NULL;
+
+  columns = RAVE_MALLOC(sizeof(long) * xsize);
+  row = RAVE_MALLOC(sizeof(double) * xsize);
+  if (columns == NULL || row == NULL) {
+    args->failed = 1;
+    goto done;
+  }
+  memset(columns, 0, sizeof(long) * xsize);
+  for (wy = startray - ry - 1; wy < startray + ry; wy++) {
+    if (wy >= 0 && wy < ysize) {
+      const unsigned char* m = args->mask + wy * xsize;
+      for (x = 0; x < xsize; x++) columns[x] += m[x];
+    }
+  }
+  for (y = startray; y < endray; y++) {
+    if (y + ry < ysize) {
+      const unsigned char* m = args->mask + (y + ry) * xsize;
+      for (x = 0; x < xsize; x++) columns[x] += m[x];
+    }
+    if (y - ry - 1 >= 0) {
+      const unsigned char* m = args->mask + (y - ry - 1) * xsize;
+      for (x = 0; x < xsize; x++) columns[x] -= m[x];
+    }
+    count = 0;
+    for (x = 0; x < rx && x < xsize; x++) {
+      count += columns[x];
+    }
+    for (x = 0; x < xsize; x++) {
+      if (x + rx < xsize) {
+        count += columns[x + rx];
+      }
+      if (x - rx - 1 >= 0) {
+        count -= columns[x - rx - 1];
+      }
+      row[x] = (count > half) ? 1.0 : 0.0;
+    }
+    PdpProcessorInternal_setRay(args->filtmask, y, row);
+  }
+done:
+  RAVE_FREE(columns);
+  RAVE_FREE(row);
+}
 
-  RaveData2D_t* degree = NULL;
+/**
+ * Median filters a 0/1 mask with an odd window size. Gives the same result as RaveData2D_medfilt2 on the mask.
+ * @param[in] self - self
+ * @param[in] mask - the mask, 0 or 1 for each pixel
+ * @param[in] xsize - xsize
+ * @param[in] ysize - ysize
+ * @param[in] filtXsize - window size in x, must be odd
+ * @param[in] filtYsize - window size in y, must be odd
+ * @returns the filtered mask on success otherwise NULL
+ */
+static RaveData2D_t* PdpProcessorInternal_binaryMedfilt(PdpProcessor_t* self, const unsigned char* mask, long xsize, long ysize,
+    long filtXsize, long filtYsize)
+{
+  PdpProcessorInternal_BinaryMedfiltArgs args;
   RaveData2D_t* result = NULL;
-  RaveData2D_t *mbf_Z = NULL, *mbf_VRADH = NULL, *mbf_texturePHIDP = NULL;
-  RaveData2D_t *mbf_RHOHV = NULL, *mbf_textureZ = NULL, *mbf_clutterMap = NULL;
 
-  RAVE_ASSERT((self != NULL), "self == NULL");
+  memset(&args, 0, sizeof(PdpProcessorInternal_BinaryMedfiltArgs));
+  args.filtmask = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
+  if (args.filtmask == NULL) {
+    goto done;
+  }
+  args.mask = mask;
+  args.xsize = xsize;
+  args.ysize = ysize;
+  args.filtXsize = filtXsize;
+  args.filtYsize = filtYsize;
+  PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_binaryMedfiltRays, &args);
+  if (args.failed) {
+    RAVE_ERROR0("Failed to allocate memory for median filter");
+    goto done;
+  }
+  result = RAVE_OBJECT_COPY(args.filtmask);
+done:
+  PdpProcessorInternal_recycle(self, &args.filtmask);
+  return result;
+}
 
-  PpcRadarOptions_getParametersUZ(self->options, &uzWeight, &uzX2, &uzX3, &uzDelta1, &uzDelta2);
-  PpcRadarOptions_getParametersVEL(self->options, &velWeight, &velX2, &velX3, &velDelta1, &velDelta2);
-  PpcRadarOptions_getParametersTEXT_PHIDP(self->options, &textPhidpWeight, &textPhidpX2, &textPhidpX3, &textPhidpDelta1, &textPhidpDelta2);
-  PpcRadarOptions_getParametersRHV(self->options, &rhvWeight, &rhvX2, &rhvX3, &rhvDelta1, &rhvDelta2);
-  PpcRadarOptions_getParametersTEXT_UZ(self->options, &textUzWeight, &textUzX2, &textUzX3, &textUzDelta1, &textUzDelta2);
-  PpcRadarOptions_getParametersCLUTTER_MAP(self->options, &clutterMapWeight, &clutterMapX2, &clutterMapX3, &clutterMapDelta1, &clutterMapDelta2);
+/**
+ * Key of pixels that are left out of the median filter window, also the median of an empty window
+ */
+#define PdpProcessorInternal_EXCLUDED_KEY 0xFFFFFFFFU
 
-  sumWeight = uzWeight + velWeight + textPhidpWeight + rhvWeight + textUzWeight + clutterMapWeight;
+/**
+ * Max number of keys for which the fine column histograms are kept, with more keys the fine counts of a column are
+ * counted from the pixels of the column when needed
+ */
+#define PdpProcessorInternal_MAX_DENSE_KEYS 4096
 
-  if (sumWeight == 0.0) {
-    RAVE_ERROR0("Sum of parameter weights == 0.0");
-    return NULL;
-  }
+/**
+ * Arguments used by the histogram median kernel
+ */
+typedef struct PdpProcessorInternal_HistogramMedianArgs {
+  const unsigned int* keys; /**< the keys, xsize * ysize */
+  unsigned int* out; /**< the median keys, xsize * ysize */
+  long xsize; /**< xsize */
+  long ysize; /**< ysize */
+  long filtXsize; /**< window size in x, odd */
+  long filtYsize; /**< window size in y, odd */
+  long nkeys; /**< number of keys, the keys are < nkeys */
+  long padKey; /**< key of the pixels outside the field, -1 if they are left out of the window */
+  int wrap; /**< if the rays wrap around as they do in azimuth */
+  int failed; /**< set if memory could not be allocated */
+} PdpProcessorInternal_HistogramMedianArgs;
 
-  if (Z == NULL || VRADH == NULL || texturePHIDP == NULL || RHOHV == NULL || textureZ == NULL || clutterMap == NULL) {
-    RAVE_ERROR0("Z, VRADH, texturePHIDP, RHOHV, textureZ and clutterMap must be NON NULL");
-    return NULL;
-  }
-  xsize = RaveData2D_getXsize(Z);
-  ysize = RaveData2D_getYsize(Z);
-  degree = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
-  if (degree == NULL) {
-    return NULL;
+/**
+ * Returns the key of a pixel, pixels outside the field get the pad key unless the rays wrap around.
+ * @param[in] args - the arguments
+ * @param[in] x - the bin
+ * @param[in] y - the ray
+ * @returns the key or PdpProcessorInternal_EXCLUDED_KEY
+ */
+static unsigned int PdpProcessorInternal_histogramMedianKey(PdpProcessorInternal_HistogramMedianArgs* args, long x, long y)
+{
+  if (args->wrap) {
+    y = ((y % args->ysize) + args->ysize) % args->ysize;
   }
-  mbf_Z = PdpProcessor_trap(self, Z, uzX2, uzX3, uzDelta1, uzDelta2);
-  mbf_VRADH = PdpProcessor_trap(self, VRADH, velX2, velX3, velDelta1, velDelta2);
-  mbf_texturePHIDP = PdpProcessor_trap(self, texturePHIDP, textPhidpX2, textPhidpX3, textPhidpDelta1, textPhidpDelta2);
-  mbf_RHOHV = PdpProcessor_trap(self, RHOHV, rhvX2, rhvX3, rhvDelta1, rhvDelta2);
-  mbf_textureZ = PdpProcessor_trap(self, textureZ, textUzX2, textUzX3, textUzDelta1, textUzDelta2);
-  mbf_clutterMap = PdpProcessor_trap(self, clutterMap, clutterMapX2, clutterMapX3, clutterMapDelta1, clutterMapDelta2);
-  if (mbf_Z == NULL || mbf_VRADH == NULL || mbf_texturePHIDP == NULL ||
-      mbf_RHOHV == NULL || mbf_textureZ == NULL || mbf_clutterMap == NULL) {
-    RAVE_ERROR0("Failed to create trap matrices");
-    goto done;
+  if (x >= 0 && x < args->xsize && y >= 0 && y < args->ysize) {
+    return args->keys[y * args->xsize + x];
   }
+  return (args->padKey < 0) ? PdpProcessorInternal_EXCLUDED_KEY : (unsigned int)args->padKey;
+}
 
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
-      double vDegree = 0.0;
-      double vZ=0.0, vVRADH=0.0, vTexturePHIDP=0.0, vRHOHV=0.0, vTextureZ=0.0, vClutterMap=0.0;
-      double inZ = 0.0, inVRADH = 0.0;
-      RaveData2D_getValueUnchecked(Z, x, y, &inZ);
-      RaveData2D_getValueUnchecked(VRADH, x, y, &inVRADH);
-
-      RaveData2D_getValueUnchecked(mbf_Z, x, y, &vZ);
-      RaveData2D_getValueUnchecked(mbf_VRADH, x, y, &vVRADH);
-      RaveData2D_getValueUnchecked(mbf_texturePHIDP, x, y, &vTexturePHIDP);
-      RaveData2D_getValueUnchecked(mbf_RHOHV, x, y, &vRHOHV);
-      RaveData2D_getValueUnchecked(mbf_textureZ, x, y, &vTextureZ);
-      RaveData2D_getValueUnchecked(mbf_clutterMap, x, y, &vClutterMap);
+/**
+ * Adds or removes one ray from the column histograms.
+ * @param[in] args - the arguments
+ * @param[in] y - the ray
+ * @param[in] sign - 1 to add the ray, -1 to remove it
+ * @param[in] nfine - number of keys in each coarse bin
+ * @param[in] coarse - the coarse column histograms
+ * @param[in] fine - the fine column histograms, NULL if they aren't kept
+ */
+static void PdpProcessorInternal_histogramMedianRay(PdpProcessorInternal_HistogramMedianArgs* args, long y, int sign, long nfine,
+    unsigned short* coarse, unsigned short* fine)
+{
+  long rx = args->filtXsize / 2, ncoarse = (args->nkeys + nfine - 1) / nfine, x;
+  for (x = -rx; x < args->xsize + rx; x++) {
+    unsigned int key = PdpProcessorInternal_histogramMedianKey(args, x, y);
+    if (key == PdpProcessorInternal_EXCLUDED_KEY) {
+      continue;
+    }
+    coarse[(x + rx) * ncoarse + key / nfine] += sign;
+    if (fine != NULL) {
+      fine[(x + rx) * args->nkeys + key] += sign;
+    }
+  }
+}
 
-      if (inVRADH != nodataVRADH && inZ != nodataZ) {
-        vDegree = uzWeight * vZ + velWeight * vVRADH + textPhidpWeight * vTexturePHIDP +
-            rhvWeight * vRHOHV + textUzWeight * vTextureZ + clutterMapWeight * vClutterMap;
-        vDegree /= sumWeight;
-      }
-      if (inVRADH == nodataVRADH && inZ != nodataZ) {
-        vDegree = uzWeight * vZ + velWeight * vVRADH + textPhidpWeight * vTexturePHIDP +
-            rhvWeight * vRHOHV + textUzWeight * vTextureZ + clutterMapWeight * vClutterMap;
-        vDegree /= sumWeight;
+/**
+ * Adds or removes the fine counts of one coarse bin for a column of the window to the fine kernel histogram.
+ * @param[in] args - the arguments
+ * @param[in] y - the ray at the center of the window
+ * @param[in] c - the column, 0 is the first column of the window at bin 0
+ * @param[in] b - the coarse bin
+ * @param[in] sign - 1 to add the column, -1 to remove it
+ * @param[in] nfine - number of keys in each coarse bin
+ * @param[in] fine - the fine column histograms, NULL if the counts should be taken from the pixels of the column
+ * @param[in,out] kfine - the fine kernel histogram
+ */
+static void PdpProcessorInternal_histogramMedianColumn(PdpProcessorInternal_HistogramMedianArgs* args, long y, long c, long b, int sign,
+    long nfine, const unsigned short* fine, long* kfine)
+{
+  long ry = args->filtYsize / 2, k, end = (b + 1) * nfine;
+  end = (end > args->nkeys) ? args->nkeys : end;
+  if (fine != NULL) {
+    const unsigned short* f = fine + c * args->nkeys;
+    for (k = b * nfine; k < end; k++) kfine[k] += sign * (long)f[k];
+  } else {
+    for (k = y - ry; k <= y + ry; k++) {
+      unsigned int key = PdpProcessorInternal_histogramMedianKey(args, c - args->filtXsize / 2, k);
+      if (key != PdpProcessorInternal_EXCLUDED_KEY && (long)key >= b * nfine && (long)key < end) {
+        kfine[key] += sign;
       }
-      RaveData2D_setValueUnchecked(degree, x, y, vDegree);
     }
   }
-
-  result = RAVE_OBJECT_COPY(degree);
-done:
-  RAVE_OBJECT_RELEASE(mbf_Z);
-  RAVE_OBJECT_RELEASE(mbf_VRADH);
-  RAVE_OBJECT_RELEASE(mbf_texturePHIDP);
-  RAVE_OBJECT_RELEASE(mbf_RHOHV);
-  RAVE_OBJECT_RELEASE(mbf_textureZ);
-  RAVE_OBJECT_RELEASE(mbf_clutterMap);
-  RAVE_OBJECT_RELEASE(degree);
-  return result;
 }
 
-int PdpProcessor_clutterCorrection(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* VRADH,
-    RaveData2D_t* texturePHIDP, RaveData2D_t* RHOHV, RaveData2D_t* textureZ, RaveData2D_t* clutterMap,
-    double nodataZ, double nodataVRADH, double qualityThreshold,
-    RaveData2D_t** outZ, RaveData2D_t** outQuality, RaveData2D_t** outClutterMask)
+/**
+ * Median filters keys for the provided rays with sliding histograms (Perreault & Hebert). A coarse and a fine
+ * histogram is kept for each column of the window and updated when moving to the next ray. Along the ray the coarse
+ * kernel histogram is updated for each bin while the fine kernel histogram of a coarse bin only is brought up to
+ * date when the median falls in it, so the cost per pixel is close to constant regardless of the window size.
+ * The keys are split in coarse and fine levels of about the square root of the number of keys each. With more keys
+ * than PdpProcessorInternal_MAX_DENSE_KEYS the fine column histograms would take too much memory, the fine counts of
+ * a column are then counted from its pixels, which costs the window height for each column the median bin moves.
+ * The median is the middle key, or the upper of the two middle keys, of the sorted keys in the window that
+ * aren't left out. With a pad key the window is always full and the median is the same as in RaveData2D_medfilt2.
+ */
+static void PdpProcessorInternal_histogramMedianRays(void* arg, long startray, long endray)
 {
-  long xsize = 0, ysize = 0;
-  long x, y;
-  int result = 0;
-  RaveData2D_t* degree = NULL;
-  RaveData2D_t* tmp = NULL;
-  RaveData2D_t *Z2 = NULL, *quality = NULL, *clutterMask = NULL;
-  double minDBZ;
-
-  RAVE_ASSERT((self != NULL), "self == NULL");
-
-  if (Z == NULL || VRADH==NULL || texturePHIDP == NULL || RHOHV == NULL ||
-      textureZ == NULL || clutterMap == NULL || outZ == NULL || outQuality == NULL || outClutterMask == NULL) {
-    RAVE_ERROR0("All ravedata2d fields, both in and out must be != NULL");
-    goto done;
+  PdpProcessorInternal_HistogramMedianArgs* args = (PdpProcessorInternal_HistogramMedianArgs*)arg;
+  long xsize = args->xsize, rx = args->filtXsize / 2, ry = args->filtYsize / 2, ncolumns = args->xsize + 2 * rx;
+  long nfine = 1, ncoarse = 0, x, y, c, b, k, sum, total, rank;
+  long *kcoarse = NULL, *kfine = NULL, *updated = NULL;
+  unsigned short *coarse = NULL, *fine = NULL;
+
+  while (nfine * nfine < args->nkeys) {
+    nfine++;
   }
-  xsize = RaveData2D_getXsize(Z);
-  ysize = RaveData2D_getYsize(Z);
-
-  degree = PdpProcessor_clutterID(self, Z, VRADH, texturePHIDP, RHOHV, textureZ, clutterMap, nodataZ, nodataVRADH);
-  if (degree == NULL) {
-    RAVE_ERROR0("Failed to process clutterID");
+  ncoarse = (args->nkeys + nfine - 1) / nfine;
+  coarse = RAVE_MALLOC(sizeof(unsigned short) * ncolumns * ncoarse);
+  kcoarse = RAVE_MALLOC(sizeof(long) * ncoarse);
+  updated = RAVE_MALLOC(sizeof(long) * ncoarse);
+  kfine = RAVE_MALLOC(sizeof(long) * args->nkeys);
+  if (coarse == NULL || kcoarse == NULL || updated == NULL || kfine == NULL) {
+    args->failed = 1;
     goto done;
   }
-
-  Z2 = RAVE_OBJECT_CLONE(Z);
-  clutterMask = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
-  tmp = RaveData2D_ones(xsize, ysize, RaveDataType_DOUBLE);
-  if (Z2 == NULL || clutterMask == NULL || tmp == NULL) {
-    goto done;
+  if (args->nkeys <= PdpProcessorInternal_MAX_DENSE_KEYS) {
+    fine = RAVE_MALLOC(sizeof(unsigned short) * ncolumns * args->nkeys);
+    if (fine == NULL) {
+      args->failed = 1;
+      goto done;
+    }
+    memset(fine, 0, sizeof(unsigned short) * ncolumns * args->nkeys);
   }
-  quality = RaveData2D_sub(tmp, degree);
-  if (quality == NULL) {
-    goto done;
+  memset(coarse, 0, sizeof(unsigned short) * ncolumns * ncoarse);
+  for (y = startray - ry - 1; y < startray + ry; y++) {
+    PdpProcessorInternal_histogramMedianRay(args, y, 1, nfine, coarse, fine);
   }
-  minDBZ = PpcRadarOptions_getMinDBZ(self->options);
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
-      double vZ = 0.0, vQ = 0.0;
-      RaveData2D_getValueUnchecked(Z, x, y, &vZ);
-      RaveData2D_getValueUnchecked(quality, x, y, &vQ);
-      if (vZ >= minDBZ && vZ != nodataZ && vQ < qualityThreshold) {
-        RaveData2D_setValueUnchecked(Z2, x, y, nodataZ);
-        RaveData2D_setValueUnchecked(clutterMask, x, y, 1.0);
+
+  for (y = startray; y < endray; y++) {
+    PdpProcessorInternal_histogramMedianRay(args, y + ry, 1, nfine, coarse, fine);
+    PdpProcessorInternal_histogramMedianRay(args, y - ry - 1, -1, nfine, coarse, fine);
+
+    memset(kcoarse, 0, sizeof(long) * ncoarse);
+    for (c = 0; c < 2 * rx; c++) {
+      for (b = 0; b < ncoarse; b++) kcoarse[b] += coarse[c * ncoarse + b];
+    }
+    for (b = 0; b < ncoarse; b++) {
+      updated[b] = -1;
+    }
+
+    for (x = 0; x < xsize; x++) {
+      const unsigned short* cadd = coarse + (x + 2 * rx) * ncoarse;
+      for (b = 0; b < ncoarse; b++) kcoarse[b] += cadd[b];
+      if (x > 0) {
+        const unsigned short* csub = coarse + (x - 1) * ncoarse;
+        for (b = 0; b < ncoarse; b++) kcoarse[b] -= csub[b];
+      }
+
+      total = 0;
+      for (b = 0; b < ncoarse; b++) total += kcoarse[b];
+      if (total == 0) {
+        args->out[y * xsize + x] = PdpProcessorInternal_EXCLUDED_KEY;
+        continue;
+      }
+      rank = total / 2;
+
+      sum = 0;
+      for (b = 0; sum + kcoarse[b] <= rank; b++) {
+        sum += kcoarse[b];
+      }
+
+      /* Bring the fine histogram of the coarse bin up to date with the window at x */
+      if (updated[b] < 0 || x - updated[b] > rx) {
+        for (k = b * nfine; k < (b + 1) * nfine && k < args->nkeys; k++) kfine[k] = 0;
+        for (c = x; c <= x + 2 * rx; c++) {
+          PdpProcessorInternal_histogramMedianColumn(args, y, c, b, 1, nfine, fine, kfine);
+        }
       } else {
-        //
+        for (c = updated[b] + 1; c <= x; c++) {
+          PdpProcessorInternal_histogramMedianColumn(args, y, c + 2 * rx, b, 1, nfine, fine, kfine);
+          PdpProcessorInternal_histogramMedianColumn(args, y, c - 1, b, -1, nfine, fine, kfine);
+        }
       }
+      updated[b] = x;
+
+      for (k = b * nfine; sum + kfine[k] <= rank; k++) {
+        sum += kfine[k];
+      }
+      args->out[y * xsize + x] = (unsigned int)k;
     }
   }
+done:
+  RAVE_FREE(coarse);
+  RAVE_FREE(fine);
+  RAVE_FREE(kcoarse);
+  RAVE_FREE(kfine);
+  RAVE_FREE(updated);
+}
 
-  *outZ = RAVE_OBJECT_COPY(Z2);
-  *outQuality = RAVE_OBJECT_COPY(quality);
-  *outClutterMask = RAVE_OBJECT_COPY(clutterMask);
+/**
+ * Median filters keys with sliding histograms, see \ref PdpProcessorInternal_histogramMedianRays.
+ * @param[in] self - self
+ * @param[in] args - the arguments, failed is set by this function
+ * @returns 1 on success otherwise 0
+ */
+static int PdpProcessorInternal_histogramMedian(PdpProcessor_t* self, PdpProcessorInternal_HistogramMedianArgs* args)
+{
+  if (args->filtYsize > 65535) {
+    RAVE_ERROR0("Window is too large for median filter");
+    return 0;
+  }
+  args->failed = 0;
+  PdpProcessorInternal_processRayBlocks(self, args->ysize, PdpProcessorInternal_histogramMedianRays, args);
+  if (args->failed) {
+    RAVE_ERROR0("Failed to allocate memory for median filter");
+    return 0;
+  }
+  return 1;
+}
 
-  result = 1;
-done:
-  RAVE_OBJECT_RELEASE(degree);
-  RAVE_OBJECT_RELEASE(tmp);
-  RAVE_OBJECT_RELEASE(Z2);
-  RAVE_OBJECT_RELEASE(quality);
-  RAVE_OBJECT_RELEASE(clutterMask);
-  return result;
+/**
+ * Compares two doubles, used when sorting.
+ */
+static int PdpProcessorInternal_compareDouble(const void* a, const void* b)
+{
+  double va = *(const double*)a, vb = *(const double*)b;
+  return (va < vb) ? -1 : ((va > vb) ? 1 : 0);
 }
 
 RaveData2D_t* PdpProcessor_medfilt(PdpProcessor_t* self, RaveData2D_t* Z, double thresh, double nodataZ, long filtXsize, long filtYsize)
@@ -1102,6 +3858,10 @@ RaveData2D_t* PdpProcessor_medfilt(PdpProcessor_t* self, RaveData2D_t* Z, double
   RaveData2D_t* mask = NULL;
   RaveData2D_t* filtmask = NULL;
   RaveData2D_t *zout = NULL, *ztmp = NULL;
+  unsigned char* binaryMask = NULL;
+  unsigned int *keys = NULL, *filtKeys = NULL;
+  double* row = NULL;
+  PdpMedfiltAlgorithm algorithm;
   int usingNodata = 0;
   double minZMedfilterThreshold;
 
@@ -1113,23 +3873,38 @@ RaveData2D_t* PdpProcessor_medfilt(PdpProcessor_t* self, RaveData2D_t* Z, double
     return NULL;
   }
 
+  algorithm = self->medfiltAlgorithm;
   xsize = RaveData2D_getXsize(Z);
   ysize = RaveData2D_getYsize(Z);
-  mask = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
+  /* The median of a 0/1 mask is found by counting or with histograms when the window has an odd size, otherwise
+   * RaveData2D_medfilt2 is used */
+  if (filtXsize <= 0 || filtYsize <= 0 || filtXsize % 2 == 0 || filtYsize % 2 == 0) {
+    algorithm = PdpMedfiltAlgorithm_SORT;
+  }
+  if (algorithm != PdpMedfiltAlgorithm_SORT) {
+    binaryMask = RAVE_MALLOC(sizeof(unsigned char) * xsize * ysize);
+  } else {
+    mask = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
+  }
   zout = RAVE_OBJECT_CLONE(Z);
-  if (mask == NULL || zout == NULL) {
-    return NULL;
+  if ((mask == NULL && binaryMask == NULL) || zout == NULL) {
+    goto done;
   }
 
   usingNodata = RaveData2D_usingNodata(Z);
 
   RaveData2D_useNodata(Z, 0);
   minVal = RaveData2D_min(Z);
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
+  for (y = 0; y < ysize; y++) {
+    for (x = 0; x < xsize; x++) {
       RaveData2D_getValueUnchecked(Z, x, y, &v);
+      if (binaryMask != NULL) {
+        binaryMask[y * xsize + x] = (v > thresh) ? 1 : 0;
+      }
       if (v > thresh) {
-        RaveData2D_setValueUnchecked(mask, x, y, 1.0);
+        if (binaryMask == NULL) {
+          RaveData2D_setValueUnchecked(mask, x, y, 1.0);
+        }
         threshctr++;
       }
     }
@@ -1137,7 +3912,39 @@ RaveData2D_t* PdpProcessor_medfilt(PdpProcessor_t* self, RaveData2D_t* Z, double
   RaveData2D_useNodata(Z, usingNodata);
 
   if (threshctr > 0) {
-    filtmask = RaveData2D_medfilt2(mask, filtXsize, filtYsize);
+    if (algorithm == PdpMedfiltAlgorithm_COUNT) {
+      filtmask = PdpProcessorInternal_binaryMedfilt(self, binaryMask, xsize, ysize, filtXsize, filtYsize);
+    } else if (algorithm == PdpMedfiltAlgorithm_HISTOGRAM) {
+      PdpProcessorInternal_HistogramMedianArgs hargs;
+      keys = RAVE_MALLOC(sizeof(unsigned int) * xsize * ysize);
+      filtKeys = RAVE_MALLOC(sizeof(unsigned int) * xsize * ysize);
+      row = RAVE_MALLOC(sizeof(double) * xsize);
+      filtmask = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
+      if (keys == NULL || filtKeys == NULL || row == NULL || filtmask == NULL) {
+        goto done;
+      }
+      for (x = 0; x < xsize * ysize; x++) keys[x] = binaryMask[x];
+      /* Pixels outside the field are 0 as in RaveData2D_medfilt2 */
+      memset(&hargs, 0, sizeof(PdpProcessorInternal_HistogramMedianArgs));
+      hargs.keys = keys;
+      hargs.out = filtKeys;
+      hargs.xsize = xsize;
+      hargs.ysize = ysize;
+      hargs.filtXsize = filtXsize;
+      hargs.filtYsize = filtYsize;
+      hargs.nkeys = 2;
+      hargs.padKey = 0;
+      hargs.wrap = 0;
+      if (!PdpProcessorInternal_histogramMedian(self, &hargs)) {
+        goto done;
+      }
+      for (y = 0; y < ysize; y++) {
+        for (x = 0; x < xsize; x++) row[x] = (double)filtKeys[y * xsize + x];
+        PdpProcessorInternal_setRay(filtmask, y, row);
+      }
+    } else {
+      filtmask = RaveData2D_medfilt2(mask, filtXsize, filtYsize);
+    }
     if (filtmask == NULL) {
       goto done;
     }
@@ -1149,13 +3956,13 @@ RaveData2D_t* PdpProcessor_medfilt(PdpProcessor_t* self, RaveData2D_t* Z, double
     goto done;
   }
   RaveData2D_useNodata(zout, 1);
-  RAVE_OBJECT_RELEASE(zout);
+  PdpProcessorInternal_recycle(self, &zout);
   zout = RAVE_OBJECT_COPY(ztmp);
-  RAVE_OBJECT_RELEASE(ztmp);
+  PdpProcessorInternal_recycle(self, &ztmp);
   minZMedfilterThreshold = PpcRadarOptions_getMinZMedfilterThreshold(self->options);
 
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
+  for (y = 0; y < ysize; y++) {
+    for (x = 0; x < xsize; x++) {
       RaveData2D_getValueUnchecked(filtmask, x, y, &v);
       if (v == 0.0)
         RaveData2D_setValueUnchecked(zout, x, y, minVal);
@@ -1168,10 +3975,115 @@ RaveData2D_t* PdpProcessor_medfilt(PdpProcessor_t* self, RaveData2D_t* Z, double
 
   result = RAVE_OBJECT_COPY(zout);
 done:
-  RAVE_OBJECT_RELEASE(mask);
-  RAVE_OBJECT_RELEASE(filtmask);
-  RAVE_OBJECT_RELEASE(zout);
-  RAVE_OBJECT_RELEASE(ztmp);
+  RAVE_FREE(binaryMask);
+  RAVE_FREE(keys);
+  RAVE_FREE(filtKeys);
+  RAVE_FREE(row);
+  PdpProcessorInternal_recycle(self, &mask);
+  PdpProcessorInternal_recycle(self, &filtmask);
+  PdpProcessorInternal_recycle(self, &zout);
+  PdpProcessorInternal_recycle(self, &ztmp);
+  return result;
+}
+
+RaveData2D_t* PdpProcessor_medianFilter(PdpProcessor_t* self, RaveData2D_t* field, long filtXsize, long filtYsize)
+{
+  RaveData2D_t* result = NULL;
+  RaveData2D_t* filtered = NULL;
+  unsigned int *keys = NULL, *out = NULL;
+  double *values = NULL, *row = NULL;
+  double nodata = 0.0;
+  long xsize = 0, ysize = 0, x = 0, y = 0, nvalid = 0, nvalues = 0;
+  int usingNodata = 0;
+  PdpProcessorInternal_HistogramMedianArgs args;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (field == NULL) {
+    RAVE_ERROR0("field == NULL");
+    return NULL;
+  }
+  if (filtXsize <= 0 || filtYsize <= 0 || filtXsize % 2 == 0 || filtYsize % 2 == 0) {
+    RAVE_ERROR0("Window size must be odd");
+    return NULL;
+  }
+  xsize = RaveData2D_getXsize(field);
+  ysize = RaveData2D_getYsize(field);
+  usingNodata = RaveData2D_usingNodata(field);
+  nodata = RaveData2D_getNodata(field);
+
+  keys = RAVE_MALLOC(sizeof(unsigned int) * xsize * ysize);
+  out = RAVE_MALLOC(sizeof(unsigned int) * xsize * ysize);
+  values = RAVE_MALLOC(sizeof(double) * xsize * ysize);
+  row = RAVE_MALLOC(sizeof(double) * xsize);
+  filtered = PdpProcessorInternal_zeros(self, xsize, ysize, RaveData2D_getType(field));
+  if (keys == NULL || out == NULL || values == NULL || row == NULL || filtered == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for median filter");
+    goto done;
+  }
+  RaveData2D_setNodata(filtered, nodata);
+  RaveData2D_useNodata(filtered, usingNodata);
+
+  /* The keys are the ranks of the distinct values so the median is the exact median of the values in the window.
+   * Nodata and values that aren't finite are left out and kept as they are. */
+  for (y = 0; y < ysize; y++) {
+    PdpProcessorInternal_getRay(field, y, row);
+    for (x = 0; x < xsize; x++) {
+      if ((!usingNodata || row[x] != nodata) && isfinite(row[x])) {
+        values[nvalid++] = row[x];
+      }
+    }
+  }
+  qsort(values, nvalid, sizeof(double), PdpProcessorInternal_compareDouble);
+  for (x = 0; x < nvalid; x++) {
+    if (nvalues == 0 || values[x] != values[nvalues - 1]) {
+      values[nvalues++] = values[x];
+    }
+  }
+
+  for (y = 0; y < ysize; y++) {
+    PdpProcessorInternal_getRay(field, y, row);
+    for (x = 0; x < xsize; x++) {
+      unsigned int key = PdpProcessorInternal_EXCLUDED_KEY;
+      if ((!usingNodata || row[x] != nodata) && isfinite(row[x])) {
+        double* found = bsearch(&row[x], values, nvalues, sizeof(double), PdpProcessorInternal_compareDouble);
+        key = (unsigned int)(found - values);
+      }
+      keys[y * xsize + x] = key;
+    }
+  }
+
+  /* The rays wrap around in azimuth and bins outside the ray are left out of the window */
+  memset(&args, 0, sizeof(PdpProcessorInternal_HistogramMedianArgs));
+  args.keys = keys;
+  args.out = out;
+  args.xsize = xsize;
+  args.ysize = ysize;
+  args.filtXsize = filtXsize;
+  args.filtYsize = filtYsize;
+  args.nkeys = (nvalues > 0) ? nvalues : 1;
+  args.padKey = -1;
+  args.wrap = 1;
+  if (!PdpProcessorInternal_histogramMedian(self, &args)) {
+    goto done;
+  }
+
+  for (y = 0; y < ysize; y++) {
+    PdpProcessorInternal_getRay(field, y, row);
+    for (x = 0; x < xsize; x++) {
+      if (keys[y * xsize + x] != PdpProcessorInternal_EXCLUDED_KEY) {
+        row[x] = values[out[y * xsize + x]];
+      }
+    }
+    PdpProcessorInternal_setRay(filtered, y, row);
+  }
+
+  result = RAVE_OBJECT_COPY(filtered);
+done:
+  RAVE_FREE(keys);
+  RAVE_FREE(out);
+  RAVE_FREE(values);
+  RAVE_FREE(row);
+  PdpProcessorInternal_recycle(self, &filtered);
   return result;
 }
 
@@ -1181,16 +4093,16 @@ RaveData2D_t* PdpProcessor_residualClutterFilter(PdpProcessor_t* self, RaveData2
   RaveData2D_t* result = NULL;
   RaveData2D_t* img = NULL;
   RaveData2D_t* mask = NULL;
-  RaveData2D_t* textureZ = NULL;
   RaveData2D_t* Zout = NULL;
   RaveData2D_t* medZ = NULL;
   RaveData2D_t* textureZout = NULL;
+  PdpStats_t* stats = NULL;
   double nodata = 0.0;
   double residualClutterNodata, residualMinZClutterThreshold, residualClutterTextureFilteringMaxZ, residualClutterMaskNodata;
-  // long long starttime = PdpProcessorInternal_timestamp();
+  double *zrow = NULL, *imgrow = NULL, *maskrow = NULL;
 
-  long nhctr = 0;
-  double nh = 0.0, EN = 0.0;
+  long nmask = 0;
+  double EN = 0.0, p = 0.0;
 
   long xsize = 0, ysize = 0, x = 0, y = 0;
   double minZ = 0.0;
@@ -1210,56 +4122,55 @@ RaveData2D_t* PdpProcessor_residualClutterFilter(PdpProcessor_t* self, RaveData2
   ysize = RaveData2D_getYsize(Z);
   minZ = RaveData2D_min(Z);
 
-  residualClutterNodata = PpcRadarOptions_getResidualClutterNodata(self->options);
+  residualClutterNodata = PdpProcessorInternal_toPrecision(self, PpcRadarOptions_getResidualClutterNodata(self->options));
   residualMinZClutterThreshold = PpcRadarOptions_getResidualMinZClutterThreshold(self->options);
   residualClutterTextureFilteringMaxZ = PpcRadarOptions_getResidualClutterTextureFilteringMaxZ(self->options);
-  residualClutterMaskNodata = PpcRadarOptions_getResidualClutterMaskNodata(self->options);
+  residualClutterMaskNodata = PdpProcessorInternal_toPrecision(self, PpcRadarOptions_getResidualClutterMaskNodata(self->options));
 
-  img = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
+  img = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
   RaveData2D_setNodata(img, residualClutterNodata);
   RaveData2D_useNodata(img, 1);
 
-  mask = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
-  if (img == NULL || mask == NULL) {
+  mask = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
+  zrow = RAVE_MALLOC(sizeof(double) * xsize);
+  imgrow = RAVE_MALLOC(sizeof(double) * xsize);
+  maskrow = RAVE_MALLOC(sizeof(double) * xsize);
+  if (img == NULL || mask == NULL || zrow == NULL || imgrow == NULL || maskrow == NULL) {
     goto done;
   }
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
-      double v = 0.0;
-      RaveData2D_getValueUnchecked(Z, x, y, &v);
+
+  /* The img and the mask are built and the ones in the mask counted in the same pass */
+  for (y = 0; y < ysize; y++) {
+    PdpProcessorInternal_getRay(Z, y, zrow);
+    for (x = 0; x < xsize; x++) {
+      double v = zrow[x];
       if (v < residualMinZClutterThreshold || v == nodata) {
-        RaveData2D_setValueUnchecked(img, x, y, residualClutterNodata); /* TODO: Specify as residualClutterNodata? */
+        imgrow[x] = residualClutterNodata; /* TODO: Specify as residualClutterNodata? */
+        maskrow[x] = 0.0;
       } else {
-        RaveData2D_setValueUnchecked(img, x, y, v);
-        if (v > thresholdZ) {
-          RaveData2D_setValueUnchecked(mask, x, y, 1.0);
-        }
+        imgrow[x] = v;
+        maskrow[x] = (v > thresholdZ) ? 1.0 : 0.0;
+        nmask += (v > thresholdZ) ? 1 : 0;
       }
     }
+    PdpProcessorInternal_setRay(img, y, imgrow);
+    PdpProcessorInternal_setRay(mask, y, maskrow);
   }
 
-  textureZ = PdpProcessor_texture(self, img);
-
-  if (textureZ == NULL) {
-    goto done;
-  }
-
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
-      double v = 0.0;
-      RaveData2D_getValueUnchecked(textureZ, x, y, &v);
-      if (v > thresholdZ)
-        nhctr++;
-    }
+  /* The entropy of a 0/1 mask only depends on the share of ones, so it is the same as RaveData2D_entropy(mask, 2)
+   * without another pass. The original gate also required nh <= 70, where nh is the share of pixels in img with a
+   * texture above thresholdZ divided by 100. Since nh never exceeds 0.01 that always holds and the texture is not needed. */
+  p = (xsize * ysize > 0) ? (double)nmask / (double)(xsize * ysize) : 0.0;
+  EN = 0.0;
+  if (p > 0.0 && p < 1.0) {
+    EN = -(p * log(p) + (1.0 - p) * log(1.0 - p)) / log(2.0);
   }
-
-  nh = ((double)nhctr) / (double)(xsize*ysize*100.0);
-  if (!RaveData2D_entropy(mask, 2, &EN)) {
-    RAVE_ERROR0("Failed to calculate entropy");
-    goto done;
+  stats = PdpProcessorInternal_getCurrentStats();
+  if (stats != NULL) {
+    PdpStats_addResidualFilterGate(stats, EN, (EN > 5e-4) ? 1 : 0);
   }
 
-  if (nh <= 70.0 && EN > 5e-4) {
+  if (EN > 5e-4) {
     Zout = PdpProcessor_medfilt(self, img, thresholdZ, nodata, filtXsize, filtYsize);
     if (Zout == NULL) {
       goto done;
@@ -1269,8 +4180,8 @@ RaveData2D_t* PdpProcessor_residualClutterFilter(PdpProcessor_t* self, RaveData2
     RaveData2D_useNodata(Zout, 1);
     textureZout = PdpProcessor_texture(self, Zout);
 
-    for (x = 0; x < xsize; x++) {
-      for (y = 0; y < ysize; y++) {
+    for (y = 0; y < ysize; y++) {
+      for (x = 0; x < xsize; x++) {
         double v = 0.0;
         RaveData2D_getValueUnchecked(textureZout, x, y, &v);
         if (v >= thresholdTexture) {
@@ -1286,47 +4197,240 @@ RaveData2D_t* PdpProcessor_residualClutterFilter(PdpProcessor_t* self, RaveData2
     if (medZ == NULL) {
       goto done;
     }
+    for (y = 0; y < ysize; y++) {
+      for (x = 0; x < xsize; x++) {
+        double v = 0.0;
+        RaveData2D_getValueUnchecked(medZ, x, y, &v);
+        if (v <= thresholdZ) {
+          RaveData2D_setValueUnchecked(medZ, x, y, minZ);
+          v = minZ;
+        }
+        if (v <= residualMinZClutterThreshold) {
+          RaveData2D_setValueUnchecked(mask, x, y, residualClutterMaskNodata);
+        }
+      }
+    }
+  }
+
+  RaveData2D_setNodata(mask, residualClutterMaskNodata);
+  RaveData2D_useNodata(mask, 1);
+
+  result = RAVE_OBJECT_COPY(mask);
+done:
+  RAVE_FREE(zrow);
+  RAVE_FREE(imgrow);
+  RAVE_FREE(maskrow);
+  PdpProcessorInternal_recycle(self, &img);
+  PdpProcessorInternal_recycle(self, &mask);
+  PdpProcessorInternal_recycle(self, &Zout);
+  PdpProcessorInternal_recycle(self, &medZ);
+  PdpProcessorInternal_recycle(self, &textureZout);
+  return result;
+}
+
+/**
+ * Arguments used when deriving KDP from PDP
+ */
+typedef struct PdpProcessorInternal_KdpArgs {
+  long xsize; /**< xsize */
+  RaveData2D_t* pdp; /**< the pdp */
+  RaveData2D_t* kdp; /**< the resulting kdp */
+  double dr; /**< range resolution */
+  long window; /**< window */
+  double kdpUp; /**< max allowed kdp */
+  double kdpDown; /**< min allowed kdp */
+} PdpProcessorInternal_KdpArgs;
+
+/**
+ * Derives KDP from PDP for the provided rays.
+ * Kdp = (Bx - Ax) / 2*(2*dr*window) == 0.5*(Bx-Ax)/(2*dr*window);
+ */
+static void PdpProcessorInternal_kdpRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_KdpArgs* args = (PdpProcessorInternal_KdpArgs*)arg;
+  long x, y, xsize = args->xsize, window = args->window;
+  for (y = startray; y < endray; y++) {
+    for (x = 0; x < xsize; x++) {
+      double Ax, Bx, Kdpv;
+      long bxi = (x + window)%xsize;
+      long axi = (x - window)%xsize;
+      while (bxi < 0) {
+        bxi += xsize;
+      }
+      while (axi < 0) {
+        axi += xsize;
+      }
+      RaveData2D_getValueUnchecked(args->pdp, axi, y, &Ax);
+      RaveData2D_getValueUnchecked(args->pdp, bxi, y, &Bx);
+      Kdpv = 0.5 * (Bx - Ax) / (2 * args->dr * window);
+      if (Kdpv < args->kdpDown || Kdpv > args->kdpUp) {
+        Kdpv = 0.0;
+      }
+      if (x < window || x >= xsize - window ) { /* Side effects compensation */
+        Kdpv = 0.0;
+      }
+      RaveData2D_setValueUnchecked(args->kdp, x, y, Kdpv);
+    }
+  }
+}
+
+/**
+ * Arguments used when filtering PDP and iterating KDP
+ */
+typedef struct PdpProcessorInternal_PdpIterationArgs {
+  long xsize; /**< xsize */
+  RaveData2D_t* kdp; /**< the initial kdp, replaced with the resulting kdp */
+  RaveData2D_t* pdpf; /**< the resulting filtered pdp */
+  double dr; /**< range resolution */
+  long window; /**< window */
+  long nrIter; /**< number of iterations */
+  double kdpUp; /**< max allowed kdp */
+  double kdpDown; /**< min allowed kdp */
+  double kdpStdThreshold; /**< kdp is set to 0 where the moving std of kdp is above this threshold */
+  int isFloat; /**< if intermediate values should be rounded to float */
+  int failed; /**< set if memory could not be allocated */
+} PdpProcessorInternal_PdpIterationArgs;
+
+/**
+ * Rounds a value to the precision of the intermediate fields.
+ */
+static double PdpProcessorInternal_roundIteration(double v, int isFloat)
+{
+  return isFloat ? (double)(float)v : v;
+}
+
+/**
+ * Adds v to a sum using Neumaier's compensated summation. The sum is *sum + *c.
+ */
+static void PdpProcessorInternal_compensatedAdd(double* sum, double* c, double v)
+{
+  double t = *sum + v;
+  if (fabs(*sum) >= fabs(v)) {
+    *c += (*sum - t) + v;
+  } else {
+    *c += (v - t) + *sum;
+  }
+  *sum = t;
+}
+
+/**
+ * Calculates the moving standard deviation along a ray over the bins x-window to x+window. The window is
+ * shrunk at the ends of the ray in the same way as RaveData2D_movingstd and the deviation is normalized
+ * with n-1, a window with one value has deviation 0. The sums are updated when the window slides so the cost
+ * per bin is the same regardless of the window size.
+ * @param[in] in - the values
+ * @param[out] out - the standard deviations
+ * @param[in] xsize - number of bins
+ * @param[in] window - half window size
+ */
+static void PdpProcessorInternal_movingStdRay(const double* in, double* out, long xsize, long window)
+{
+  long x, lo = 0, hi = -1;
+  double sum = 0.0, c = 0.0, sum2 = 0.0, c2 = 0.0;
+
+  if (window < 0) {
+    window = 0;
+  }
+  for (x = 0; x < xsize; x++) {
+    long n;
+    double s, s2, var = 0.0;
+    while (hi < x + window && hi < xsize - 1) {
+      hi++;
+      PdpProcessorInternal_compensatedAdd(&sum, &c, in[hi]);
+      PdpProcessorInternal_compensatedAdd(&sum2, &c2, in[hi] * in[hi]);
+    }
+    while (lo < x - window) {
+      PdpProcessorInternal_compensatedAdd(&sum, &c, -in[lo]);
+      PdpProcessorInternal_compensatedAdd(&sum2, &c2, -in[lo] * in[lo]);
+      lo++;
+    }
+    n = hi - lo + 1;
+    if (n > 1) {
+      s = sum + c;
+      s2 = sum2 + c2;
+      var = (s2 - s * s / n) / (n - 1);
+    }
+    out[x] = sqrt((var > 0.0) ? var : 0.0);
+  }
+}
+
+/**
+ * Integrates kdp along the ray, pdp = cumsum(2 * dr * kdp), where kdp values below kdpDown are set to 0 if threshold is set.
+ */
+static void PdpProcessorInternal_integrateKdpRay(PdpProcessorInternal_PdpIterationArgs* args, const double* kdp, double* pdp, int threshold)
+{
+  long x;
+  double sum = 0.0;
+  for (x = 0; x < args->xsize; x++) {
+    double v = kdp[x];
+    if (threshold && v < args->kdpDown) {
+      v = 0.0;
+    }
+    sum += PdpProcessorInternal_roundIteration(v * (2.0 * args->dr), args->isFloat);
+    pdp[x] = PdpProcessorInternal_roundIteration(sum, args->isFloat);
+  }
+}
+
+/**
+ * Filters PDP and iterates KDP for the provided rays. Kdp is first set to 0 where the moving standard deviation
+ * along the ray is above the threshold. Each ray is independent so the screening and all iterations are run on
+ * buffers local to the ray instead of allocating new fields for each step. The steps and the rounding of the
+ * intermediate values are the same as when the iterations are performed on complete fields,
+ * see \ref PdpProcessorInternal_kdpRays.
+ */
+static void PdpProcessorInternal_pdpIterationRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_PdpIterationArgs* args = (PdpProcessorInternal_PdpIterationArgs*)arg;
+  long x, y, ki, xsize = args->xsize, window = args->window;
+  double *kdp = NULL, *pdp = NULL;
+
+  kdp = RAVE_MALLOC(sizeof(double) * xsize);
+  pdp = RAVE_MALLOC(sizeof(double) * xsize);
+  if (kdp == NULL || pdp == NULL) {
+    args->failed = 1;
+    goto done;
+  }
+
+  for (y = startray; y < endray; y++) {
+    PdpProcessorInternal_getRay(args->kdp, y, kdp);
+    PdpProcessorInternal_movingStdRay(kdp, pdp, xsize, window);
     for (x = 0; x < xsize; x++) {
-      for (y = 0; y < ysize; y++) {
-        double v = 0.0;
-        RaveData2D_getValueUnchecked(medZ, x, y, &v);
-        if (v <= thresholdZ) {
-          RaveData2D_setValueUnchecked(medZ, x, y, minZ);
-          v = minZ;
-        }
-        if (v <= residualMinZClutterThreshold) {
-          RaveData2D_setValueUnchecked(mask, x, y, residualClutterMaskNodata);
+      if (pdp[x] > args->kdpStdThreshold) {
+        kdp[x] = 0.0;
+      }
+    }
+    for (ki = 0; ki < args->nrIter; ki++) {
+      PdpProcessorInternal_integrateKdpRay(args, kdp, pdp, 1);
+      for (x = 0; x < xsize; x++) {
+        double Kdpv = 0.0;
+        if (x >= window && x < xsize - window) { /* Side effects compensation */
+          Kdpv = 0.5 * (pdp[x + window] - pdp[x - window]) / (2 * args->dr * window);
+          if (Kdpv < args->kdpDown || Kdpv > args->kdpUp) {
+            Kdpv = 0.0;
+          }
         }
+        kdp[x] = PdpProcessorInternal_roundIteration(Kdpv, args->isFloat);
       }
     }
+    PdpProcessorInternal_integrateKdpRay(args, kdp, pdp, 0);
+    PdpProcessorInternal_setRay(args->kdp, y, kdp);
+    PdpProcessorInternal_setRay(args->pdpf, y, pdp);
   }
-
-  RaveData2D_setNodata(mask, residualClutterMaskNodata);
-  RaveData2D_useNodata(mask, 1);
-
-  result = RAVE_OBJECT_COPY(mask);
 done:
-  RAVE_OBJECT_RELEASE(img);
-  RAVE_OBJECT_RELEASE(mask);
-  RAVE_OBJECT_RELEASE(textureZ);
-  RAVE_OBJECT_RELEASE(Zout);
-  RAVE_OBJECT_RELEASE(medZ);
-  RAVE_OBJECT_RELEASE(textureZout);
-  return result;
+  RAVE_FREE(kdp);
+  RAVE_FREE(pdp);
 }
 
 int PdpProcessor_pdpProcessing(PdpProcessor_t* self, RaveData2D_t* pdp, double dr, long window, long nrIter, RaveData2D_t** pdpf, RaveData2D_t** kdp)
 {
   int result = 0;
   long xsize = 0, ysize = 0;
-  long x = 0, y = 0;
-  long ki = 0;
   RaveData2D_t *pdpres = NULL, *kdpres = NULL;
-  RaveData2D_t *stdK = NULL;
-  RaveData2D_t *tmp = NULL, *tmp2 = NULL;
   double kdpUp, kdpDown, kdpStdThreshold;
+  PdpProcessorInternal_KdpArgs kargs;
+  PdpProcessorInternal_PdpIterationArgs iargs;
 
-  // long long starttime = PdpProcessorInternal_timestamp();
+  // long long starttime = PdpStats_now();
 
   RAVE_ASSERT((self != NULL), "self == NULL");
   if (pdp == NULL) {
@@ -1346,7 +4450,7 @@ int PdpProcessor_pdpProcessing(PdpProcessor_t* self, RaveData2D_t* pdp, double d
   xsize = RaveData2D_getXsize(pdp); /* Bin */
   ysize = RaveData2D_getYsize(pdp); /* Ray */
   pdpres = RAVE_OBJECT_CLONE(pdp);
-  kdpres = RaveData2D_zeros(xsize, ysize, RaveDataType_DOUBLE);
+  kdpres = PdpProcessorInternal_zeros(self, xsize, ysize, PdpProcessorInternal_getDataType(self));
   RaveData2D_setNodata(kdpres, -999.0);
   RaveData2D_useNodata(kdpres, 1);
 
@@ -1357,111 +4461,39 @@ int PdpProcessor_pdpProcessing(PdpProcessor_t* self, RaveData2D_t* pdp, double d
   kdpDown = PpcRadarOptions_getKdpDown(self->options);
   kdpStdThreshold = PpcRadarOptions_getKdpStdThreshold(self->options);
 
-  // starttime = PdpProcessorInternal_timestamp();
-  // fprintf(stderr, "pdpProcessing: Initialization %ld\n", PdpProcessorInternal_timestamp() - starttime);
-  //Kdp = (Bx - Ax) / 2*(2*dr*window) == 0.5*(Bx-Ax)/(2*dr*window);
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
-      double Ax, Bx, Kdpv;
-      long bxi = (x + window)%xsize;
-      long axi = (x - window)%xsize;
-      while (bxi < 0) {
-        bxi += xsize;
-      }
-      while (axi < 0) {
-        axi += xsize;
-      }
-      RaveData2D_getValueUnchecked(pdpres, axi, y, &Ax);
-      RaveData2D_getValueUnchecked(pdpres, bxi, y, &Bx);
-      Kdpv = 0.5 * (Bx - Ax) / (2 * dr * window);
-      if (Kdpv < kdpDown || Kdpv > kdpUp) {
-        Kdpv = 0.0;
-      }
-      if (x < window || x >= xsize - window ) { /* Side effects compensation */
-        Kdpv = 0.0;
-      }
-      RaveData2D_setValueUnchecked(kdpres, x, y, Kdpv);
-    }
-  }
-
-  stdK = RaveData2D_movingstd(kdpres, window, 0); /* In matlab they use 0, window as inparam, but they are used as window, 0 in array...... */
-
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
-      double v = 0.0;
-      RaveData2D_getValueUnchecked(stdK,  x, y, &v);
-      if (v > kdpStdThreshold) {
-        RaveData2D_setValueUnchecked(kdpres, x, y, 0.0);
-      }
-    }
-  }
-
-  for (ki = 0; ki < nrIter; ki++) {
-    RAVE_OBJECT_RELEASE(tmp);
-    tmp = RAVE_OBJECT_CLONE(kdpres);
-
-    if (tmp == NULL) {
-      goto done;
-    }
-
-    for (x = 0; x < xsize; x++) {
-      for (y = 0; y < ysize; y++) {
-        double v = 0.0;
-        RaveData2D_getValueUnchecked(tmp, x, y, &v);
-        if (v < kdpDown) {
-          RaveData2D_setValueUnchecked(tmp, x, y, 0.0);
-        }
-      }
-    }
-    tmp2 = RaveData2D_mulNumber(tmp, 2.0 * dr);
-    if (tmp2 == NULL) {
-      goto done;
-    }
-
-    RAVE_OBJECT_RELEASE(pdpres);
-    pdpres = RaveData2D_cumsum(tmp2, 0);  // Matlab - cumsum(2*tmp*dr,2); Basically says that it's in y-direction since x is vertically and y horizontally
-    if (pdpres == NULL) {
-      goto done;
-    }
-
-    for (x = 0; x < xsize; x++) {
-      for (y = 0; y < ysize; y++) {
-        double Ax, Bx, Kdpv;
-
-        long bxi = (x + window)%xsize;
-        long axi = (x - window)%xsize;
-        while (bxi < 0) {
-          bxi += xsize;
-        }
-        while (axi < 0) {
-          axi += xsize;
-        }
-
-        RaveData2D_getValueUnchecked(pdpres, axi, y, &Ax);
-        RaveData2D_getValueUnchecked(pdpres, bxi, y, &Bx);
-        Kdpv = 0.5 * (Bx - Ax) / (2 * dr * window);
-        if (Kdpv < kdpDown || Kdpv > kdpUp) {
-          Kdpv = 0.0;
-        }
-        if (x < window || x >= xsize - window ) { /* Side effects compensation */
-          Kdpv = 0.0;
-        }
-        RaveData2D_setValueUnchecked(kdpres, x, y, Kdpv);
-      }
-    }
-
-    RAVE_OBJECT_RELEASE(tmp);
-    RAVE_OBJECT_RELEASE(tmp2);
-  }
-
-  tmp = RaveData2D_mulNumber(kdpres, 2.0 * dr);
-  if (tmp == NULL) {
+  // starttime = PdpStats_now();
+  // fprintf(stderr, "pdpProcessing: Initialization %ld\n", PdpStats_now() - starttime);
+  kargs.xsize = xsize;
+  kargs.pdp = pdpres;
+  kargs.kdp = kdpres;
+  kargs.dr = dr;
+  kargs.window = window;
+  kargs.kdpUp = kdpUp;
+  kargs.kdpDown = kdpDown;
+  PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_kdpRays, &kargs);
+
+  PdpProcessorInternal_recycle(self, &pdpres);
+  pdpres = PdpProcessorInternal_zeros(self, xsize, ysize, RaveData2D_getType(kdpres));
+  if (pdpres == NULL) {
     goto done;
   }
-
-  RAVE_OBJECT_RELEASE(pdpres);
-  pdpres = RaveData2D_cumsum(tmp, 0);
-  if (pdpres == NULL) {
+  RaveData2D_setNodata(pdpres, -999.0);
+  RaveData2D_useNodata(pdpres, 1);
+
+  iargs.xsize = xsize;
+  iargs.kdp = kdpres;
+  iargs.pdpf = pdpres;
+  iargs.dr = dr;
+  iargs.window = window;
+  iargs.nrIter = nrIter;
+  iargs.kdpUp = kdpUp;
+  iargs.kdpDown = kdpDown;
+  iargs.kdpStdThreshold = kdpStdThreshold;
+  iargs.isFloat = (RaveData2D_getType(kdpres) == RaveDataType_FLOAT);
+  iargs.failed = 0;
+  PdpProcessorInternal_processRayBlocks(self, ysize, PdpProcessorInternal_pdpIterationRays, &iargs);
+  if (iargs.failed) {
+    RAVE_ERROR0("Failed to allocate memory for pdp processing");
     goto done;
   }
 
@@ -1470,20 +4502,21 @@ int PdpProcessor_pdpProcessing(PdpProcessor_t* self, RaveData2D_t* pdp, double d
 
   result = 1;
 done:
-  RAVE_OBJECT_RELEASE(pdpres);
-  RAVE_OBJECT_RELEASE(kdpres);
-  RAVE_OBJECT_RELEASE(stdK);
-  RAVE_OBJECT_RELEASE(tmp);
-  RAVE_OBJECT_RELEASE(tmp2);
+  PdpProcessorInternal_recycle(self, &pdpres);
+  PdpProcessorInternal_recycle(self, &kdpres);
 
   return result;
 }
 
-int PdpProcessor_pdpScript(PdpProcessor_t* self, RaveData2D_t* pdp, double dr, double rWin1, double rWin2, long nrIter, RaveData2D_t** pdpf, RaveData2D_t** kdp)
+/**
+ * See \ref PdpProcessor_pdpScript.
+ * @param[in] pdpTexture - the texture of pdp, if NULL it will be calculated
+ */
+static int PdpProcessorInternal_pdpScript(PdpProcessor_t* self, RaveData2D_t* pdp, RaveData2D_t* pdpTexture, double dr, double rWin1, double rWin2, long nrIter, RaveData2D_t** pdpf, RaveData2D_t** kdp)
 {
-  int result = 0;
+  int result = 0, status = 0;
   long x, y, xsize = 0, ysize = 0;
-  long window = 0;
+  long window = 0, nflagged = 0;
   int isempty = 1;
   RaveData2D_t* texture = NULL;
   RaveData2D_t* pdpwork = NULL;
@@ -1503,7 +4536,7 @@ int PdpProcessor_pdpScript(PdpProcessor_t* self, RaveData2D_t* pdp, double dr, d
     RAVE_ERROR0("dr must be > 0");
     goto done;
   }
-  nodata = PpcRadarOptions_getNodata(self->options);
+  nodata = PdpProcessorInternal_toPrecision(self, PpcRadarOptions_getNodata(self->options));
   processingTextureThreshold = PpcRadarOptions_getProcessingTextureThreshold(self->options);
   thresholdPhidp = PpcRadarOptions_getThresholdPhidp(self->options);
 
@@ -1515,28 +4548,37 @@ int PdpProcessor_pdpScript(PdpProcessor_t* self, RaveData2D_t* pdp, double dr, d
   xsize = RaveData2D_getXsize(pdp);
   ysize = RaveData2D_getYsize(pdp);
 
-  texture = PdpProcessor_texture(self,  pdpwork);
+  if (pdpTexture != NULL) {
+    texture = RAVE_OBJECT_COPY(pdpTexture);
+  } else {
+    texture = PdpProcessor_texture(self,  pdpwork);
+  }
   if (texture == NULL) {
     goto done;
   }
 
-  for (x = 0; x < xsize; x++) {
-    for (y = 0; y < ysize; y++) {
+  for (y = 0; y < ysize; y++) {
+    for (x = 0; x < xsize; x++) {
       double v = 0.0;
       RaveData2D_getValueUnchecked(texture, x, y, &v);
       if (v > processingTextureThreshold) {
         RaveData2D_setValueUnchecked(pdpwork, x, y, nodata);
+        nflagged++;
       }
     }
   }
+  PdpProcessorInternal_addPixels(PdpStatsStage_PDP_SCRIPT, xsize * ysize, nflagged);
 
-
-  if (!PdpProcessor_pdpProcessing(self, pdpwork, dr, (long)window, nrIter, &pdpres, &kdpres)) {
+  PdpProcessorInternal_startStage(PdpStatsStage_PDP_PASS1);
+  status = PdpProcessor_pdpProcessing(self, pdpwork, dr, (long)window, nrIter, &pdpres, &kdpres);
+  PdpProcessorInternal_stopStage();
+  if (!status) {
     goto done;
   }
+  PdpProcessorInternal_addPixels(PdpStatsStage_PDP_PASS1, xsize * ysize, 0);
 
-  for (x = 0; isempty == 1 && x < xsize; x++) {
-    for (y = 0; isempty == 1 && y < ysize; y++) {
+  for (y = 0; isempty == 1 && y < ysize; y++) {
+    for (x = 0; isempty == 1 && x < xsize; x++) {
       double v = 0.0;
       RaveData2D_getValueUnchecked(pdpres, x, y, &v);
       if (v > thresholdPhidp) {
@@ -1550,11 +4592,15 @@ int PdpProcessor_pdpScript(PdpProcessor_t* self, RaveData2D_t* pdp, double dr, d
     if (window < PpcRadarOptions_getMinWindow(self->options)) {
       window = PpcRadarOptions_getMinWindow(self->options);
     }
-    RAVE_OBJECT_RELEASE(pdpres);
-    RAVE_OBJECT_RELEASE(kdpres);
-    if (!PdpProcessor_pdpProcessing(self, pdpwork, dr, window, nrIter, &pdpres, &kdpres)) {
+    PdpProcessorInternal_recycle(self, &pdpres);
+    PdpProcessorInternal_recycle(self, &kdpres);
+    PdpProcessorInternal_startStage(PdpStatsStage_PDP_PASS2);
+    status = PdpProcessor_pdpProcessing(self, pdpwork, dr, window, nrIter, &pdpres, &kdpres);
+    PdpProcessorInternal_stopStage();
+    if (!status) {
       goto done;
     }
+    PdpProcessorInternal_addPixels(PdpStatsStage_PDP_PASS2, xsize * ysize, 0);
   }
 
   *pdpf = RAVE_OBJECT_COPY(pdpres);
@@ -1562,27 +4608,120 @@ int PdpProcessor_pdpScript(PdpProcessor_t* self, RaveData2D_t* pdp, double dr, d
 
   result = 1;
 done:
-  RAVE_OBJECT_RELEASE(texture);
-  RAVE_OBJECT_RELEASE(pdpwork);
-  RAVE_OBJECT_RELEASE(pdpres);
-  RAVE_OBJECT_RELEASE(kdpres);
+  PdpProcessorInternal_recycle(self, &texture);
+  PdpProcessorInternal_recycle(self, &pdpwork);
+  PdpProcessorInternal_recycle(self, &pdpres);
+  PdpProcessorInternal_recycle(self, &kdpres);
 
   return result;
 }
 
+int PdpProcessor_pdpScript(PdpProcessor_t* self, RaveData2D_t* pdp, double dr, double rWin1, double rWin2, long nrIter, RaveData2D_t** pdpf, RaveData2D_t** kdp)
+{
+  return PdpProcessorInternal_pdpScript(self, pdp, NULL, dr, rWin1, rWin2, nrIter, pdpf, kdp);
+}
+
+/**
+ * Arguments used by the attenuation kernels
+ */
+typedef struct PdpProcessorInternal_AttenuationArgs {
+  long nbins; /**< number of bins */
+  RaveData2D_t* Z; /**< Z */
+  RaveData2D_t* zdr; /**< ZDR */
+  RaveData2D_t* dbzh; /**< DBZH */
+  RaveData2D_t* pdp; /**< PDP */
+  RaveData2D_t* mask; /**< the attenuation mask */
+  RaveData2D_t* PIA; /**< PIA */
+  RaveData2D_t* PIDA; /**< PIDA */
+  RaveData2D_t* zres; /**< the corrected Z */
+  RaveData2D_t* zdrres; /**< the corrected ZDR */
+  RaveData2D_t* dbzhres; /**< the corrected DBZH */
+  double gamma_h; /**< gamma h */
+  double zundetect; /**< undetect for Z */
+  double dbzhundetect; /**< undetect for DBZH */
+  double vpianodata; /**< nodata for PIA */
+  double znodata; /**< nodata for Z */
+  double dbzhnodata; /**< nodata for DBZH */
+  double attenuationPIAminZ; /**< min Z for PIA */
+} PdpProcessorInternal_AttenuationArgs;
+
+/**
+ * Calculates the PIA for the provided rays
+ */
+static void PdpProcessorInternal_attenuationPIARays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_AttenuationArgs* args = (PdpProcessorInternal_AttenuationArgs*)arg;
+  long ri, bi, nbins = args->nbins;
+  for (ri = startray; ri < endray; ri++) {
+    long startbi = -1, endbi = -1;
+    for (bi = 0; bi < nbins; bi++) {
+      double v = 0;
+      RaveData2D_getValueUnchecked(args->mask, bi, ri, &v);
+      if (v > 0 && startbi == -1) {
+        startbi = bi;
+      } else if (v > 0) {
+        endbi = bi;
+      }
+    }
+    if (startbi != -1 && endbi != -1 &&  endbi < nbins-1) { /* don't want end bin to activate attenuation for some reason */
+      double pdpFirst = 0.0;
+      double lastValue = 0.0;
+      RaveData2D_getValueUnchecked(args->pdp, startbi, ri, &pdpFirst);
+      for (bi = startbi; bi <= endbi; bi++) {
+        double v = 0.0;
+        RaveData2D_getValueUnchecked(args->pdp, bi, ri, &v);
+        lastValue = args->gamma_h * (v - pdpFirst);
+        RaveData2D_setValueUnchecked(args->PIA, bi, ri, lastValue);
+      }
+      for (bi = endbi + 1; bi < nbins; bi++) {
+        RaveData2D_setValueUnchecked(args->PIA, bi, ri, lastValue);
+      }
+    }
+  }
+}
+
+/**
+ * Applies the attenuation correction for the provided rays
+ */
+static void PdpProcessorInternal_attenuationCorrectionRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_AttenuationArgs* args = (PdpProcessorInternal_AttenuationArgs*)arg;
+  long ri, bi, nbins = args->nbins;
+  for (ri = startray; ri < endray; ri++) {
+    for (bi = 0; bi < nbins; bi++) {
+      double vz = 0, vpia = 0, vzdr = 0, vpida = 0, vdbzh = 0;
+      RaveData2D_getValueUnchecked(args->Z, bi, ri, &vz);
+      RaveData2D_getValueUnchecked(args->dbzh, bi, ri, &vdbzh);
+      RaveData2D_getValueUnchecked(args->PIA, bi, ri, &vpia);
+      RaveData2D_getValueUnchecked(args->zdr, bi, ri, &vzdr);
+      RaveData2D_getValueUnchecked(args->PIDA, bi, ri, &vpida);
+      if (vpia != args->vpianodata && vpia >= 0.0 && args->znodata != vz && vz != args->zundetect) {
+        RaveData2D_setValueUnchecked(args->zres, bi, ri, vz + vpia);
+        RaveData2D_setValueUnchecked(args->zdrres, bi, ri, vzdr + vpida);
+      }
+
+      if (vpia != args->vpianodata && vpia >= 0.0 && args->dbzhnodata != vdbzh && vdbzh != args->dbzhundetect) { /* Adding attenuation to DBZH */
+        RaveData2D_setValueUnchecked(args->dbzhres, bi, ri, vdbzh + vpia);
+      }
+
+      RaveData2D_getValueUnchecked(args->zres, bi, ri, &vz);
+      if (vz < args->attenuationPIAminZ) {
+        RaveData2D_setValueUnchecked(args->PIA, bi, ri, args->vpianodata);
+      }
+    }
+  }
+}
+
 int PdpProcessor_attenuation(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* zdr, RaveData2D_t* dbzh, RaveData2D_t* pdp,
     RaveData2D_t* mask, double gamma_h, double alpha, double zundetect, double dbzhundetect, RaveData2D_t** outz, RaveData2D_t** outzdr, RaveData2D_t** outPIA, RaveData2D_t** outDBZH)
 {
   long nrays = 0;
   long nbins = 0;
   int result = 0;
-  long ri = 0, bi = 0;
   double vpianodata = 0.0;
-  double znodata = 0.0;
-  double dbzhnodata = 0.0;
   RaveData2D_t *PIA = NULL, *PIDA = NULL;
   RaveData2D_t *zdrres = NULL, *zres = NULL, *dbzhres = NULL;
-  double attenuationPIAminZ;
+  PdpProcessorInternal_AttenuationArgs args;
 
   RAVE_ASSERT((self != NULL), "self == NULL");
 
@@ -1611,43 +4750,30 @@ int PdpProcessor_attenuation(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t
     goto done;
   }
 
-  PIA = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
+  PIA = PdpProcessorInternal_zeros(self, nbins, nrays, PdpProcessorInternal_getDataType(self));
   if (PIA == NULL) {
     goto done;
   }
   vpianodata = RaveData2D_getNodata(pdp);
-  znodata = RaveData2D_getNodata(Z);
   RaveData2D_setNodata(PIA, vpianodata);
   RaveData2D_useNodata(PIA, 1);
 
-  dbzhnodata = RaveData2D_getNodata(dbzh);
-
-  for (ri = 0; ri < nrays; ri++) {
-    long startbi = -1, endbi = -1;
-    for (bi = 0; bi < nbins; bi++) {
-      double v = 0;
-      RaveData2D_getValueUnchecked(mask, bi, ri, &v);
-      if (v > 0 && startbi == -1) {
-        startbi = bi;
-      } else if (v > 0) {
-        endbi = bi;
-      }
-    }
-    if (startbi != -1 && endbi != -1 &&  endbi < nbins-1) { /* don't want end bin to activate attenuation for some reason */
-      double pdpFirst = 0.0;
-      double lastValue = 0.0;
-      RaveData2D_getValueUnchecked(pdp, startbi, ri, &pdpFirst);
-      for (bi = startbi; bi <= endbi; bi++) {
-        double v = 0.0;
-        RaveData2D_getValueUnchecked(pdp, bi, ri, &v);
-        lastValue = gamma_h * (v - pdpFirst);
-        RaveData2D_setValueUnchecked(PIA, bi, ri, lastValue);
-      }
-      for (bi = endbi + 1; bi < nbins; bi++) {
-        RaveData2D_setValueUnchecked(PIA, bi, ri, lastValue);
-      }
-    }
-  }
+  memset(&args, 0, sizeof(PdpProcessorInternal_AttenuationArgs));
+  args.nbins = nbins;
+  args.Z = Z;
+  args.zdr = zdr;
+  args.dbzh = dbzh;
+  args.pdp = pdp;
+  args.mask = mask;
+  args.PIA = PIA;
+  args.gamma_h = gamma_h;
+  args.zundetect = zundetect;
+  args.dbzhundetect = dbzhundetect;
+  args.vpianodata = vpianodata;
+  args.znodata = RaveData2D_getNodata(Z);
+  args.dbzhnodata = RaveData2D_getNodata(dbzh);
+
+  PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_attenuationPIARays, &args);
 
   PIDA = RaveData2D_mulNumber(PIA, alpha);
   if (PIDA == NULL) {
@@ -1662,31 +4788,13 @@ int PdpProcessor_attenuation(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t
     goto done;
   }
 
-  attenuationPIAminZ = PpcRadarOptions_getAttenuationPIAminZ(self->options);
-
-  for (ri = 0; ri < nrays; ri++) {
-    for (bi = 0; bi < nbins; bi++) {
-      double vz = 0, vpia = 0, vzdr = 0, vpida = 0, vdbzh = 0;
-      RaveData2D_getValueUnchecked(Z, bi, ri, &vz);
-      RaveData2D_getValueUnchecked(dbzh, bi, ri, &vdbzh);
-      RaveData2D_getValueUnchecked(PIA, bi, ri, &vpia);
-      RaveData2D_getValueUnchecked(zdr, bi, ri, &vzdr);
-      RaveData2D_getValueUnchecked(PIDA, bi, ri, &vpida);
-      if (vpia != vpianodata && vpia >= 0.0 && znodata != vz && vz != zundetect) {
-        RaveData2D_setValueUnchecked(zres, bi, ri, vz + vpia);
-        RaveData2D_setValueUnchecked(zdrres, bi, ri, vzdr + vpida);
-      }
-
-      if (vpia != vpianodata && vpia >= 0.0 && dbzhnodata != vdbzh && vdbzh != dbzhundetect) { /* Adding attenuation to DBZH */
-        RaveData2D_setValueUnchecked(dbzhres, bi, ri, vdbzh + vpia);
-      }
+  args.PIDA = PIDA;
+  args.zres = zres;
+  args.zdrres = zdrres;
+  args.dbzhres = dbzhres;
+  args.attenuationPIAminZ = PpcRadarOptions_getAttenuationPIAminZ(self->options);
 
-      RaveData2D_getValueUnchecked(zres, bi, ri, &vz);
-      if (vz < attenuationPIAminZ) {
-        RaveData2D_setValueUnchecked(PIA, bi, ri, vpianodata);
-      }
-    }
-  }
+  PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_attenuationCorrectionRays, &args);
 
   *outz = RAVE_OBJECT_COPY(zres);
   *outzdr = RAVE_OBJECT_COPY(zdrres);
@@ -1695,62 +4803,46 @@ int PdpProcessor_attenuation(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t
 
   result = 1;
 done:
-  RAVE_OBJECT_RELEASE(PIA);
-  RAVE_OBJECT_RELEASE(PIDA);
-  RAVE_OBJECT_RELEASE(zdrres);
-  RAVE_OBJECT_RELEASE(zres);
-  RAVE_OBJECT_RELEASE(dbzhres);
+  PdpProcessorInternal_recycle(self, &PIA);
+  PdpProcessorInternal_recycle(self, &PIDA);
+  PdpProcessorInternal_recycle(self, &zdrres);
+  PdpProcessorInternal_recycle(self, &zres);
+  PdpProcessorInternal_recycle(self, &dbzhres);
   return result;
 }
 
-/* BB=0.7987; % at C-band */
-int PdpProcessor_zphi(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* pdp, RaveData2D_t* mask,
-    double dr, double BB, double gamma_h, RaveData2D_t** outzphi, RaveData2D_t** outAH)
-{
-  long nrays = 0;
-  long nbins = 0;
-  int result = 0;
-  long ri = 0, bi = 0;
-  double vpdpnodata = 0.0;
-  double Znodata = 0.0;
-  RaveData2D_t *ah = NULL, *zphi = NULL;
-  RAVE_ASSERT((self != NULL), "self == NULL");
-  if (Z == NULL || pdp == NULL || mask == NULL) {
-    RAVE_ERROR0("Z, pdp or mask is NULL");
-    goto done;
-  }
-  if (outzphi == NULL || outAH == NULL) {
-    RAVE_ERROR0("Out zphi AH is NULL");
-    goto done;
-  }
-  if (!RaveData2D_usingNodata(pdp)) {
-    RAVE_ERROR0("pdp is not using nodata");
-    goto done;
-  }
-  if (!RaveData2D_usingNodata(Z)) {
-    RAVE_ERROR0("Z is not using nodata");
-    goto done;
-  }
-  vpdpnodata = RaveData2D_getNodata(pdp);
-  Znodata = RaveData2D_getNodata(Z);
-  nrays = RaveData2D_getYsize(Z);
-  nbins = RaveData2D_getXsize(Z);
+/**
+ * Arguments used by the zphi kernel
+ */
+typedef struct PdpProcessorInternal_ZphiArgs {
+  long nbins; /**< number of bins */
+  RaveData2D_t* Z; /**< Z */
+  RaveData2D_t* pdp; /**< PDP */
+  RaveData2D_t* mask; /**< the attenuation mask */
+  RaveData2D_t* ah; /**< the resulting AH */
+  RaveData2D_t* zphi; /**< the resulting zphi */
+  double dr; /**< range resolution */
+  double BB; /**< BB */
+  double gamma_h; /**< gamma h */
+  double vpdpnodata; /**< nodata for PDP */
+  double Znodata; /**< nodata for Z */
+} PdpProcessorInternal_ZphiArgs;
 
-  ah = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
-  zphi = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
-  if (ah == NULL || zphi == NULL) {
-    goto done;
-  }
-  RaveData2D_useNodata(ah, 1);
-  RaveData2D_useNodata(zphi, 1);
-  RaveData2D_setNodata(ah, RaveData2D_getNodata(Z));
-  RaveData2D_setNodata(zphi, RaveData2D_getNodata(Z));
+/**
+ * Applies the ZPHI methodology for the provided rays
+ */
+static void PdpProcessorInternal_zphiRays(void* arg, long startray, long endray)
+{
+  PdpProcessorInternal_ZphiArgs* args = (PdpProcessorInternal_ZphiArgs*)arg;
+  long ri, bi, nbins = args->nbins;
+  double dr = args->dr, BB = args->BB, gamma_h = args->gamma_h;
+  double vpdpnodata = args->vpdpnodata, Znodata = args->Znodata;
 
-  for (ri = 0; ri < nrays; ri++) {
+  for (ri = startray; ri < endray; ri++) {
     long startbi = -1, endbi = -1;
     for (bi = 0; bi < nbins; bi++) {
       double v = 0;
-      RaveData2D_getValueUnchecked(mask, bi, ri, &v);
+      RaveData2D_getValueUnchecked(args->mask, bi, ri, &v);
       if (v > 0 && startbi == -1) {
         startbi = bi;
         endbi = bi;
@@ -1765,10 +4857,10 @@ int PdpProcessor_zphi(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* pdp,
       double Ir1rn = 0.0;
       double cumsum = 0.0;
       double cumsum_zphi = 0.0;
-      RaveData2D_getValueUnchecked(pdp, endbi, ri, &vpdp);
+      RaveData2D_getValueUnchecked(args->pdp, endbi, ri, &vpdp);
       if (vpdp > 0 && vpdp != vpdpnodata) {
         double vpdp1 = 0.0;
-        RaveData2D_getValueUnchecked(pdp, startbi, ri, &vpdp1);
+        RaveData2D_getValueUnchecked(args->pdp, startbi, ri, &vpdp1);
         DPDP = vpdp - vpdp1;
       }
       if (vpdp < 0 || vpdp == vpdpnodata) {
@@ -1777,7 +4869,7 @@ int PdpProcessor_zphi(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* pdp,
       factor = pow(10, 0.1 * BB * gamma_h * DPDP) - 1;
       for (bi = startbi; bi <= endbi; bi++) {
         double zv = 0.0;
-        RaveData2D_getValueUnchecked(Z, bi, ri, &zv);
+        RaveData2D_getValueUnchecked(args->Z, bi, ri, &zv);
         /* Linearization.. */
         if (zv != Znodata) {
           double linval = pow(10.0, 0.1*zv); /* 10.^(0.1*xx); */
@@ -1787,7 +4879,7 @@ int PdpProcessor_zphi(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* pdp,
 
       for (bi = startbi; bi <= endbi; bi++) {
         double zv = 0.0;
-        RaveData2D_getValueUnchecked(Z, bi, ri, &zv);
+        RaveData2D_getValueUnchecked(args->Z, bi, ri, &zv);
         /* Linearization.. */
         if (zv != Znodata) {
           double linval = pow(10.0, 0.1*zv); // 10.^(0.1*xx);
@@ -1805,27 +4897,85 @@ int PdpProcessor_zphi(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* pdp,
           simplified_denominator = 0.46*BB*dr*(Ir1rn + factor*Ir1rn - factor * cumsum);
           if (simplified_denominator != 0.0) {
             nv = factor * (pow(linval, BB) / simplified_denominator);
-            RaveData2D_setValueUnchecked(ah, bi, ri, nv);
+            RaveData2D_setValueUnchecked(args->ah, bi, ri, nv);
             cumsum_zphi += 2*dr*nv;
-            RaveData2D_setValueUnchecked(zphi, bi, ri, zv+cumsum_zphi);
+            RaveData2D_setValueUnchecked(args->zphi, bi, ri, zv+cumsum_zphi);
           }
         }
       }
       /* To get same behaviour as matlab code, we pad values until end of ray with last cumsum */
       for (bi = endbi; bi < nbins; bi++) {
         double zv = 0.0;
-        RaveData2D_getValueUnchecked(Z, bi, ri, &zv);
-        RaveData2D_setValueUnchecked(zphi, bi, ri, zv+cumsum_zphi);
+        RaveData2D_getValueUnchecked(args->Z, bi, ri, &zv);
+        RaveData2D_setValueUnchecked(args->zphi, bi, ri, zv+cumsum_zphi);
       }
     }
   }
+}
+
+/* BB=0.7987; % at C-band */
+int PdpProcessor_zphi(PdpProcessor_t* self, RaveData2D_t* Z, RaveData2D_t* pdp, RaveData2D_t* mask,
+    double dr, double BB, double gamma_h, RaveData2D_t** outzphi, RaveData2D_t** outAH)
+{
+  long nrays = 0;
+  long nbins = 0;
+  int result = 0;
+  double vpdpnodata = 0.0;
+  double Znodata = 0.0;
+  RaveData2D_t *ah = NULL, *zphi = NULL;
+  PdpProcessorInternal_ZphiArgs args;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (Z == NULL || pdp == NULL || mask == NULL) {
+    RAVE_ERROR0("Z, pdp or mask is NULL");
+    goto done;
+  }
+  if (outzphi == NULL || outAH == NULL) {
+    RAVE_ERROR0("Out zphi AH is NULL");
+    goto done;
+  }
+  if (!RaveData2D_usingNodata(pdp)) {
+    RAVE_ERROR0("pdp is not using nodata");
+    goto done;
+  }
+  if (!RaveData2D_usingNodata(Z)) {
+    RAVE_ERROR0("Z is not using nodata");
+    goto done;
+  }
+  vpdpnodata = RaveData2D_getNodata(pdp);
+  Znodata = RaveData2D_getNodata(Z);
+  nrays = RaveData2D_getYsize(Z);
+  nbins = RaveData2D_getXsize(Z);
+
+  ah = PdpProcessorInternal_zeros(self, nbins, nrays, PdpProcessorInternal_getDataType(self));
+  zphi = PdpProcessorInternal_zeros(self, nbins, nrays, PdpProcessorInternal_getDataType(self));
+  if (ah == NULL || zphi == NULL) {
+    goto done;
+  }
+  RaveData2D_useNodata(ah, 1);
+  RaveData2D_useNodata(zphi, 1);
+  RaveData2D_setNodata(ah, RaveData2D_getNodata(Z));
+  RaveData2D_setNodata(zphi, RaveData2D_getNodata(Z));
+
+  args.nbins = nbins;
+  args.Z = Z;
+  args.pdp = pdp;
+  args.mask = mask;
+  args.ah = ah;
+  args.zphi = zphi;
+  args.dr = dr;
+  args.BB = BB;
+  args.gamma_h = gamma_h;
+  args.vpdpnodata = vpdpnodata;
+  args.Znodata = Znodata;
+
+  PdpProcessorInternal_processRayBlocks(self, nrays, PdpProcessorInternal_zphiRays, &args);
 
   *outzphi = RAVE_OBJECT_COPY(zphi);
   *outAH = RAVE_OBJECT_COPY(ah);
   result = 1;
 done:
-  RAVE_OBJECT_RELEASE(ah);
-  RAVE_OBJECT_RELEASE(zphi);
+  PdpProcessorInternal_recycle(self, &ah);
+  PdpProcessorInternal_recycle(self, &zphi);
   return result;
 }
 
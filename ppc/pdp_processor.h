@@ -19,6 +19,12 @@ along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
 /**
  * Main routine for the pdp processing based on the algorithm from Vulpiani et al. (2012)
  * This object does support \ref #RAVE_OBJECT_CLONE.
+ *
+ * Thread safety: \ref PdpProcessor_process, \ref PdpProcessor_processVolume and the individual processing
+ * functions only read the processor, its radar options and the input data. One instance can therefore be used
+ * from several threads at the same time, e.g. one thread for each radar, as long as the options, the melting layer
+ * bottom height and the workspace are not changed while processing. The workspace and the statistics are
+ * synchronized internally. The input scans and fields must not be modified by another thread during processing.
  * @file
  * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
  * @date 2019-02-16
@@ -27,12 +33,25 @@ along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
 #define PDP_PROCESSOR_H
 #include "polarvolume.h"
 #include "rave_data2d.h"
+#include "raveobject_list.h"
 #include "ppc_radar_options.h"
+#include "pdp_workspace.h"
+#include "pdp_stats.h"
 /**
  * Defines a transformer
  */
 typedef struct _PdpProcessor_t PdpProcessor_t;
 
+/**
+ * The median filter used on the thresholded 0/1 mask in \ref PdpProcessor_medfilt. All algorithms give
+ * the same result, windows with an even size always use RaveData2D_medfilt2.
+ */
+typedef enum PdpMedfiltAlgorithm {
+  PdpMedfiltAlgorithm_COUNT = 0, /**< counts the ones in the window with sliding column counts (default) */
+  PdpMedfiltAlgorithm_SORT,      /**< RaveData2D_medfilt2 */
+  PdpMedfiltAlgorithm_HISTOGRAM  /**< sliding histograms, see \ref PdpProcessor_medianFilter */
+} PdpMedfiltAlgorithm;
+
 /**
  * Type definition to use when creating a rave object.
  */
@@ -62,6 +81,13 @@ PpcRadarOptions_t* PdpProcessor_getRadarOptions(PdpProcessor_t* self);
 /**
  * Combines all functions implemented in this class into one process that performs the actual polar data processing chain
  * according to the matlab prototype developed by Gianfranco Vulpiani.
+ * The rays are split into blocks that are processed on the number of threads defined in the radar options
+ * (numberOfThreads) or by the environment variable PPC_NUMBER_OF_THREADS. The worker threads are kept in the processor
+ * between calls and are replaced when the number of threads changes. The result is the same regardless
+ * of the number of threads used. The statistics for each stage can be retrieved with \ref PdpProcessor_getLastStats afterwards.
+ * When TH, VRADH and RHOHV are 8 or 16 bit the clutter memberships are looked up from the raw values in tables
+ * that are cached in the processor, so the tables are only built again when the options or the gain/offset changes.
+ * At most 16 tables are kept and the least recently used one is evicted when a new one is needed.
  * @param[in] self - self
  * @param[in] scan - the polar scan
  * @param[in] sclutterMap - the statistical clutter map (if NULL, then default cluttermap with 0s will be used)
@@ -69,6 +95,71 @@ PpcRadarOptions_t* PdpProcessor_getRadarOptions(PdpProcessor_t* self);
  */
 PolarScan_t* PdpProcessor_process(PdpProcessor_t* self, PolarScan_t* scan, RaveData2D_t* sclutterMap);
 
+/**
+ * Same as \ref PdpProcessor_process but the requested fields are added directly to the provided scan instead
+ * of to a copy of it. Parameters replace any existing parameter with the same quantity and quality fields replace
+ * any quality field with the same how/task. The requested fields are only added if the processing succeeds.
+ * @param[in] self - self
+ * @param[in] scan - the polar scan
+ * @param[in] sclutterMap - the statistical clutter map (if NULL, then default cluttermap with 0s will be used)
+ * @returns 1 on success otherwise 0
+ */
+int PdpProcessor_processInPlace(PdpProcessor_t* self, PolarScan_t* scan, RaveData2D_t* sclutterMap);
+
+/**
+ * Attaches a workspace that keeps the scratch buffers between calls so that scans with the same geometry can be
+ * processed without new allocations. The workspace is shared when the processor is cloned.
+ * @param[in] self - self
+ * @param[in] workspace - the workspace, NULL to detach the current workspace
+ */
+void PdpProcessor_setWorkspace(PdpProcessor_t* self, PdpWorkspace_t* workspace);
+
+/**
+ * @param[in] self - self
+ * @return the attached workspace or NULL if there is none
+ */
+PdpWorkspace_t* PdpProcessor_getWorkspace(PdpProcessor_t* self);
+
+/**
+ * Returns the statistics from the last successful call to \ref PdpProcessor_process or \ref PdpProcessor_processVolume.
+ * For a volume the statistics of all scans are added together, which means that the durations are the sum of the
+ * durations of the scans that were processed concurrently.
+ * @param[in] self - self
+ * @return the statistics or NULL if nothing has been processed yet
+ */
+PdpStats_t* PdpProcessor_getLastStats(PdpProcessor_t* self);
+
+/**
+ * If the statistics should be printed to stderr after each processing. Default is no printing.
+ * @param[in] self - self
+ * @param[in] print - 1 to print, 0 to not print
+ */
+void PdpProcessor_setPrintStats(PdpProcessor_t* self, int print);
+
+/**
+ * @param[in] self - self
+ * @return 1 if the statistics are printed to stderr after each processing, otherwise 0
+ */
+int PdpProcessor_getPrintStats(PdpProcessor_t* self);
+
+/**
+ * Processes all scans in the volume. The scans are processed concurrently on the threads defined in the radar options
+ * (numberOfThreads or PPC_NUMBER_OF_THREADS). At most that many scans are processed at the same time and the threads
+ * are split between the scans for their rays, so the volume never uses more threads than a single scan. All scans
+ * share the melting layer bottom height of this processor. The requested fields are attached
+ * to the scans in the volume in place, parameters replacing any existing parameter with the same quantity and
+ * quality fields replacing any quality field with the same how/task. Nothing is attached unless all scans could be processed.
+ * The scans are not copied, the requested fields of each scan are kept until all scans have been processed.
+ * @param[in] self - self
+ * @param[in] pvol - the volume
+ * @param[in] clutterMaps - list of statistical clutter maps (RaveData2D), one for each scan in the same order as the scans in the volume.
+ * If NULL or if the list contains fewer items than there are scans, the default cluttermap with 0s will be used for the remaining scans.
+ * The maps are matched to the scans by their position in the list only, not by elevation, so the list must follow the order that
+ * the scans have in the volume. If a map doesn't have the same geometry as its scan, the whole volume fails and nothing is attached.
+ * @return 1 on success otherwise 0
+ */
+int PdpProcessor_processVolume(PdpProcessor_t* self, PolarVolume_t* pvol, RaveObjectList_t* clutterMaps);
+
 /**
  * Sets the melting layer bottom height. Default is < -1.0 (km) and in that case, the value from the ppc radar options is used.
  * @param[in] scan - scan
@@ -84,12 +175,25 @@ double PdpProcessor_getMeltingLayerBottomHeight(PdpProcessor_t* scan);
 
 /**
  * Calculates the texture from the data 2d field. Note, X must have nodata and useNodata set.
+ * The window is defined by textureBinSize and textureRaySize in the radar options. The default 3x3 window
+ * is calculated directly, other windows are calculated with box sums so the cost doesn't depend on the window size.
  * @param[in] self - self
  * @param[in] X - data 2D field
  * @returns a new data 2D field
  */
 RaveData2D_t* PdpProcessor_texture(PdpProcessor_t* self, RaveData2D_t* X);
 
+/**
+ * Calculates the textures of several fields in one sweep over the rays. The result is the same as calling
+ * \ref PdpProcessor_texture for each field. All fields must have the same geometry and nodata set.
+ * @param[in] self - self
+ * @param[in] nfields - number of fields
+ * @param[in] fields - the fields
+ * @param[out] textures - the resulting textures, must be able to hold nfields items
+ * @returns 1 on success otherwise 0
+ */
+int PdpProcessor_textures(PdpProcessor_t* self, long nfields, RaveData2D_t** fields, RaveData2D_t** textures);
+
 /**
  * Trapezoidal function.
  * @param[in] self - self
@@ -140,7 +244,9 @@ int PdpProcessor_clutterCorrection(PdpProcessor_t* self, RaveData2D_t* Z, RaveDa
     RaveData2D_t** outZ, RaveData2D_t** outQuality, RaveData2D_t** outClutterMask);
 
 /**
- * Creates a median filtered field
+ * Creates a median filtered field. The thresholded 0/1 mask is median filtered with the algorithm set by
+ * \ref PdpProcessor_setMedfiltAlgorithm, by default the ones in the window are counted when the window size is odd,
+ * which costs the same for all window sizes. Even window sizes use RaveData2D_medfilt2.
  * @param[in] self - self
  * @param[in] Z - img to filter
  * @param[in] thresh - min Z threshold to know if median filtering should be performed
@@ -150,6 +256,37 @@ int PdpProcessor_clutterCorrection(PdpProcessor_t* self, RaveData2D_t* Z, RaveDa
  */
 RaveData2D_t* PdpProcessor_medfilt(PdpProcessor_t* self, RaveData2D_t* Z, double thresh, double nodataZ, long filtXsize, long filtYsize);
 
+/**
+ * Sets the median filter used by \ref PdpProcessor_medfilt.
+ * @param[in] self - self
+ * @param[in] algorithm - the algorithm
+ * @returns 1 on success or 0 if the algorithm is unknown
+ */
+int PdpProcessor_setMedfiltAlgorithm(PdpProcessor_t* self, PdpMedfiltAlgorithm algorithm);
+
+/**
+ * @param[in] self - self
+ * @returns the median filter used by \ref PdpProcessor_medfilt
+ */
+PdpMedfiltAlgorithm PdpProcessor_getMedfiltAlgorithm(PdpProcessor_t* self);
+
+/**
+ * Median filters a continuous field, e.g. for despeckling Z or ZDR, with sliding column and kernel histograms,
+ * so the cost is close to constant regardless of the window size for fields with up to 4096 distinct values. Fields
+ * with more are counted from the pixels of the window height in the finest level. The rays are split into blocks
+ * that are filtered on the number of threads defined in the radar options.
+ * The window wraps around in azimuth (y) while bins beyond the ends of the rays and nodata pixels are left out
+ * of the window, so the median is the middle value (the upper one for an even count) of the valid pixels in the
+ * window. Nodata pixels keep nodata in the result. Values that aren't finite are left out in the same way and
+ * are kept as they are. The median is exact for any number of distinct values.
+ * @param[in] self - self
+ * @param[in] field - the field
+ * @param[in] filtXsize - window x size, must be odd
+ * @param[in] filtYsize - window y size, must be odd
+ * @returns the filtered field on success otherwise NULL
+ */
+RaveData2D_t* PdpProcessor_medianFilter(PdpProcessor_t* self, RaveData2D_t* field, long filtXsize, long filtYsize);
+
 /**
  * Runs the residual clutter filter on the image
  * @param[in] self - self
@@ -0,0 +1,351 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of baltrad-ppc.
+
+baltrad-ppc is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+baltrad-ppc is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Statistics collected for each stage when processing a scan.
+ * This object supports \ref #RAVE_OBJECT_CLONE.
+ * @file
+ * @author agent <agent@local>
+ * @date 2026-10-16
+ */
+#include "pdp_stats.h"
+#include "rave_debug.h"
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+/**
+ * Max number of nested stages
+ */
+#define PDP_STATS_MAX_DEPTH 8
+
+/**
+ * The statistics for one stage
+ */
+typedef struct PdpStatsInternal_Stage {
+  long long duration; /**< duration in nanoseconds */
+  long processed; /**< processed pixels */
+  long flagged; /**< flagged pixels */
+  long bytes; /**< allocated bytes */
+} PdpStatsInternal_Stage;
+
+/**
+ * Represents the statistics
+ */
+struct _PdpStats_t {
+  RAVE_OBJECT_HEAD /** Always on top */
+  PdpStatsInternal_Stage stages[PdpStatsStage_NUMBER_OF_STAGES]; /**< the stages */
+  PdpStatsStage started[PDP_STATS_MAX_DEPTH]; /**< the started stages */
+  long long starttime[PDP_STATS_MAX_DEPTH]; /**< the start time of the started stages */
+  int depth; /**< number of started stages */
+  double residualFilterEntropy; /**< sum of the residual clutter mask entropies */
+  long residualFilterApplied; /**< number of scans where the residual clutter filter was applied */
+  long residualFilterSkipped; /**< number of scans where the residual clutter filter was skipped */
+  pthread_mutex_t lock; /**< protects the statistics */
+};
+
+/**
+ * Names of the stages
+ */
+static const char* PdpStatsInternal_stageNames[PdpStatsStage_NUMBER_OF_STAGES] = {
+  "preprocess",
+  "texture",
+  "clutterID",
+  "residualFilter",
+  "pdpScript",
+  "pdpPass1",
+  "pdpPass2",
+  "attenuation",
+  "zphi",
+  "quantization",
+  "total"
+};
+
+/*@{ Private functions */
+/**
+ * Constructor
+ */
+static int PdpStats_constructor(RaveCoreObject* obj)
+{
+  PdpStats_t* this = (PdpStats_t*)obj;
+  memset(this->stages, 0, sizeof(this->stages));
+  this->depth = 0;
+  this->residualFilterEntropy = 0.0;
+  this->residualFilterApplied = 0;
+  this->residualFilterSkipped = 0;
+  pthread_mutex_init(&this->lock, NULL);
+  return 1;
+}
+
+/**
+ * Copy constructor, started stages are not copied
+ */
+static int PdpStats_copyconstructor(RaveCoreObject* obj, RaveCoreObject* srcobj)
+{
+  PdpStats_t* this = (PdpStats_t*)obj;
+  PdpStats_t* src = (PdpStats_t*)srcobj;
+  PdpStats_constructor(obj);
+  pthread_mutex_lock(&src->lock);
+  memcpy(this->stages, src->stages, sizeof(this->stages));
+  this->residualFilterEntropy = src->residualFilterEntropy;
+  this->residualFilterApplied = src->residualFilterApplied;
+  this->residualFilterSkipped = src->residualFilterSkipped;
+  pthread_mutex_unlock(&src->lock);
+  return 1;
+}
+
+/**
+ * Destructor
+ */
+static void PdpStats_destructor(RaveCoreObject* obj)
+{
+  pthread_mutex_destroy(&((PdpStats_t*)obj)->lock);
+}
+
+/**
+ * @param[in] stage - the stage
+ * @return 1 if stage is a valid stage otherwise 0
+ */
+static int PdpStatsInternal_isValid(PdpStatsStage stage)
+{
+  return (stage >= 0 && stage < PdpStatsStage_NUMBER_OF_STAGES) ? 1 : 0;
+}
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+const char* PdpStats_getStageName(PdpStatsStage stage)
+{
+  if (!PdpStatsInternal_isValid(stage)) {
+    return NULL;
+  }
+  return PdpStatsInternal_stageNames[stage];
+}
+
+long long PdpStats_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + (long long)ts.tv_nsec;
+}
+
+void PdpStats_startStage(PdpStats_t* self, PdpStatsStage stage)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT(PdpStatsInternal_isValid(stage), "Invalid stage");
+  pthread_mutex_lock(&self->lock);
+  if (self->depth < PDP_STATS_MAX_DEPTH) {
+    self->started[self->depth] = stage;
+    self->starttime[self->depth] = PdpStats_now();
+  } else {
+    RAVE_WARNING0("Too many nested stages, stage will not be timed");
+  }
+  self->depth++;
+  pthread_mutex_unlock(&self->lock);
+}
+
+void PdpStats_stopStage(PdpStats_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  if (self->depth > 0) {
+    self->depth--;
+    if (self->depth < PDP_STATS_MAX_DEPTH) {
+      self->stages[self->started[self->depth]].duration += PdpStats_now() - self->starttime[self->depth];
+    }
+  }
+  pthread_mutex_unlock(&self->lock);
+}
+
+void PdpStats_addPixels(PdpStats_t* self, PdpStatsStage stage, long processed, long flagged)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT(PdpStatsInternal_isValid(stage), "Invalid stage");
+  pthread_mutex_lock(&self->lock);
+  self->stages[stage].processed += processed;
+  self->stages[stage].flagged += flagged;
+  pthread_mutex_unlock(&self->lock);
+}
+
+void PdpStats_addBytes(PdpStats_t* self, long bytes)
+{
+  PdpStatsStage stage = PdpStatsStage_TOTAL;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  if (self->depth > 0 && self->depth <= PDP_STATS_MAX_DEPTH) {
+    stage = self->started[self->depth - 1];
+  }
+  self->stages[stage].bytes += bytes;
+  pthread_mutex_unlock(&self->lock);
+}
+
+void PdpStats_addResidualFilterGate(PdpStats_t* self, double entropy, int applied)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  self->residualFilterEntropy += entropy;
+  if (applied) {
+    self->residualFilterApplied++;
+  } else {
+    self->residualFilterSkipped++;
+  }
+  pthread_mutex_unlock(&self->lock);
+}
+
+void PdpStats_merge(PdpStats_t* self, PdpStats_t* other)
+{
+  PdpStatsInternal_Stage stages[PdpStatsStage_NUMBER_OF_STAGES];
+  double residualFilterEntropy = 0.0;
+  long residualFilterApplied = 0, residualFilterSkipped = 0;
+  int i = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (other == NULL || other == self) {
+    return;
+  }
+  pthread_mutex_lock(&other->lock);
+  memcpy(stages, other->stages, sizeof(stages));
+  residualFilterEntropy = other->residualFilterEntropy;
+  residualFilterApplied = other->residualFilterApplied;
+  residualFilterSkipped = other->residualFilterSkipped;
+  pthread_mutex_unlock(&other->lock);
+
+  pthread_mutex_lock(&self->lock);
+  for (i = 0; i < PdpStatsStage_NUMBER_OF_STAGES; i++) {
+    self->stages[i].duration += stages[i].duration;
+    self->stages[i].processed += stages[i].processed;
+    self->stages[i].flagged += stages[i].flagged;
+    self->stages[i].bytes += stages[i].bytes;
+  }
+  self->residualFilterEntropy += residualFilterEntropy;
+  self->residualFilterApplied += residualFilterApplied;
+  self->residualFilterSkipped += residualFilterSkipped;
+  pthread_mutex_unlock(&self->lock);
+}
+
+double PdpStats_getDuration(PdpStats_t* self, PdpStatsStage stage)
+{
+  double result = 0.0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (PdpStatsInternal_isValid(stage)) {
+    pthread_mutex_lock(&self->lock);
+    result = (double)self->stages[stage].duration / 1000000.0;
+    pthread_mutex_unlock(&self->lock);
+  }
+  return result;
+}
+
+long PdpStats_getProcessedPixels(PdpStats_t* self, PdpStatsStage stage)
+{
+  long result = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (PdpStatsInternal_isValid(stage)) {
+    pthread_mutex_lock(&self->lock);
+    result = self->stages[stage].processed;
+    pthread_mutex_unlock(&self->lock);
+  }
+  return result;
+}
+
+long PdpStats_getFlaggedPixels(PdpStats_t* self, PdpStatsStage stage)
+{
+  long result = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (PdpStatsInternal_isValid(stage)) {
+    pthread_mutex_lock(&self->lock);
+    result = self->stages[stage].flagged;
+    pthread_mutex_unlock(&self->lock);
+  }
+  return result;
+}
+
+long PdpStats_getAllocatedBytes(PdpStats_t* self, PdpStatsStage stage)
+{
+  long result = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (PdpStatsInternal_isValid(stage)) {
+    pthread_mutex_lock(&self->lock);
+    result = self->stages[stage].bytes;
+    pthread_mutex_unlock(&self->lock);
+  }
+  return result;
+}
+
+long PdpStats_getResidualFilterApplied(PdpStats_t* self)
+{
+  long result = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  result = self->residualFilterApplied;
+  pthread_mutex_unlock(&self->lock);
+  return result;
+}
+
+long PdpStats_getResidualFilterSkipped(PdpStats_t* self)
+{
+  long result = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  result = self->residualFilterSkipped;
+  pthread_mutex_unlock(&self->lock);
+  return result;
+}
+
+double PdpStats_getResidualFilterEntropy(PdpStats_t* self)
+{
+  double result = 0.0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  if (self->residualFilterApplied + self->residualFilterSkipped > 0) {
+    result = self->residualFilterEntropy / (double)(self->residualFilterApplied + self->residualFilterSkipped);
+  }
+  pthread_mutex_unlock(&self->lock);
+  return result;
+}
+
+void PdpStats_print(PdpStats_t* self, FILE* fp, const char* prefix)
+{
+  int i = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (fp == NULL) {
+    return;
+  }
+  for (i = 0; i < PdpStatsStage_NUMBER_OF_STAGES; i++) {
+    fprintf(fp, "%s%-15s %10.3f ms, processed: %ld, flagged: %ld, allocated: %ld bytes\n",
+        (prefix != NULL) ? prefix : "",
+        PdpStatsInternal_stageNames[i],
+        PdpStats_getDuration(self, (PdpStatsStage)i),
+        PdpStats_getProcessedPixels(self, (PdpStatsStage)i),
+        PdpStats_getFlaggedPixels(self, (PdpStatsStage)i),
+        PdpStats_getAllocatedBytes(self, (PdpStatsStage)i));
+  }
+  fprintf(fp, "%sresidual filter applied: %ld, skipped: %ld, mask entropy: %g\n",
+      (prefix != NULL) ? prefix : "",
+      PdpStats_getResidualFilterApplied(self),
+      PdpStats_getResidualFilterSkipped(self),
+      PdpStats_getResidualFilterEntropy(self));
+}
+
+/*@} End of Interface functions */
+
+RaveCoreObjectType PdpStats_TYPE = {
+    "PdpStats",
+    sizeof(PdpStats_t),
+    PdpStats_constructor,
+    PdpStats_destructor,
+    PdpStats_copyconstructor
+};
@@ -0,0 +1,172 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of baltrad-ppc.
+
+baltrad-ppc is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+baltrad-ppc is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Statistics collected for each stage when processing a scan. For each stage the duration (monotonic clock),
+ * the number of processed and flagged pixels and the number of bytes in the fields allocated by the stage are kept.
+ * Durations of nested stages are included in the enclosing stage, e.g. the two pdp passes are included in the pdp script.
+ * The statistics object is thread safe so kernels running in several threads can report to the same object.
+ * This object supports \ref #RAVE_OBJECT_CLONE.
+ * @file
+ * @author agent <agent@local>
+ * @date 2026-10-16
+ */
+#ifndef PDP_STATS_H
+#define PDP_STATS_H
+#include "rave_object.h"
+#include <stdio.h>
+
+/**
+ * The stages that statistics are collected for
+ */
+typedef enum PdpStatsStage {
+  PdpStatsStage_PREPROCESS = 0,  /**< preprocessing threshold */
+  PdpStatsStage_TEXTURE,         /**< PHIDP and TH textures */
+  PdpStatsStage_CLUTTER_ID,      /**< clutter identification and quality threshold */
+  PdpStatsStage_RESIDUAL_FILTER, /**< residual clutter filter and mask */
+  PdpStatsStage_PDP_SCRIPT,      /**< PHIDP filtering and KDP retrieval */
+  PdpStatsStage_PDP_PASS1,       /**< first pass of the pdp script */
+  PdpStatsStage_PDP_PASS2,       /**< second pass of the pdp script */
+  PdpStatsStage_ATTENUATION,     /**< attenuation mask and correction */
+  PdpStatsStage_ZPHI,            /**< zphi attenuation correction */
+  PdpStatsStage_QUANTIZATION,    /**< quantization of the output fields */
+  PdpStatsStage_TOTAL,           /**< the complete processing */
+  PdpStatsStage_NUMBER_OF_STAGES /**< number of stages, not a stage */
+} PdpStatsStage;
+
+/**
+ * Defines the statistics
+ */
+typedef struct _PdpStats_t PdpStats_t;
+
+/**
+ * Type definition to use when creating a rave object.
+ */
+extern RaveCoreObjectType PdpStats_TYPE;
+
+/**
+ * @param[in] stage - the stage
+ * @return the name of the stage, e.g. "preprocess", or NULL if not a valid stage
+ */
+const char* PdpStats_getStageName(PdpStatsStage stage);
+
+/**
+ * @return the current time in nanoseconds from a monotonic clock
+ */
+long long PdpStats_now(void);
+
+/**
+ * Starts timing a stage. Stages can be nested and fields allocated while a stage is started are
+ * accounted to the innermost stage.
+ * @param[in] self - self
+ * @param[in] stage - the stage
+ */
+void PdpStats_startStage(PdpStats_t* self, PdpStatsStage stage);
+
+/**
+ * Stops timing the innermost started stage and adds the elapsed time to its duration.
+ * @param[in] self - self
+ */
+void PdpStats_stopStage(PdpStats_t* self);
+
+/**
+ * Adds pixel counts to a stage.
+ * @param[in] self - self
+ * @param[in] stage - the stage
+ * @param[in] processed - number of processed pixels
+ * @param[in] flagged - number of flagged pixels
+ */
+void PdpStats_addPixels(PdpStats_t* self, PdpStatsStage stage, long processed, long flagged);
+
+/**
+ * Adds allocated bytes to the innermost started stage. If no stage is started they are added to the total.
+ * @param[in] self - self
+ * @param[in] bytes - the number of bytes
+ */
+void PdpStats_addBytes(PdpStats_t* self, long bytes);
+
+/**
+ * Adds the outcome of the residual clutter filter gate for one scan.
+ * @param[in] self - self
+ * @param[in] entropy - the entropy of the thresholded residual clutter mask
+ * @param[in] applied - 1 if the residual clutter filter was applied, 0 if it was skipped
+ */
+void PdpStats_addResidualFilterGate(PdpStats_t* self, double entropy, int applied);
+
+/**
+ * Adds all statistics in other to self.
+ * @param[in] self - self
+ * @param[in] other - the statistics to add
+ */
+void PdpStats_merge(PdpStats_t* self, PdpStats_t* other);
+
+/**
+ * @param[in] self - self
+ * @param[in] stage - the stage
+ * @return the duration in milliseconds
+ */
+double PdpStats_getDuration(PdpStats_t* self, PdpStatsStage stage);
+
+/**
+ * @param[in] self - self
+ * @param[in] stage - the stage
+ * @return the number of processed pixels
+ */
+long PdpStats_getProcessedPixels(PdpStats_t* self, PdpStatsStage stage);
+
+/**
+ * @param[in] self - self
+ * @param[in] stage - the stage
+ * @return the number of flagged pixels
+ */
+long PdpStats_getFlaggedPixels(PdpStats_t* self, PdpStatsStage stage);
+
+/**
+ * @param[in] self - self
+ * @param[in] stage - the stage
+ * @return the number of bytes allocated
+ */
+long PdpStats_getAllocatedBytes(PdpStats_t* self, PdpStatsStage stage);
+
+/**
+ * @param[in] self - self
+ * @return the number of scans where the residual clutter filter was applied
+ */
+long PdpStats_getResidualFilterApplied(PdpStats_t* self);
+
+/**
+ * @param[in] self - self
+ * @return the number of scans where the residual clutter filter was skipped since the mask was too uniform
+ */
+long PdpStats_getResidualFilterSkipped(PdpStats_t* self);
+
+/**
+ * @param[in] self - self
+ * @return the mean entropy of the residual clutter masks over the scans, 0 if there are none
+ */
+double PdpStats_getResidualFilterEntropy(PdpStats_t* self);
+
+/**
+ * Prints the statistics, one line per stage followed by the residual clutter filter gate.
+ * @param[in] self - self
+ * @param[in] fp - the stream to print to
+ * @param[in] prefix - prefix of each line, may be NULL
+ */
+void PdpStats_print(PdpStats_t* self, FILE* fp, const char* prefix);
+
+#endif /* PDP_STATS_H */
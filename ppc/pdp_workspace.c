@@ -0,0 +1,228 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of baltrad-ppc.
+
+baltrad-ppc is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+baltrad-ppc is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Workspace that keeps scratch buffers between processing calls.
+ * This object does support \ref #RAVE_OBJECT_CLONE but the cloned workspace will be empty.
+ * @file
+ * @author agent <agent@local>
+ * @date 2026-10-16
+ */
+#include "pdp_workspace.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include "raveobject_list.h"
+#include <string.h>
+#include <pthread.h>
+
+/**
+ * Represents the workspace
+ */
+struct _PdpWorkspace_t {
+  RAVE_OBJECT_HEAD /** Always on top */
+  RaveObjectList_t* buffers; /**< the free buffers */
+  double nodata; /**< the nodata value of a new field */
+  pthread_mutex_t lock; /**< protects the free buffers */
+};
+
+/*@{ Private functions */
+/**
+ * Constructor
+ */
+static int PdpWorkspace_constructor(RaveCoreObject* obj)
+{
+  PdpWorkspace_t* this = (PdpWorkspace_t*)obj;
+  RaveData2D_t* field = RAVE_OBJECT_NEW(&RaveData2D_TYPE);
+  this->buffers = RAVE_OBJECT_NEW(&RaveObjectList_TYPE);
+  if (this->buffers == NULL || field == NULL) {
+    RAVE_OBJECT_RELEASE(this->buffers);
+    RAVE_OBJECT_RELEASE(field);
+    return 0;
+  }
+  this->nodata = RaveData2D_getNodata(field);
+  RAVE_OBJECT_RELEASE(field);
+  pthread_mutex_init(&this->lock, NULL);
+  return 1;
+}
+
+/**
+ * Copy constructor, the buffers are not copied
+ */
+static int PdpWorkspace_copyconstructor(RaveCoreObject* obj, RaveCoreObject* srcobj)
+{
+  return PdpWorkspace_constructor(obj);
+}
+
+/**
+ * Destructor
+ */
+static void PdpWorkspace_destructor(RaveCoreObject* obj)
+{
+  PdpWorkspace_t* this = (PdpWorkspace_t*)obj;
+  RAVE_OBJECT_RELEASE(this->buffers);
+  pthread_mutex_destroy(&this->lock);
+}
+
+/**
+ * Removes a free buffer with the specified geometry and type from the workspace.
+ * @param[in] self - self
+ * @param[in] xsize - number of bins
+ * @param[in] ysize - number of rays
+ * @param[in] type - the data type
+ * @return the buffer or NULL if there was no such buffer
+ */
+static RaveData2D_t* PdpWorkspaceInternal_take(PdpWorkspace_t* self, long xsize, long ysize, RaveDataType type)
+{
+  RaveData2D_t* result = NULL;
+  int i = 0, n = 0;
+
+  pthread_mutex_lock(&self->lock);
+  n = RaveObjectList_size(self->buffers);
+  for (i = n - 1; result == NULL && i >= 0; i--) {
+    RaveData2D_t* field = (RaveData2D_t*)RaveObjectList_get(self->buffers, i);
+    if (RaveData2D_getXsize(field) == xsize && RaveData2D_getYsize(field) == ysize && RaveData2D_getType(field) == type) {
+      result = (RaveData2D_t*)RaveObjectList_remove(self->buffers, i);
+    }
+    RAVE_OBJECT_RELEASE(field);
+  }
+  pthread_mutex_unlock(&self->lock);
+
+  return result;
+}
+
+/**
+ * Returns a field with the specified geometry, either a reused buffer or a new one.
+ * @param[in] self - self
+ * @param[in] xsize - number of bins
+ * @param[in] ysize - number of rays
+ * @param[in] type - the data type
+ * @param[in] v - the value to fill the field with
+ * @return the field or NULL on failure
+ */
+static RaveData2D_t* PdpWorkspaceInternal_get(PdpWorkspace_t* self, long xsize, long ysize, RaveDataType type, double v)
+{
+  RaveData2D_t* field = NULL;
+  long x = 0, y = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  field = PdpWorkspaceInternal_take(self, xsize, ysize, type);
+  if (field == NULL) {
+    return (v == 0.0) ? RaveData2D_zeros(xsize, ysize, type) : RaveData2D_ones(xsize, ysize, type);
+  }
+
+  RaveData2D_useNodata(field, 0);
+  RaveData2D_setNodata(field, self->nodata);
+  if (v == 0.0) {
+    memset(RaveData2D_getData(field), 0, get_ravetype_size(type) * xsize * ysize);
+  } else {
+    for (y = 0; y < ysize; y++) {
+      for (x = 0; x < xsize; x++) {
+        RaveData2D_setValueUnchecked(field, x, y, v);
+      }
+    }
+  }
+  return field;
+}
+
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+RaveData2D_t* PdpWorkspace_zeros(PdpWorkspace_t* self, long xsize, long ysize, RaveDataType type)
+{
+  return PdpWorkspaceInternal_get(self, xsize, ysize, type, 0.0);
+}
+
+RaveData2D_t* PdpWorkspace_ones(PdpWorkspace_t* self, long xsize, long ysize, RaveDataType type)
+{
+  return PdpWorkspaceInternal_get(self, xsize, ysize, type, 1.0);
+}
+
+void PdpWorkspace_recycle(PdpWorkspace_t* self, RaveData2D_t** field)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((field != NULL), "field == NULL");
+  if (*field != NULL && RAVE_OBJECT_REFCNT(*field) == 1 && RaveData2D_getData(*field) != NULL) {
+    pthread_mutex_lock(&self->lock);
+    if (!RaveObjectList_add(self->buffers, (RaveCoreObject*)*field)) {
+      RAVE_WARNING0("Failed to keep buffer in workspace");
+    }
+    pthread_mutex_unlock(&self->lock);
+  }
+  RAVE_OBJECT_RELEASE(*field);
+}
+
+void PdpWorkspace_trim(PdpWorkspace_t* self, long xsize, long ysize)
+{
+  int i = 0, n = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  n = RaveObjectList_size(self->buffers);
+  for (i = n - 1; i >= 0; i--) {
+    RaveData2D_t* field = (RaveData2D_t*)RaveObjectList_get(self->buffers, i);
+    if (RaveData2D_getXsize(field) != xsize || RaveData2D_getYsize(field) != ysize) {
+      RaveObjectList_release(self->buffers, i);
+    }
+    RAVE_OBJECT_RELEASE(field);
+  }
+  pthread_mutex_unlock(&self->lock);
+}
+
+void PdpWorkspace_clear(PdpWorkspace_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  RaveObjectList_clear(self->buffers);
+  pthread_mutex_unlock(&self->lock);
+}
+
+int PdpWorkspace_getNumberOfBuffers(PdpWorkspace_t* self)
+{
+  int result = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  result = RaveObjectList_size(self->buffers);
+  pthread_mutex_unlock(&self->lock);
+  return result;
+}
+
+long PdpWorkspace_getSize(PdpWorkspace_t* self)
+{
+  long result = 0;
+  int i = 0, n = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  pthread_mutex_lock(&self->lock);
+  n = RaveObjectList_size(self->buffers);
+  for (i = 0; i < n; i++) {
+    RaveData2D_t* field = (RaveData2D_t*)RaveObjectList_get(self->buffers, i);
+    result += RaveData2D_getXsize(field) * RaveData2D_getYsize(field) * get_ravetype_size(RaveData2D_getType(field));
+    RAVE_OBJECT_RELEASE(field);
+  }
+  pthread_mutex_unlock(&self->lock);
+  return result;
+}
+
+/*@} End of Interface functions */
+
+RaveCoreObjectType PdpWorkspace_TYPE = {
+    "PdpWorkspace",
+    sizeof(PdpWorkspace_t),
+    PdpWorkspace_constructor,
+    PdpWorkspace_destructor,
+    PdpWorkspace_copyconstructor
+};
@@ -0,0 +1,97 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of baltrad-ppc.
+
+baltrad-ppc is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+baltrad-ppc is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Workspace that keeps scratch buffers between processing calls so that scans and volumes with the same
+ * geometry (nbins x nrays) can be processed without allocating new buffers every time.
+ * The workspace is thread safe so it can be shared by scans that are processed concurrently.
+ * This object does support \ref #RAVE_OBJECT_CLONE but the cloned workspace will be empty.
+ * @file
+ * @author agent <agent@local>
+ * @date 2026-10-16
+ */
+#ifndef PDP_WORKSPACE_H
+#define PDP_WORKSPACE_H
+#include "rave_data2d.h"
+
+/**
+ * Defines a workspace
+ */
+typedef struct _PdpWorkspace_t PdpWorkspace_t;
+
+/**
+ * Type definition to use when creating a rave object.
+ */
+extern RaveCoreObjectType PdpWorkspace_TYPE;
+
+/**
+ * Returns a zero filled field with the specified geometry. If there is a free buffer in the workspace with
+ * the same geometry and type it will be reused, otherwise a new field is created. The field will not be using nodata.
+ * @param[in] self - self
+ * @param[in] xsize - number of bins
+ * @param[in] ysize - number of rays
+ * @param[in] type - the data type
+ * @return the field or NULL on failure
+ */
+RaveData2D_t* PdpWorkspace_zeros(PdpWorkspace_t* self, long xsize, long ysize, RaveDataType type);
+
+/**
+ * Same as \ref PdpWorkspace_zeros but the field is filled with 1.
+ * @param[in] self - self
+ * @param[in] xsize - number of bins
+ * @param[in] ysize - number of rays
+ * @param[in] type - the data type
+ * @return the field or NULL on failure
+ */
+RaveData2D_t* PdpWorkspace_ones(PdpWorkspace_t* self, long xsize, long ysize, RaveDataType type);
+
+/**
+ * Gives the field back to the workspace and releases the callers reference. The field is only kept
+ * if nobody else is referencing it, otherwise it is just released. *field will be NULL after this call.
+ * @param[in] self - self
+ * @param[in,out] field - the field to give back
+ */
+void PdpWorkspace_recycle(PdpWorkspace_t* self, RaveData2D_t** field);
+
+/**
+ * Releases all free buffers that does not have the specified geometry.
+ * @param[in] self - self
+ * @param[in] xsize - number of bins to keep
+ * @param[in] ysize - number of rays to keep
+ */
+void PdpWorkspace_trim(PdpWorkspace_t* self, long xsize, long ysize);
+
+/**
+ * Releases all free buffers.
+ * @param[in] self - self
+ */
+void PdpWorkspace_clear(PdpWorkspace_t* self);
+
+/**
+ * @param[in] self - self
+ * @return the number of free buffers kept by the workspace
+ */
+int PdpWorkspace_getNumberOfBuffers(PdpWorkspace_t* self);
+
+/**
+ * @param[in] self - self
+ * @return the number of bytes in the free buffers kept by the workspace
+ */
+long PdpWorkspace_getSize(PdpWorkspace_t* self);
+
+#endif /* PDP_WORKSPACE_H */
@@ -233,6 +233,27 @@ static int PpcOptionsInternal_setRequestedFields(SimpleXmlNode_t* child, PpcRada
   return result;
 }
 
+static int PpcOptionsInternal_setProcessingPrecision(SimpleXmlNode_t* child, PpcRadarOptions_t* options, RaveObjectHashTable_t* tagNames, const char* name)
+{
+  int result = 0;
+  const char* value = SimpleXmlNode_getAttribute(child, "value");
+  if (value != NULL) {
+    if (strcasecmp("double", value) == 0) {
+      PpcRadarOptions_setProcessingPrecision(options, RaveDataType_DOUBLE);
+      result = 1;
+    } else if (strcasecmp("float", value) == 0) {
+      PpcRadarOptions_setProcessingPrecision(options, RaveDataType_FLOAT);
+      result = 1;
+    } else {
+      RAVE_ERROR1("Unknown processing precision: %s, must be double or float", value);
+    }
+    if (result) {
+      PpcOptionsInternal_addTagName(tagNames, name);
+    }
+  }
+  return result;
+}
+
 static int PpcOptionsInternal_setDoubleFun(SimpleXmlNode_t* child, PpcRadarOptions_t* options, RaveObjectHashTable_t* tagNames, const char* name, void (*doublefun)(PpcRadarOptions_t*, double))
 {
   int result = 0;
@@ -251,6 +272,51 @@ done:
   return result;
 }
 
+static int PpcOptionsInternal_setOutputScaling(SimpleXmlNode_t* child, PpcRadarOptions_t* options)
+{
+  int result = 0;
+  int type = RaveDataType_UCHAR;
+  double gain = 0.0, offset = 0.0;
+  const char* quantity = SimpleXmlNode_getAttribute(child, "quantity");
+  const char* typestr = SimpleXmlNode_getAttribute(child, "type");
+  const char* gainstr = SimpleXmlNode_getAttribute(child, "gain");
+  const char* offsetstr = SimpleXmlNode_getAttribute(child, "offset");
+
+  if (quantity == NULL) {
+    RAVE_ERROR0("outputScaling must have a quantity");
+    goto done;
+  }
+  if (typestr != NULL) {
+    if (strcasecmp("uchar", typestr) == 0) {
+      type = RaveDataType_UCHAR;
+    } else if (strcasecmp("ushort", typestr) == 0) {
+      type = RaveDataType_USHORT;
+    } else if (strcasecmp("float", typestr) == 0) {
+      type = RaveDataType_FLOAT;
+    } else if (strcasecmp("double", typestr) == 0) {
+      type = RaveDataType_DOUBLE;
+    } else {
+      RAVE_ERROR1("Unknown output type: %s, must be uchar, ushort, float or double", typestr);
+      goto done;
+    }
+  }
+  if (type == RaveDataType_FLOAT || type == RaveDataType_DOUBLE) {
+    result = PpcRadarOptions_setOutputScaling(options, quantity, type, 1.0, 0.0);
+    goto done;
+  }
+  if (gainstr == NULL || offsetstr == NULL) {
+    RAVE_ERROR0("outputScaling must have gain and offset for uchar and ushort");
+    goto done;
+  }
+  if (sscanf(gainstr, "%lf", &gain) != 1 || sscanf(offsetstr, "%lf", &offset) != 1) {
+    RAVE_ERROR0("Failed to parse gain or offset");
+    goto done;
+  }
+  result = PpcRadarOptions_setOutputScaling(options, quantity, type, gain, offset);
+done:
+  return result;
+}
+
 //static int PpcOptionsInternal_setStringFun(SimpleXmlNode_t* child, PpcRadarOptions_t* options, RaveObjectHashTable_t* tagNames, const char* name, int (*stringfun)(PpcRadarOptions_t*, const char*))
 //{
 //  int result = 0;
@@ -349,6 +415,12 @@ static PpcRadarOptions_t* PpcOptionsInternal_createRadarOptionsFromNode(PpcOptio
       } else if (strcasecmp("residualFilterRaySize", nodeName) == 0 &&
                  !PpcOptionsInternal_setLongFun(child, options, tagNames, nodeName, PpcRadarOptions_setResidualFilterRaySize)) {
           RAVE_ERROR0("Failed to set residualFilterRaySize in radar options");
+      } else if (strcasecmp("textureBinSize", nodeName) == 0 &&
+                 !PpcOptionsInternal_setLongFun(child, options, tagNames, nodeName, PpcRadarOptions_setTextureBinSize)) {
+          RAVE_ERROR0("Failed to set textureBinSize in radar options");
+      } else if (strcasecmp("textureRaySize", nodeName) == 0 &&
+                 !PpcOptionsInternal_setLongFun(child, options, tagNames, nodeName, PpcRadarOptions_setTextureRaySize)) {
+          RAVE_ERROR0("Failed to set textureRaySize in radar options");
       } else if (strcasecmp("minZMedfilterThreshold", nodeName) == 0 &&
                  !PpcOptionsInternal_setDoubleFun(child, options, tagNames, nodeName, PpcRadarOptions_setMinZMedfilterThreshold)) {
           RAVE_ERROR0("Failed to set minZMedfilterThreshold in radar options");
@@ -409,6 +481,15 @@ static PpcRadarOptions_t* PpcOptionsInternal_createRadarOptionsFromNode(PpcOptio
       } else if (strcasecmp("invertPHIDP", nodeName) == 0 &&
           !PpcOptionsInternal_setIntFun(child, options, tagNames, nodeName, PpcRadarOptions_setInvertPHIDP)) {
           RAVE_ERROR0("Failed to set invertPHIDP in radar options");
+      } else if (strcasecmp("numberOfThreads", nodeName) == 0 &&
+                 !PpcOptionsInternal_setLongFun(child, options, tagNames, nodeName, PpcRadarOptions_setNumberOfThreads)) {
+          RAVE_ERROR0("Failed to set numberOfThreads in radar options");
+      } else if (strcasecmp("processingPrecision", nodeName) == 0 &&
+                 !PpcOptionsInternal_setProcessingPrecision(child, options, tagNames, nodeName)) {
+          RAVE_ERROR0("Failed to set processingPrecision in radar options");
+      } else if (strcasecmp("outputScaling", nodeName) == 0 &&
+                 !PpcOptionsInternal_setOutputScaling(child, options)) {
+          RAVE_ERROR0("Failed to set outputScaling in radar options");
       }
     }
 
@@ -432,7 +513,7 @@ void PpcOptionsInternal_moveParameterValues(PpcRadarOptions_t* options, PpcRadar
 
 int PpcOptionsInternal_merge(PpcOptions_t* self, PpcRadarOptions_t* options, PpcRadarOptions_t* other)
 {
-  int result = 0;
+  int result = 0, i = 0;
   RaveObjectHashTable_t* optionTagNames = NULL;
   RAVE_ASSERT((self != NULL), "self == NULL");
   RAVE_ASSERT((options != NULL), "options == NULL");
@@ -496,6 +577,12 @@ int PpcOptionsInternal_merge(PpcOptions_t* self, PpcRadarOptions_t* options, Ppc
     if (!RaveObjectHashTable_exists(optionTagNames, "residualFilterRaySize")) {
       PpcRadarOptions_setResidualFilterRaySize(options, PpcRadarOptions_getResidualFilterRaySize(other));
     }
+    if (!RaveObjectHashTable_exists(optionTagNames, "textureBinSize")) {
+      PpcRadarOptions_setTextureBinSize(options, PpcRadarOptions_getTextureBinSize(other));
+    }
+    if (!RaveObjectHashTable_exists(optionTagNames, "textureRaySize")) {
+      PpcRadarOptions_setTextureRaySize(options, PpcRadarOptions_getTextureRaySize(other));
+    }
     if (!RaveObjectHashTable_exists(optionTagNames, "minZMedfilterThreshold")) {
       PpcRadarOptions_setMinZMedfilterThreshold(options, PpcRadarOptions_getMinZMedfilterThreshold(other));
     }
@@ -556,6 +643,22 @@ int PpcOptionsInternal_merge(PpcOptions_t* self, PpcRadarOptions_t* options, Ppc
     if (!RaveObjectHashTable_exists(optionTagNames, "invertPHIDP")) {
       PpcRadarOptions_setInvertPHIDP(options, PpcRadarOptions_getInvertPHIDP(other));
     }
+    if (!RaveObjectHashTable_exists(optionTagNames, "numberOfThreads")) {
+      PpcRadarOptions_setNumberOfThreads(options, PpcRadarOptions_getNumberOfThreads(other));
+    }
+    if (!RaveObjectHashTable_exists(optionTagNames, "processingPrecision")) {
+      PpcRadarOptions_setProcessingPrecision(options, PpcRadarOptions_getProcessingPrecision(other));
+    }
+    /* The output scalings are merged per quantity */
+    for (i = 0; i < PpcRadarOptions_getNumberOfOutputScalings(other); i++) {
+      const char* quantity = PpcRadarOptions_getOutputScalingQuantity(other, i);
+      int type = 0;
+      double gain = 0.0, offset = 0.0;
+      if (!PpcRadarOptions_getOutputScaling(options, quantity, NULL, NULL, NULL) &&
+          PpcRadarOptions_getOutputScaling(other, quantity, &type, &gain, &offset)) {
+        PpcRadarOptions_setOutputScaling(options, quantity, type, gain, offset);
+      }
+    }
   }
   RAVE_OBJECT_RELEASE(optionTagNames);
   return result;
@@ -33,6 +33,26 @@ along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
 #include <sys/time.h>
 #include "pdp_processor.h"
 
+/**
+ * Max number of output quantities that can have a fixed scaling
+ */
+#define PPC_RADAR_OPTIONS_MAX_OUTPUT_SCALINGS 16
+
+/**
+ * Max length of the quantity of an output scaling including the terminating 0
+ */
+#define PPC_RADAR_OPTIONS_MAX_QUANTITY_LENGTH 64
+
+/**
+ * A fixed scaling of an output quantity
+ */
+typedef struct PpcRadarOptionsInternal_OutputScaling {
+  char quantity[PPC_RADAR_OPTIONS_MAX_QUANTITY_LENGTH]; /**< the quantity or how/task */
+  int type; /**< the data type */
+  double gain; /**< the gain */
+  double offset; /**< the offset */
+} PpcRadarOptionsInternal_OutputScaling;
+
 /**
  * The radar options class
  */
@@ -58,6 +78,8 @@ struct _PpcRadarOptions_t {
   double residualClutterTextureFilteringMaxZ; /**< Max Z value when creating the residual clutter mask, anything higher will be set to min value */
   long residualFilterBinSize; /**< number of bins used in the window when creating the residual mask */
   long residualFilterRaySize; /**< number of rays used in the window when creating the residual mask */
+  long textureBinSize; /**< number of bins in the texture window, an even size is increased by one */
+  long textureRaySize; /**< number of rays in the texture window, an even size is increased by one */
 
   double minZMedfilterThreshold; /**< min z threshold used in the median filter that is used by the residual clutter filter */
   double processingTextureThreshold; /**< threshold for the texture created in the pdp processing*/
@@ -79,10 +101,14 @@ struct _PpcRadarOptions_t {
   double attenuationAlpha;  /**< alpha value used in the attenuation */
   double attenuationPIAminZ; /**< min PIA Z value in attenuation process */
   int invertPHIDP; /**< If PHIDP should be inverted or not */
+  long numberOfThreads; /**< number of threads to use when processing a scan */
+  int processingPrecision; /**< the data type used for the fields in the processing chain */
 
   double meltingLayerBottomHeight; /**< the default melting layer bottom height */
   long meltingLayerHourThreshold; /**< number of hours before default height is used */
   int requestedFieldMask; /**< the fields that should be added to the result */
+  PpcRadarOptionsInternal_OutputScaling outputScalings[PPC_RADAR_OPTIONS_MAX_OUTPUT_SCALINGS]; /**< the fixed output scalings */
+  int nOutputScalings; /**< number of fixed output scalings */
 };
 //                                          Weight | X2   |  X3  | Delta1  | Delta2
 // X1=X2-Delta1, X3=X4-Delta2
@@ -120,6 +146,8 @@ static int PpcRadarOptions_constructor(RaveCoreObject* obj)
   options->residualThresholdTexture = 20.0;
   options->residualFilterBinSize = 1;
   options->residualFilterRaySize = 1;
+  options->textureBinSize = 3;
+  options->textureRaySize = 3;
   options->residualClutterTextureFilteringMaxZ = 70.0;
 
   options->minZMedfilterThreshold = -30.0;
@@ -144,8 +172,11 @@ static int PpcRadarOptions_constructor(RaveCoreObject* obj)
   options->meltingLayerHourThreshold = 6;
 
   options->invertPHIDP = 0;
+  options->numberOfThreads = 1;
+  options->processingPrecision = RaveDataType_DOUBLE;
 
   options->requestedFieldMask = PpcRadarOptions_DBZH_CORR|PpcRadarOptions_ATT_DBZH_CORR|PpcRadarOptions_PHIDP_CORR|PpcRadarOptions_QUALITY_RESIDUAL_CLUTTER_MASK;
+  options->nOutputScalings = 0;
 
   return 1;
 }
@@ -185,6 +216,8 @@ static int PpcRadarOptions_copyconstructor(RaveCoreObject* obj, RaveCoreObject*
   this->residualThresholdTexture = src->residualThresholdTexture;
   this->residualFilterBinSize = src->residualFilterBinSize;
   this->residualFilterRaySize = src->residualFilterRaySize;
+  this->textureBinSize = src->textureBinSize;
+  this->textureRaySize = src->textureRaySize;
 
   this->minZMedfilterThreshold = src->minZMedfilterThreshold;
   this->processingTextureThreshold = src->processingTextureThreshold;
@@ -210,8 +243,12 @@ static int PpcRadarOptions_copyconstructor(RaveCoreObject* obj, RaveCoreObject*
   this->meltingLayerHourThreshold = src->meltingLayerHourThreshold;
 
   this->invertPHIDP = src->invertPHIDP;
+  this->numberOfThreads = src->numberOfThreads;
+  this->processingPrecision = src->processingPrecision;
 
   this->requestedFieldMask = src->requestedFieldMask;
+  memcpy(this->outputScalings, src->outputScalings, sizeof(src->outputScalings));
+  this->nOutputScalings = src->nOutputScalings;
 
   this->name = NULL;
   this->defaultName = NULL;
@@ -236,6 +273,24 @@ done:
   return 0;
 }
 
+/**
+ * @param[in] self - self
+ * @param[in] quantity - the quantity
+ * @returns the index of the output scaling for the quantity or -1 if there is none
+ */
+static int PpcRadarOptionsInternal_findOutputScaling(PpcRadarOptions_t* self, const char* quantity)
+{
+  int i = 0;
+  if (quantity != NULL) {
+    for (i = 0; i < self->nOutputScalings; i++) {
+      if (strcmp(self->outputScalings[i].quantity, quantity) == 0) {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
 /*@} End of Private functions */
 
 /*@{ Interface functions */
@@ -818,6 +873,143 @@ int PpcRadarOptions_getInvertPHIDP(PpcRadarOptions_t* self)
   RAVE_ASSERT((self != NULL), "self == NULL");
   return self->invertPHIDP;
 }
+
+void PpcRadarOptions_setNumberOfThreads(PpcRadarOptions_t* self, long v)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (v < 1) {
+    self->numberOfThreads = 1;
+  } else {
+    self->numberOfThreads = v;
+  }
+}
+
+long PpcRadarOptions_getNumberOfThreads(PpcRadarOptions_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->numberOfThreads;
+}
+
+void PpcRadarOptions_setProcessingPrecision(PpcRadarOptions_t* self, int v)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (v == RaveDataType_DOUBLE || v == RaveDataType_FLOAT) {
+    self->processingPrecision = v;
+  } else {
+    RAVE_WARNING0("Only RaveDataType_DOUBLE and RaveDataType_FLOAT can be used as processing precision");
+  }
+}
+
+int PpcRadarOptions_getProcessingPrecision(PpcRadarOptions_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->processingPrecision;
+}
+
+void PpcRadarOptions_setTextureBinSize(PpcRadarOptions_t* self, long v)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->textureBinSize = v;
+}
+
+long PpcRadarOptions_getTextureBinSize(PpcRadarOptions_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->textureBinSize;
+}
+
+void PpcRadarOptions_setTextureRaySize(PpcRadarOptions_t* self, long v)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->textureRaySize = v;
+}
+
+long PpcRadarOptions_getTextureRaySize(PpcRadarOptions_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->textureRaySize;
+}
+
+int PpcRadarOptions_setOutputScaling(PpcRadarOptions_t* self, const char* quantity, int type, double gain, double offset)
+{
+  int index = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (quantity == NULL || strlen(quantity) >= PPC_RADAR_OPTIONS_MAX_QUANTITY_LENGTH) {
+    RAVE_ERROR0("Quantity must be given and shorter than 64 characters");
+    return 0;
+  }
+  if (type == RaveDataType_FLOAT || type == RaveDataType_DOUBLE) {
+    gain = 1.0;
+    offset = 0.0;
+  } else if (type != RaveDataType_UCHAR && type != RaveDataType_USHORT) {
+    RAVE_ERROR0("Only RaveDataType_UCHAR, RaveDataType_USHORT, RaveDataType_FLOAT and RaveDataType_DOUBLE can be used as output type");
+    return 0;
+  }
+  if (gain == 0.0) {
+    RAVE_ERROR0("Gain must not be 0.0");
+    return 0;
+  }
+  index = PpcRadarOptionsInternal_findOutputScaling(self, quantity);
+  if (index < 0) {
+    if (self->nOutputScalings >= PPC_RADAR_OPTIONS_MAX_OUTPUT_SCALINGS) {
+      RAVE_ERROR0("Too many output scalings");
+      return 0;
+    }
+    index = self->nOutputScalings++;
+    strcpy(self->outputScalings[index].quantity, quantity);
+  }
+  self->outputScalings[index].type = type;
+  self->outputScalings[index].gain = gain;
+  self->outputScalings[index].offset = offset;
+  return 1;
+}
+
+int PpcRadarOptions_getOutputScaling(PpcRadarOptions_t* self, const char* quantity, int* type, double* gain, double* offset)
+{
+  int index = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  index = PpcRadarOptionsInternal_findOutputScaling(self, quantity);
+  if (index < 0) {
+    return 0;
+  }
+  if (type != NULL) {
+    *type = self->outputScalings[index].type;
+  }
+  if (gain != NULL) {
+    *gain = self->outputScalings[index].gain;
+  }
+  if (offset != NULL) {
+    *offset = self->outputScalings[index].offset;
+  }
+  return 1;
+}
+
+void PpcRadarOptions_removeOutputScaling(PpcRadarOptions_t* self, const char* quantity)
+{
+  int index = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  index = PpcRadarOptionsInternal_findOutputScaling(self, quantity);
+  if (index >= 0) {
+    memmove(&self->outputScalings[index], &self->outputScalings[index + 1],
+        sizeof(PpcRadarOptionsInternal_OutputScaling) * (self->nOutputScalings - index - 1));
+    self->nOutputScalings--;
+  }
+}
+
+int PpcRadarOptions_getNumberOfOutputScalings(PpcRadarOptions_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->nOutputScalings;
+}
+
+const char* PpcRadarOptions_getOutputScalingQuantity(PpcRadarOptions_t* self, int index)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (index < 0 || index >= self->nOutputScalings) {
+    return NULL;
+  }
+  return self->outputScalings[index].quantity;
+}
 /*@} End of Interface functions */
 
 RaveCoreObjectType PpcRadarOptions_TYPE = {
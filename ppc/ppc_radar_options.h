@@ -19,6 +19,8 @@ along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
 /**
  * Keeps one radar options setup
  * This object does support \ref #RAVE_OBJECT_CLONE.
+ * The options are not synchronized. They can be read from several threads at the same time but must not be
+ * modified while a processor using them is running, clone the options if another setup is needed.
  * @file
  * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
  * @date 2019-05-13
@@ -664,4 +666,104 @@ void PpcRadarOptions_setInvertPHIDP(PpcRadarOptions_t* self, int v);
  */
 int PpcRadarOptions_getInvertPHIDP(PpcRadarOptions_t* self);
 
+/**
+ * Sets the number of threads that should be used when processing a scan. The rays are split into blocks that are
+ * processed in parallel. The result will be identical regardless of number of threads used. Values < 1 will be set to 1.
+ * @param[in] self - self
+ * @param[in] v - the value
+ */
+void PpcRadarOptions_setNumberOfThreads(PpcRadarOptions_t* self, long v);
+
+/**
+ * @returns the number of threads that should be used when processing a scan. Default is 1.
+ * @param[in] self - self
+ */
+long PpcRadarOptions_getNumberOfThreads(PpcRadarOptions_t* self);
+
+/**
+ * Sets the precision of the fields in the processing chain. Only RaveDataType_DOUBLE and RaveDataType_FLOAT are allowed.
+ * @param[in] self - self
+ * @param[in] v - the value
+ */
+void PpcRadarOptions_setProcessingPrecision(PpcRadarOptions_t* self, int v);
+
+/**
+ * @returns the precision of the fields in the processing chain, RaveDataType_DOUBLE or RaveDataType_FLOAT
+ * @param[in] self - self
+ */
+int PpcRadarOptions_getProcessingPrecision(PpcRadarOptions_t* self);
+
+/**
+ * Sets the number of bins in the texture window, an even size is increased by one
+ * @param[in] self - self
+ * @param[in] v - the value
+ */
+void PpcRadarOptions_setTextureBinSize(PpcRadarOptions_t* self, long v);
+
+/**
+ * @returns the number of bins in the texture window, an even size is increased by one
+ * @param[in] self - self
+ */
+long PpcRadarOptions_getTextureBinSize(PpcRadarOptions_t* self);
+
+/**
+ * Sets the number of rays in the texture window, an even size is increased by one
+ * @param[in] self - self
+ * @param[in] v - the value
+ */
+void PpcRadarOptions_setTextureRaySize(PpcRadarOptions_t* self, long v);
+
+/**
+ * @returns the number of rays in the texture window, an even size is increased by one
+ * @param[in] self - self
+ */
+long PpcRadarOptions_getTextureRaySize(PpcRadarOptions_t* self);
+
+/**
+ * Sets a fixed scaling for an output quantity (e.g. TH_CORR) or quality field (how/task). The field is then quantized
+ * with the given gain and offset in one pass instead of being spread over 0 - 254 by the min and max of each scan.
+ * The values are rounded to the nearest raw value and valid values are clamped to 1 - (nodata - 1), 0 is only undetect.
+ * Nodata is the max value of the type, 255 or 65535. Quantities without a fixed scaling are scaled by their min and max.
+ * With RaveDataType_FLOAT or RaveDataType_DOUBLE the values are not quantized at all, gain and offset are ignored
+ * and stored as 1 and 0 and nodata (also used as undetect) is the nodata of the processed field.
+ * @param[in] self - self
+ * @param[in] quantity - the quantity or how/task
+ * @param[in] type - RaveDataType_UCHAR, RaveDataType_USHORT, RaveDataType_FLOAT or RaveDataType_DOUBLE
+ * @param[in] gain - the gain, must not be 0 for the integer types
+ * @param[in] offset - the offset
+ * @returns 1 on success otherwise 0
+ */
+int PpcRadarOptions_setOutputScaling(PpcRadarOptions_t* self, const char* quantity, int type, double gain, double offset);
+
+/**
+ * Returns the fixed scaling of an output quantity.
+ * @param[in] self - self
+ * @param[in] quantity - the quantity or how/task
+ * @param[out] type - the data type, may be NULL
+ * @param[out] gain - the gain, may be NULL
+ * @param[out] offset - the offset, may be NULL
+ * @returns 1 if the quantity has a fixed scaling otherwise 0
+ */
+int PpcRadarOptions_getOutputScaling(PpcRadarOptions_t* self, const char* quantity, int* type, double* gain, double* offset);
+
+/**
+ * Removes the fixed scaling of an output quantity so that it is scaled by its min and max again.
+ * @param[in] self - self
+ * @param[in] quantity - the quantity or how/task
+ */
+void PpcRadarOptions_removeOutputScaling(PpcRadarOptions_t* self, const char* quantity);
+
+/**
+ * @param[in] self - self
+ * @returns the number of quantities with a fixed scaling
+ */
+int PpcRadarOptions_getNumberOfOutputScalings(PpcRadarOptions_t* self);
+
+/**
+ * @param[in] self - self
+ * @param[in] index - the index
+ * @returns the quantity of the fixed scaling at index or NULL if index is out of bounds
+ */
+const char* PpcRadarOptions_getOutputScalingQuantity(PpcRadarOptions_t* self, int index);
+
 #endif /* PPC_RADAR_OPTIONS_H_ */
@@ -89,6 +89,38 @@ class ppc_quality_plugin(rave_quality_plugin):
   def getQualityFields(self):
     return ["se.baltrad.ppc.residual_clutter_mask"]
   
+  ##
+  # @param scan: The scan
+  # @return the ATT_DBZH_CORR that the scan has before processing or None
+  def existing_att_dbzh_corr(self, scan):
+    return scan.getParameter("ATT_DBZH_CORR") if scan.hasParameter("ATT_DBZH_CORR") else None
+
+  ##
+  # Takes the ATT_DBZH_CORR added by the processor out of the scan, restores the one the scan had before
+  # processing and adds the processed one as DBZH unless only analyzing.
+  # @param scan: The processed scan
+  # @param existing: The ATT_DBZH_CORR from \ref existing_att_dbzh_corr
+  # @param quality_control_mode: The quality control mode
+  def apply_att_dbzh_corr(self, scan, existing, quality_control_mode):
+    f = scan.getParameter("ATT_DBZH_CORR")
+    scan.removeParameter("ATT_DBZH_CORR")
+    if existing is not None:
+      scan.addParameter(existing)
+    if quality_control_mode != QUALITY_CONTROL_MODE_ANALYZE:
+      f.quantity = "DBZH"
+      scan.addParameter(f)
+
+  ##
+  # Processes the scan in place, the residual clutter mask is added to the scan and ATT_DBZH_CORR is
+  # added as DBZH unless only analyzing. Any existing ATT_DBZH_CORR in the scan is kept as it is.
+  # @param processor: The pdp processor
+  # @param scan: The scan
+  # @param quality_control_mode: The quality control mode
+  def process_scan(self, processor, scan, quality_control_mode):
+    existing = self.existing_att_dbzh_corr(scan)
+    processor.processInPlace(scan)
+    self.apply_att_dbzh_corr(scan, existing, quality_control_mode)
+
   ##
   # @param obj: A rave object that should be processed.
   # @param reprocess_quality_flag: If the quality fields should be reprocessed or not.
@@ -111,13 +143,10 @@ class ppc_quality_plugin(rave_quality_plugin):
                 processor.meltingLayerBottomHeight = latest.bottom
             except Exception as e:
               logger.error("Failed to determine melting layer bottom height: "%e.__str__())
-          processor.options.requestedFields = processor.options.requestedFields | _ppcradaroptions.P_DBZH_CORR | _ppcradaroptions.P_ATT_DBZH_CORR | _ppcradaroptions.Q_RESIDUAL_CLUTTER_MASK
-          result = processor.process(obj)
-          obj.addOrReplaceQualityField(result.getQualityFieldByHowTask("se.baltrad.ppc.residual_clutter_mask"))
-          if quality_control_mode != QUALITY_CONTROL_MODE_ANALYZE:
-            f = result.getParameter("ATT_DBZH_CORR")
-            f.quantity = "DBZH"
-            obj.addParameter(f)
+          # Only the residual clutter mask and the attenuated DBZH are used, requesting anything else would
+          # just make the processor run stages that are thrown away (like zphi).
+          processor.options.requestedFields = _ppcradaroptions.P_ATT_DBZH_CORR | _ppcradaroptions.Q_RESIDUAL_CLUTTER_MASK
+          self.process_scan(processor, obj, quality_control_mode)
           
         elif _polarvolume.isPolarVolume(obj):
           nod, options = self.get_options(obj)
@@ -131,21 +160,29 @@ class ppc_quality_plugin(rave_quality_plugin):
             except Exception as e:
               logger.error("Failed to determine melting layer bottom height: "%e.__str__())
           
-          for i in range(obj.getNumberOfScans()):
-            scan = obj.getScan(i)
-            if reprocess_quality_flag == False and scan.findQualityFieldByHowTask("se.baltrad.ppc.residual_clutter_mask") != None:
-              continue
-            processor = _pdpprocessor.new()
-            processor.options = options
-            if meltingLayer is not None:
-              processor.meltingLayerBottomHeight = meltingLayer
-            processor.options.requestedFields = processor.options.requestedFields | _ppcradaroptions.P_DBZH_CORR | _ppcradaroptions.P_ATT_DBZH_CORR | _ppcradaroptions.Q_RESIDUAL_CLUTTER_MASK
-            result = processor.process(scan)
-            scan.addOrReplaceQualityField(result.getQualityFieldByHowTask("se.baltrad.ppc.residual_clutter_mask"))
-            if quality_control_mode != QUALITY_CONTROL_MODE_ANALYZE:
-              f = result.getParameter("ATT_DBZH_CORR")
-              f.quantity = "DBZH"
-              scan.addParameter(f)
+          scans = [obj.getScan(i) for i in range(obj.getNumberOfScans())]
+          if reprocess_quality_flag == False:
+            scans = [s for s in scans if s.findQualityFieldByHowTask("se.baltrad.ppc.residual_clutter_mask") == None]
+          if len(scans) == 0:
+            return obj
+
+          processor = _pdpprocessor.new()
+          processor.options = options
+          if meltingLayer is not None:
+            processor.meltingLayerBottomHeight = meltingLayer
+          # Only the residual clutter mask and the attenuated DBZH are used, requesting anything else would
+          # just make the processor run stages that are thrown away (like zphi).
+          processor.options.requestedFields = _ppcradaroptions.P_ATT_DBZH_CORR | _ppcradaroptions.Q_RESIDUAL_CLUTTER_MASK
+
+          if len(scans) == obj.getNumberOfScans():
+            # All scans are processed concurrently and the products are added to the scans in the volume
+            existing = [self.existing_att_dbzh_corr(s) for s in scans]
+            processor.processVolume(obj)
+            for scan, e in zip(scans, existing):
+              self.apply_att_dbzh_corr(scan, e, quality_control_mode)
+          else:
+            for scan in scans:
+              self.process_scan(processor, scan, quality_control_mode)
       except:
         logger.exception("Failed to generate baltrad-ppc field")
 
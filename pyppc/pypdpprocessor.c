@@ -33,6 +33,8 @@ along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
 #include "pypdpprocessor.h"
 #include "pyppcradaroptions.h"
 #include "pypolarscan.h"
+#include "pypolarvolume.h"
+#include "raveobject_list.h"
 #include "pyrave_debug.h"
 #include "rave_alloc.h"
 
@@ -168,7 +170,9 @@ static PyObject* _pypdpprocessor_texture(PyPdpProcessor* self, PyObject* args)
     raiseException_returnNULL(PyExc_AttributeError, "To create texture, nodata must be set");
   }
 
+  Py_BEGIN_ALLOW_THREADS
   tresult = PdpProcessor_texture(self->processor, ((PyRaveData2D*)pyin)->field);
+  Py_END_ALLOW_THREADS
   if (tresult == NULL) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to generate a texture");
   }
@@ -178,6 +182,83 @@ static PyObject* _pypdpprocessor_texture(PyPdpProcessor* self, PyObject* args)
   return result;
 }
 
+/**
+ * See \ref PdpProcessor_textures
+ * @param[in] self - self
+ * @param[in] args - a list of fields
+ * @return a list of textures on success otherwise NULL
+ */
+static PyObject* _pypdpprocessor_textures(PyPdpProcessor* self, PyObject* args)
+{
+  PyObject *pyfields = NULL, *pyresult = NULL;
+  RaveData2D_t** fields = NULL;
+  RaveData2D_t** textures = NULL;
+  Py_ssize_t i = 0, n = 0;
+  int ok = 0;
+
+  if (!PyArg_ParseTuple(args, "O", &pyfields))
+    return NULL;
+  if (!PySequence_Check(pyfields)) {
+    raiseException_returnNULL(PyExc_AttributeError, "Inparameter must be a list of RaveData2DCore");
+  }
+  n = PySequence_Size(pyfields);
+  if (n <= 0) {
+    raiseException_returnNULL(PyExc_AttributeError, "At least one field must be provided");
+  }
+  fields = RAVE_MALLOC(sizeof(RaveData2D_t*) * n);
+  textures = RAVE_MALLOC(sizeof(RaveData2D_t*) * n);
+  if (fields == NULL || textures == NULL) {
+    PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory");
+    goto done;
+  }
+  for (i = 0; i < n; i++) {
+    textures[i] = NULL;
+  }
+  for (i = 0; i < n; i++) {
+    PyObject* pyfield = PySequence_GetItem(pyfields, i);
+    if (pyfield == NULL || !PyRaveData2D_Check(pyfield)) {
+      Py_XDECREF(pyfield);
+      raiseException_gotoTag(done, PyExc_AttributeError, "Inparameter must be a list of RaveData2DCore");
+    }
+    fields[i] = ((PyRaveData2D*)pyfield)->field;
+    Py_DECREF(pyfield); /* The list keeps the field */
+    if (!RaveData2D_usingNodata(fields[i])) {
+      raiseException_gotoTag(done, PyExc_AttributeError, "To create texture, nodata must be set");
+    }
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  ok = PdpProcessor_textures(self->processor, (long)n, fields, textures);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
+    raiseException_gotoTag(done, PyExc_RuntimeError, "Failed to generate textures");
+  }
+
+  pyresult = PyList_New(n);
+  if (pyresult == NULL) {
+    goto done;
+  }
+  for (i = 0; i < n; i++) {
+    PyObject* pytexture = (PyObject*)PyRaveData2D_New(textures[i]);
+    if (pytexture == NULL) {
+      Py_DECREF(pyresult);
+      pyresult = NULL;
+      goto done;
+    }
+    PyList_SET_ITEM(pyresult, i, pytexture);
+  }
+
+done:
+  if (textures != NULL) {
+    for (i = 0; i < n; i++) {
+      RAVE_OBJECT_RELEASE(textures[i]);
+    }
+  }
+  RAVE_FREE(fields);
+  RAVE_FREE(textures);
+  return pyresult;
+}
+
 static PyObject* _pypdpprocessor_trap(PyPdpProcessor* self, PyObject* args)
 {
   PyObject* pyin = NULL;
@@ -192,7 +273,9 @@ static PyObject* _pypdpprocessor_trap(PyPdpProcessor* self, PyObject* args)
     raiseException_returnNULL(PyExc_AttributeError, "First argument must be a RaveData2DCore object");
   }
 
+  Py_BEGIN_ALLOW_THREADS
   trapResult = PdpProcessor_trap(self->processor, ((PyRaveData2D*)pyin)->field, a, b, s, t);
+  Py_END_ALLOW_THREADS
   if (trapResult == NULL) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to run trap on x");
   }
@@ -222,9 +305,11 @@ static PyObject* _pypdpprocessor_clutterID(PyPdpProcessor* self, PyObject* args)
     raiseException_returnNULL(PyExc_AttributeError, "Z, VRADH, TexturePHIDP, RHOHV, TextureZ and ClutterMap has be of type RaveData2DCore");
   }
 
+  Py_BEGIN_ALLOW_THREADS
   clutterIDResult = PdpProcessor_clutterID(self->processor, ((PyRaveData2D*)pyinZ)->field, ((PyRaveData2D*)pyinVRADH)->field,
       ((PyRaveData2D*)pyinTexturePHIDP)->field, ((PyRaveData2D*)pyinRHOHV)->field, ((PyRaveData2D*)pyinTextureZ)->field,
       ((PyRaveData2D*)pyinClutterMap)->field, nodataZ, nodataVRADH);
+  Py_END_ALLOW_THREADS
 
   if (clutterIDResult == NULL) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to run clutter ID");
@@ -243,13 +328,26 @@ static PyObject* _pypdpprocessor_clutterCorrection(PyPdpProcessor* self, PyObjec
   PyObject *pyoutZ = NULL, *pyoutQuality = NULL, *pyoutClutterMask = NULL;
   PyObject* result = NULL;
   double nodataZ = 0.0, nodataVRADH = 0.0, qualityThreshold = 0.0;
+  int ok = 0;
 
   if (!PyArg_ParseTuple(args, "OOOOOOddd", &pyinZ, &pyinVRADH, &pyinTexturePHIDP, &pyinRHOHV, &pyinTextureZ, &pyinClutterMap, &nodataZ, &nodataVRADH, &qualityThreshold))
     return NULL;
 
-  if (!PdpProcessor_clutterCorrection(self->processor, ((PyRaveData2D*)pyinZ)->field, ((PyRaveData2D*)pyinVRADH)->field,
+  if (!PyRaveData2D_Check(pyinZ) ||
+      !PyRaveData2D_Check(pyinVRADH) ||
+      !PyRaveData2D_Check(pyinTexturePHIDP) ||
+      !PyRaveData2D_Check(pyinRHOHV) ||
+      !PyRaveData2D_Check(pyinTextureZ) ||
+      !PyRaveData2D_Check(pyinClutterMap)) {
+    raiseException_returnNULL(PyExc_AttributeError, "Z, VRADH, TexturePHIDP, RHOHV, TextureZ and ClutterMap has be of type RaveData2DCore");
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  ok = PdpProcessor_clutterCorrection(self->processor, ((PyRaveData2D*)pyinZ)->field, ((PyRaveData2D*)pyinVRADH)->field,
       ((PyRaveData2D*)pyinTexturePHIDP)->field, ((PyRaveData2D*)pyinRHOHV)->field, ((PyRaveData2D*)pyinTextureZ)->field,
-      ((PyRaveData2D*)pyinClutterMap)->field, nodataZ, nodataVRADH, qualityThreshold, &outZ, &outQuality, &outClutterMask)) {
+      ((PyRaveData2D*)pyinClutterMap)->field, nodataZ, nodataVRADH, qualityThreshold, &outZ, &outQuality, &outClutterMask);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to generate clutter correction");
   }
   pyoutZ = (PyObject*)PyRaveData2D_New(outZ);
@@ -285,7 +383,9 @@ static PyObject* _pypdpprocessor_medfilt(PyPdpProcessor* self, PyObject* args)
   if (!PyRaveData2D_Check(pyinZ)) {
     raiseException_returnNULL(PyExc_AttributeError, "First argument must be of type RaveData2DCore");
   }
+  Py_BEGIN_ALLOW_THREADS
   mask = PdpProcessor_medfilt(self->processor, (RaveData2D_t*)((PyRaveData2D*)pyinZ)->field, threshZ, nodataZ, filtXsize, filtYsize);
+  Py_END_ALLOW_THREADS
   if (mask == NULL) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to create filtered Z field");
   }
@@ -294,6 +394,31 @@ static PyObject* _pypdpprocessor_medfilt(PyPdpProcessor* self, PyObject* args)
   return pyresult;
 }
 
+static PyObject* _pypdpprocessor_medianFilter(PyPdpProcessor* self, PyObject* args)
+{
+  PyObject* pyfield = NULL;
+  long filtXsize = 3, filtYsize = 3;
+  RaveData2D_t* filtered = NULL;
+  PyObject* pyresult = NULL;
+  if (!PyArg_ParseTuple(args, "O|(ll)", &pyfield, &filtXsize, &filtYsize))
+    return NULL;
+  if (!PyRaveData2D_Check(pyfield)) {
+    raiseException_returnNULL(PyExc_AttributeError, "First argument must be of type RaveData2DCore");
+  }
+  if (filtXsize <= 0 || filtYsize <= 0 || filtXsize % 2 == 0 || filtYsize % 2 == 0) {
+    raiseException_returnNULL(PyExc_ValueError, "Window size must be odd");
+  }
+  Py_BEGIN_ALLOW_THREADS
+  filtered = PdpProcessor_medianFilter(self->processor, (RaveData2D_t*)((PyRaveData2D*)pyfield)->field, filtXsize, filtYsize);
+  Py_END_ALLOW_THREADS
+  if (filtered == NULL) {
+    raiseException_returnNULL(PyExc_RuntimeError, "Failed to median filter field");
+  }
+  pyresult = (PyObject*)PyRaveData2D_New(filtered);
+  RAVE_OBJECT_RELEASE(filtered);
+  return pyresult;
+}
+
 static PyObject* _pypdpprocessor_residualClutterFilter(PyPdpProcessor* self, PyObject* args)
 {
   PyObject* pyinZ = NULL;
@@ -311,7 +436,9 @@ static PyObject* _pypdpprocessor_residualClutterFilter(PyPdpProcessor* self, PyO
   if (!RaveData2D_usingNodata(((PyRaveData2D*)pyinZ)->field)) {
     raiseException_returnNULL(PyExc_AttributeError, "Z must be defined to use nodata");
   }
+  Py_BEGIN_ALLOW_THREADS
   mask = PdpProcessor_residualClutterFilter(self->processor, (RaveData2D_t*)((PyRaveData2D*)pyinZ)->field, threshZ, threshTexture, filtXsize, filtYsize);
+  Py_END_ALLOW_THREADS
   if (mask == NULL) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to create residual clutter mask");
   }
@@ -346,7 +473,9 @@ static PyObject* _pypdpprocessor_process(PyPdpProcessor* self, PyObject* args)
   if (pysclutterMap != NULL) {
     sclutterMap = ((PyRaveData2D*)pysclutterMap)->field;
   }
+  Py_BEGIN_ALLOW_THREADS
   resultScan = PdpProcessor_process(self->processor, ((PyPolarScan*)pyin)->scan, sclutterMap);
+  Py_END_ALLOW_THREADS
   if (resultScan == NULL) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to process scan");
   }
@@ -358,6 +487,178 @@ static PyObject* _pypdpprocessor_process(PyPdpProcessor* self, PyObject* args)
   return pyresult;
 }
 
+/**
+ * See \ref PdpProcessor_processInPlace
+ * @param[in] self - self
+ * @param[in] args - the scan and optionally a cluttermap
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pypdpprocessor_processInPlace(PyPdpProcessor* self, PyObject* args)
+{
+  PyObject *pyin = NULL, *pysclutterMap = NULL;
+  RaveData2D_t* sclutterMap = NULL;
+  int ok = 0;
+
+  if (!PyArg_ParseTuple(args, "O|O", &pyin, &pysclutterMap))
+    return NULL;
+
+  if (!PyPolarScan_Check(pyin)) {
+    raiseException_returnNULL(PyExc_RuntimeError, "Indata must be polar scan (and eventually a cluttermap as ravedata2d object)");
+  }
+
+  if (pysclutterMap != NULL && !PyRaveData2D_Check(pysclutterMap)) {
+    raiseException_returnNULL(PyExc_RuntimeError, "Indata must be polar scan (and eventually a cluttermap as ravedata2d object)");
+  }
+  if (pysclutterMap != NULL) {
+    sclutterMap = ((PyRaveData2D*)pysclutterMap)->field;
+  }
+  Py_BEGIN_ALLOW_THREADS
+  ok = PdpProcessor_processInPlace(self->processor, ((PyPolarScan*)pyin)->scan, sclutterMap);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
+    raiseException_returnNULL(PyExc_RuntimeError, "Failed to process scan");
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * Releases the free buffers in the workspace. If nbins and nrays are given, only the buffers with another geometry are released.
+ * @param[in] self - self
+ * @param[in] args - optionally nbins, nrays
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pypdpprocessor_trimWorkspace(PyPdpProcessor* self, PyObject* args)
+{
+  long nbins = -1, nrays = -1;
+  PdpWorkspace_t* workspace = NULL;
+
+  if (!PyArg_ParseTuple(args, "|ll", &nbins, &nrays))
+    return NULL;
+
+  workspace = PdpProcessor_getWorkspace(self->processor);
+  if (workspace != NULL) {
+    if (nbins < 0 || nrays < 0) {
+      PdpWorkspace_clear(workspace);
+    } else {
+      PdpWorkspace_trim(workspace, nbins, nrays);
+    }
+  }
+  RAVE_OBJECT_RELEASE(workspace);
+  Py_RETURN_NONE;
+}
+
+/**
+ * Returns the statistics from the last processing as a dictionary with one entry for each stage. Each stage is
+ * a dictionary with the keys duration (ms), processed, flagged and allocated (bytes).
+ * @param[in] self - self
+ * @param[in] args - N/A
+ * @return the dictionary or None if nothing has been processed
+ */
+static PyObject* _pypdpprocessor_getLastStats(PyPdpProcessor* self, PyObject* args)
+{
+  PdpStats_t* stats = NULL;
+  PyObject *pyresult = NULL, *pystage = NULL;
+  int i = 0;
+
+  if (!PyArg_ParseTuple(args, ""))
+    return NULL;
+
+  stats = PdpProcessor_getLastStats(self->processor);
+  if (stats == NULL) {
+    Py_RETURN_NONE;
+  }
+  pyresult = PyDict_New();
+  if (pyresult == NULL) {
+    goto fail;
+  }
+  for (i = 0; i < PdpStatsStage_NUMBER_OF_STAGES; i++) {
+    PdpStatsStage stage = (PdpStatsStage)i;
+    pystage = Py_BuildValue("{s:d,s:l,s:l,s:l}",
+        "duration", PdpStats_getDuration(stats, stage),
+        "processed", PdpStats_getProcessedPixels(stats, stage),
+        "flagged", PdpStats_getFlaggedPixels(stats, stage),
+        "allocated", PdpStats_getAllocatedBytes(stats, stage));
+    if (pystage == NULL || PyDict_SetItemString(pyresult, PdpStats_getStageName(stage), pystage) != 0) {
+      goto fail;
+    }
+    Py_DECREF(pystage);
+    pystage = NULL;
+  }
+  pystage = Py_BuildValue("{s:l,s:l,s:d}",
+      "applied", PdpStats_getResidualFilterApplied(stats),
+      "skipped", PdpStats_getResidualFilterSkipped(stats),
+      "entropy", PdpStats_getResidualFilterEntropy(stats));
+  if (pystage == NULL || PyDict_SetItemString(pyresult, "residualFilterGate", pystage) != 0) {
+    goto fail;
+  }
+  Py_DECREF(pystage);
+  RAVE_OBJECT_RELEASE(stats);
+  return pyresult;
+fail:
+  Py_XDECREF(pystage);
+  Py_XDECREF(pyresult);
+  RAVE_OBJECT_RELEASE(stats);
+  return NULL;
+}
+
+/**
+ * See \ref PdpProcessor_processVolume
+ * @param[in] self - self
+ * @param[in] args - the volume and optionally a list of clutter maps
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pypdpprocessor_processVolume(PyPdpProcessor* self, PyObject* args)
+{
+  PyObject *pyin = NULL, *pyclutterMaps = NULL;
+  RaveObjectList_t* clutterMaps = NULL;
+  PyObject* pyresult = NULL;
+  Py_ssize_t i = 0, n = 0;
+  int ok = 0;
+
+  if (!PyArg_ParseTuple(args, "O|O", &pyin, &pyclutterMaps))
+    return NULL;
+
+  if (!PyPolarVolume_Check(pyin)) {
+    raiseException_returnNULL(PyExc_RuntimeError, "Indata must be polar volume (and eventually a list of cluttermaps as ravedata2d objects)");
+  }
+
+  if (pyclutterMaps != NULL && pyclutterMaps != Py_None) {
+    if (!PySequence_Check(pyclutterMaps)) {
+      raiseException_returnNULL(PyExc_RuntimeError, "Cluttermaps must be a list of ravedata2d objects");
+    }
+    clutterMaps = RAVE_OBJECT_NEW(&RaveObjectList_TYPE);
+    if (clutterMaps == NULL) {
+      raiseException_returnNULL(PyExc_MemoryError, "Failed to create cluttermap list");
+    }
+    n = PySequence_Size(pyclutterMaps);
+    for (i = 0; i < n; i++) {
+      PyObject* pymap = PySequence_GetItem(pyclutterMaps, i);
+      if (pymap == NULL || !PyRaveData2D_Check(pymap)) {
+        Py_XDECREF(pymap);
+        raiseException_gotoTag(done, PyExc_RuntimeError, "Cluttermaps must be a list of ravedata2d objects");
+      }
+      if (!RaveObjectList_add(clutterMaps, (RaveCoreObject*)((PyRaveData2D*)pymap)->field)) {
+        Py_DECREF(pymap);
+        raiseException_gotoTag(done, PyExc_MemoryError, "Failed to add cluttermap to list");
+      }
+      Py_DECREF(pymap);
+    }
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  ok = PdpProcessor_processVolume(self->processor, ((PyPolarVolume*)pyin)->pvol, clutterMaps);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
+    raiseException_gotoTag(done, PyExc_RuntimeError, "Failed to process volume");
+  }
+
+  Py_INCREF(Py_None);
+  pyresult = Py_None;
+done:
+  RAVE_OBJECT_RELEASE(clutterMaps);
+  return pyresult;
+}
+
 static PyObject* _pypdpprocessor_pdpProcessing(PyPdpProcessor* self, PyObject* args)
 {
   PyObject* pyinPdp = NULL;
@@ -368,6 +669,7 @@ static PyObject* _pypdpprocessor_pdpProcessing(PyPdpProcessor* self, PyObject* a
   double dr;
   long window;
   long nrIter;
+  int ok = 0;
 
   if (!PyArg_ParseTuple(args, "Odll", &pyinPdp, &dr, &window, &nrIter))
     return NULL;
@@ -379,7 +681,10 @@ static PyObject* _pypdpprocessor_pdpProcessing(PyPdpProcessor* self, PyObject* a
   if (!RaveData2D_usingNodata(((PyRaveData2D*)pyinPdp)->field)) {
     raiseException_returnNULL(PyExc_AttributeError, "Pdp field must be defined to use nodata");
   }
-  if (!PdpProcessor_pdpProcessing(self->processor, ((PyRaveData2D*)pyinPdp)->field, dr, window, nrIter, &pdpres, &kdpres)) {
+  Py_BEGIN_ALLOW_THREADS
+  ok = PdpProcessor_pdpProcessing(self->processor, ((PyRaveData2D*)pyinPdp)->field, dr, window, nrIter, &pdpres, &kdpres);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to run pdp processing");
   }
   pypdpres = (PyObject*)PyRaveData2D_New(pdpres);
@@ -404,6 +709,7 @@ static PyObject* _pypdpprocessor_pdpScript(PyPdpProcessor* self, PyObject* args)
   double dr;
   double rWin1,rWin2;
   long nrIter;
+  int ok = 0;
 
   if (!PyArg_ParseTuple(args, "Odddl", &pyinPdp, &dr, &rWin1, &rWin2, &nrIter))
     return NULL;
@@ -416,7 +722,10 @@ static PyObject* _pypdpprocessor_pdpScript(PyPdpProcessor* self, PyObject* args)
     raiseException_returnNULL(PyExc_AttributeError, "Pdp field must be defined to use nodata");
   }
 
-  if (!PdpProcessor_pdpScript(self->processor, ((PyRaveData2D*)pyinPdp)->field, dr, rWin1, rWin2, nrIter, &pdpres, &kdpres)) {
+  Py_BEGIN_ALLOW_THREADS
+  ok = PdpProcessor_pdpScript(self->processor, ((PyRaveData2D*)pyinPdp)->field, dr, rWin1, rWin2, nrIter, &pdpres, &kdpres);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to run pdp processing");
   }
   pypdpres = (PyObject*)PyRaveData2D_New(pdpres);
@@ -439,6 +748,7 @@ static PyObject* _pypdpprocessor_attenuation(PyPdpProcessor* self, PyObject* arg
   PyObject* result = NULL;
   double gamma_h = 0.0, alpha = 0.0;
   double zundetect = -32.0, dbzhundetect = -32.0;
+  int ok = 0;
 
   if (!PyArg_ParseTuple(args, "OOOOOdddd", &pyinz, &pyinzdr, &pyindbzh, &pyinpdp, &pyinmask, &gamma_h, &alpha, &zundetect, &dbzhundetect))
     return NULL;
@@ -451,9 +761,12 @@ static PyObject* _pypdpprocessor_attenuation(PyPdpProcessor* self, PyObject* arg
     raiseException_returnNULL(PyExc_AttributeError, "pdp and dbzh field must be defined to use nodata");
   }
 
-  if (!PdpProcessor_attenuation(self->processor, ((PyRaveData2D*)pyinz)->field, ((PyRaveData2D*)pyinzdr)->field,
+  Py_BEGIN_ALLOW_THREADS
+  ok = PdpProcessor_attenuation(self->processor, ((PyRaveData2D*)pyinz)->field, ((PyRaveData2D*)pyinzdr)->field,
       ((PyRaveData2D*)pyindbzh)->field, ((PyRaveData2D*)pyinpdp)->field, ((PyRaveData2D*)pyinmask)->field, gamma_h, alpha, zundetect, dbzhundetect,
-      &outz, &outzdr, &outpia, &outdbzh)) {
+      &outz, &outzdr, &outpia, &outdbzh);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to run pdp processing");
   }
   pyoutz = (PyObject*)PyRaveData2D_New(outz);
@@ -486,6 +799,7 @@ static PyObject* _pypdpprocessor_zphi(PyPdpProcessor* self, PyObject* args)
   PyObject *pyoutzphi = NULL, *pyoutah = NULL;
   PyObject* result = NULL;
   double dr = 0.0, BB = 0.0, gamma_h = 0.0;
+  int ok = 0;
 
   if (!PyArg_ParseTuple(args, "OOOddd", &pyinz, &pyinpdp, &pyinmask, &dr, &BB, &gamma_h))
     return NULL;
@@ -498,8 +812,11 @@ static PyObject* _pypdpprocessor_zphi(PyPdpProcessor* self, PyObject* args)
     raiseException_returnNULL(PyExc_AttributeError, "pdp field must be defined to use nodata");
   }
 
-  if (!PdpProcessor_zphi(self->processor, ((PyRaveData2D*)pyinz)->field, ((PyRaveData2D*)pyinpdp)->field,
-      ((PyRaveData2D*)pyinmask)->field, dr, BB, gamma_h, &outzphi, &outah)) {
+  Py_BEGIN_ALLOW_THREADS
+  ok = PdpProcessor_zphi(self->processor, ((PyRaveData2D*)pyinz)->field, ((PyRaveData2D*)pyinpdp)->field,
+      ((PyRaveData2D*)pyinmask)->field, dr, BB, gamma_h, &outzphi, &outah);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to run zphi");
   }
   pyoutzphi = (PyObject*)PyRaveData2D_New(outzphi);
@@ -527,12 +844,22 @@ static struct PyMethodDef _pypdpprocessor_methods[] =
   {"options", NULL, METH_VARARGS, NULL},
   {"meltingLayerBottomHeight", NULL, METH_VARARGS, NULL},
   {"texture", (PyCFunction)_pypdpprocessor_texture, METH_VARARGS, NULL},
+  {"textures", (PyCFunction)_pypdpprocessor_textures, METH_VARARGS, NULL},
   {"trap", (PyCFunction)_pypdpprocessor_trap, METH_VARARGS, NULL},
   {"clutterID", (PyCFunction)_pypdpprocessor_clutterID, METH_VARARGS, NULL},
   {"clutterCorrection", (PyCFunction)_pypdpprocessor_clutterCorrection, METH_VARARGS, NULL},
   {"medfilt", (PyCFunction)_pypdpprocessor_medfilt, METH_VARARGS, NULL},
+  {"medianFilter", (PyCFunction)_pypdpprocessor_medianFilter, METH_VARARGS, NULL},
+  {"medfiltAlgorithm", NULL, METH_VARARGS, NULL},
   {"residualClutterFilter", (PyCFunction)_pypdpprocessor_residualClutterFilter, METH_VARARGS, NULL},
   {"process", (PyCFunction)_pypdpprocessor_process, METH_VARARGS, NULL},
+  {"processInPlace", (PyCFunction)_pypdpprocessor_processInPlace, METH_VARARGS, NULL},
+  {"processVolume", (PyCFunction)_pypdpprocessor_processVolume, METH_VARARGS, NULL},
+  {"useWorkspace", NULL, METH_VARARGS, NULL},
+  {"workspaceSize", NULL, METH_VARARGS, NULL},
+  {"trimWorkspace", (PyCFunction)_pypdpprocessor_trimWorkspace, METH_VARARGS, NULL},
+  {"printStats", NULL, METH_VARARGS, NULL},
+  {"getLastStats", (PyCFunction)_pypdpprocessor_getLastStats, METH_VARARGS, NULL},
   {"pdpProcessing", (PyCFunction)_pypdpprocessor_pdpProcessing, METH_VARARGS, NULL},
   {"pdpScript", (PyCFunction)_pypdpprocessor_pdpScript, METH_VARARGS, NULL},
   {"attenuation", (PyCFunction)_pypdpprocessor_attenuation, METH_VARARGS, NULL},
@@ -552,6 +879,26 @@ static PyObject* _pypdpprocessor_getattro(PyPdpProcessor* self, PyObject* name)
     return result;
   } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "meltingLayerBottomHeight") == 0) {
     return PyFloat_FromDouble(PdpProcessor_getMeltingLayerBottomHeight(self->processor));
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "useWorkspace") == 0) {
+    PdpWorkspace_t* workspace = PdpProcessor_getWorkspace(self->processor);
+    PyObject* result = PyBool_FromLong(workspace != NULL);
+    RAVE_OBJECT_RELEASE(workspace);
+    return result;
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "workspaceSize") == 0) {
+    PdpWorkspace_t* workspace = PdpProcessor_getWorkspace(self->processor);
+    PyObject* result = PyLong_FromLong(workspace != NULL ? PdpWorkspace_getSize(workspace) : 0);
+    RAVE_OBJECT_RELEASE(workspace);
+    return result;
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "printStats") == 0) {
+    return PyBool_FromLong(PdpProcessor_getPrintStats(self->processor));
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "medfiltAlgorithm") == 0) {
+    PdpMedfiltAlgorithm algorithm = PdpProcessor_getMedfiltAlgorithm(self->processor);
+    if (algorithm == PdpMedfiltAlgorithm_SORT) {
+      return PyString_FromString("sort");
+    } else if (algorithm == PdpMedfiltAlgorithm_HISTOGRAM) {
+      return PyString_FromString("histogram");
+    }
+    return PyString_FromString("count");
   }
 
   return PyObject_GenericGetAttr((PyObject*)self, name);
@@ -584,6 +931,33 @@ static int _pypdpprocessor_setattro(PyPdpProcessor* self, PyObject* name, PyObje
     } else {
       raiseException_gotoTag(done, PyExc_ValueError, "meltingLayerBottomHeight must be of type float or long");
     }
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "useWorkspace") == 0) {
+    if (PyObject_IsTrue(val)) {
+      PdpWorkspace_t* workspace = PdpProcessor_getWorkspace(self->processor);
+      if (workspace == NULL) {
+        workspace = RAVE_OBJECT_NEW(&PdpWorkspace_TYPE);
+        if (workspace == NULL) {
+          raiseException_gotoTag(done, PyExc_MemoryError, "Failed to create workspace");
+        }
+        PdpProcessor_setWorkspace(self->processor, workspace);
+      }
+      RAVE_OBJECT_RELEASE(workspace);
+    } else {
+      PdpProcessor_setWorkspace(self->processor, NULL);
+    }
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "printStats") == 0) {
+    PdpProcessor_setPrintStats(self->processor, PyObject_IsTrue(val) ? 1 : 0);
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "medfiltAlgorithm") == 0) {
+    const char* algorithm = PyString_Check(val) ? PyString_AsString(val) : NULL;
+    if (algorithm != NULL && strcmp("count", algorithm) == 0) {
+      PdpProcessor_setMedfiltAlgorithm(self->processor, PdpMedfiltAlgorithm_COUNT);
+    } else if (algorithm != NULL && strcmp("sort", algorithm) == 0) {
+      PdpProcessor_setMedfiltAlgorithm(self->processor, PdpMedfiltAlgorithm_SORT);
+    } else if (algorithm != NULL && strcmp("histogram", algorithm) == 0) {
+      PdpProcessor_setMedfiltAlgorithm(self->processor, PdpMedfiltAlgorithm_HISTOGRAM);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "medfiltAlgorithm must be count, sort or histogram");
+    }
   } else {
     raiseException_gotoTag(done, PyExc_AttributeError, PY_RAVE_ATTRO_NAME_TO_STRING(name));
   }
@@ -670,6 +1044,11 @@ PyDoc_STRVAR(_pypdpprocessor_doc,
     "\n"
     ">>> param = newscan.getParameter(\"KDP_CORR\")\n"
     "\n"
+    "The GIL is released while processing so several radars can be processed in parallel from python threads, e.g.\n"
+    "one thread for each radar. A processor can be shared between the threads as long as its options, meltingLayerBottomHeight\n"
+    "and useWorkspace are not changed while processing. The scans and fields passed to the processor must not be modified\n"
+    "by another thread until the call has returned.\n"
+    "\n"
     "The functions are:\n"
     "\n"
     "scan := process(scan, clutterMap)\n"
@@ -679,12 +1058,51 @@ PyDoc_STRVAR(_pypdpprocessor_doc,
     "   clutterMap - the statistical clutter map."
     " - returns a scan of type PolarScanParam\n"
     "\n"
+    "processInPlace(scan, clutterMap)\n"
+    " Same as process but the requested fields are added directly to the scan instead of to a copy of it.\n"
+    " Existing parameters and quality fields with the same quantity or how/task are replaced.\n"
+    " - indata\n"
+    "   scan       - a polar scan\n"
+    "   clutterMap - the statistical clutter map.\n"
+    " - returns None\n"
+    "\n"
+    "processVolume(volume, clutterMaps)\n"
+    " Performs the polarimetric processing chain on all scans in the volume concurrently. The requested fields are\n"
+    " added to the scans in the volume. At most numberOfThreads scans are processed at the same time and the threads\n"
+    " are shared between them.\n"
+    " - indata\n"
+    "   volume      - a polar volume\n"
+    "   clutterMaps - optional list of statistical clutter maps, one for each scan in the same order as the scans.\n"
+    "                 The maps are matched to the scans by position only, not by elevation. If a map doesn't have\n"
+    "                 the geometry of its scan the whole volume fails and nothing is added.\n"
+    " - returns None\n"
+    "\n"
+    "trimWorkspace(nbins, nrays)\n"
+    " Scratch buffers are kept between calls if processor.useWorkspace = True. This releases the kept buffers\n"
+    " that doesn't have the geometry nbins x nrays or all kept buffers if nbins and nrays are omitted.\n"
+    " The number of bytes kept can be read from processor.workspaceSize.\n"
+    "\n"
+    "stats := getLastStats()\n"
+    " Returns the statistics from the last call to process, processInPlace or processVolume as a dictionary with one entry for each\n"
+    " stage (preprocess, texture, clutterID, residualFilter, pdpScript, pdpPass1, pdpPass2, attenuation, zphi, quantization\n"
+    " and total). Each entry is a dictionary with duration (ms), processed (pixels), flagged (pixels) and allocated (bytes).\n"
+    " For a volume the statistics of all scans are added together. Returns None if nothing has been processed.\n"
+    " The entry residualFilterGate has the number of scans where the residual clutter filter was applied and skipped and\n"
+    " the mean entropy of the thresholded residual clutter mask that decides it.\n"
+    " If processor.printStats = True the statistics are also printed to stderr after each processing.\n"
+    "\n"
     "texture := texture(field)\n"
     " Creates a texture from the provided data field.\n"
     " - indata:\n"
     "   field (RaveData2DCore)      - An arbitary field\n"
     " - returns a texture of type RaveData2DCore\n"
     "\n"
+    "textures := textures(fields)\n"
+    " Creates the textures of several fields with the same geometry in one sweep. Same result as calling texture for each field.\n"
+    " - indata:\n"
+    "   fields (list of RaveData2DCore) - The fields\n"
+    " - returns a list with the textures in the same order as the fields\n"
+    "\n"
     "degree := trap(field, a, b, s, t)\n"
     " Trapezoidal function where the field can be any variable and a,b,s,t\n"
     " identifies the trapezoid coordinates along the x-axis x1 = a-s, x2=a, x3=b, x4=b+t.\n"
@@ -732,6 +1150,19 @@ PyDoc_STRVAR(_pypdpprocessor_doc,
     "   (filtXsize, filtYsize) (2*digit), - window size\n"
     " - returns a RaveData2DCore field with the mask calculated by the filter\n"
     "\n"
+    "field := medianFilter(field, (filtXsize, filtYsize))\n"
+    " Median filters a continuous field with sliding histograms, the cost is close to constant regardless of the window size.\n"
+    " The window wraps around in azimuth, bins beyond the ray ends, nodata and values that aren't finite are left out\n"
+    " and are kept as they are. The result is the exact median of the values in the window.\n"
+    " The window size must be odd and defaults to (3, 3).\n"
+    " - indata:\n"
+    "   field (RaveData2DCore)      - An arbitary field\n"
+    "   (filtXsize, filtYsize) (2*digit), - window size\n"
+    " - returns the filtered field as a RaveData2DCore\n"
+    "\n"
+    "The median filter used on the mask in medfilt is selected with processor.medfiltAlgorithm = \"count\" (default),\n"
+    "\"sort\" or \"histogram\". All of them give the same result.\n"
+    "\n"
     "mask := residualClutterFilter(Z, threshZ, threshTexture, (filtXsize, filtYsize))\n"
     " Residual clutter filter. Z is a RaveData2DCore field. threshZ, threshTexture are doubles and filtXsize, filtYsize are digits. All attributes are optional except Z.\n"
     " - indata: \n"
@@ -828,6 +1259,7 @@ MOD_INIT(_pdpprocessor)
   }
 
   import_pypolarscan();
+  import_pypolarvolume();
   import_ppcradaroptions();
   import_ravedata2d();
   PYRAVE_DEBUG_INITIALIZE;
@@ -178,6 +178,100 @@ PyDoc_STRVAR(_pyppcro_setBand_doc,
     "  band = 'x' => kdpUp = 40, kdpDown = -2, kdpStdThreshold = 5\n"
     );
 
+static PyObject* _pyppcradaroptions_setOutputScaling(PyPpcRadarOptions* self, PyObject* args)
+{
+  char *quantity = NULL, *type = NULL;
+  double gain = 1.0, offset = 0.0;
+  int dtype = RaveDataType_UCHAR;
+  if (!PyArg_ParseTuple(args, "ss|dd", &quantity, &type, &gain, &offset))
+    return NULL;
+
+  if (strcmp("uchar", type) == 0) {
+    dtype = RaveDataType_UCHAR;
+  } else if (strcmp("ushort", type) == 0) {
+    dtype = RaveDataType_USHORT;
+  } else if (strcmp("float", type) == 0) {
+    dtype = RaveDataType_FLOAT;
+  } else if (strcmp("double", type) == 0) {
+    dtype = RaveDataType_DOUBLE;
+  } else {
+    raiseException_returnNULL(PyExc_ValueError, "type must be either uchar, ushort, float or double");
+  }
+  if (!PpcRadarOptions_setOutputScaling(self->options, quantity, dtype, gain, offset)) {
+    raiseException_returnNULL(PyExc_ValueError, "Failed to set output scaling");
+  }
+  Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(_pyppcro_setOutputScaling_doc,
+    "setOutputScaling(quantity, type[, gain, offset])\n"
+    "Sets a fixed scaling of an output quantity or quality field (how/task). type is uchar, ushort, float or double.\n"
+    "For uchar and ushort the values are rounded to the nearest raw value and valid values are clamped to 1 - (nodata - 1),\n"
+    "0 is only undetect and nodata is 255 or 65535.\n"
+    "For float and double the values are not quantized, gain and offset are ignored.\n"
+    );
+
+static PyObject* _pyppcradaroptions_getOutputScaling(PyPpcRadarOptions* self, PyObject* args)
+{
+  char* quantity = NULL;
+  int type = 0;
+  double gain = 0.0, offset = 0.0;
+  if (!PyArg_ParseTuple(args, "s", &quantity))
+    return NULL;
+
+  if (!PpcRadarOptions_getOutputScaling(self->options, quantity, &type, &gain, &offset)) {
+    Py_RETURN_NONE;
+  }
+  return Py_BuildValue("(sdd)", (type == RaveDataType_USHORT) ? "ushort" : ((type == RaveDataType_FLOAT) ? "float" :
+      ((type == RaveDataType_DOUBLE) ? "double" : "uchar")), gain, offset);
+}
+
+PyDoc_STRVAR(_pyppcro_getOutputScaling_doc,
+    "getOutputScaling(quantity) -> (type, gain, offset)\n"
+    "Returns the fixed scaling of an output quantity or None if it is scaled by min and max.\n"
+    );
+
+static PyObject* _pyppcradaroptions_removeOutputScaling(PyPpcRadarOptions* self, PyObject* args)
+{
+  char* quantity = NULL;
+  if (!PyArg_ParseTuple(args, "s", &quantity))
+    return NULL;
+  PpcRadarOptions_removeOutputScaling(self->options, quantity);
+  Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(_pyppcro_removeOutputScaling_doc,
+    "removeOutputScaling(quantity)\n"
+    "Removes the fixed scaling of an output quantity so that it is scaled by min and max again.\n"
+    );
+
+static PyObject* _pyppcradaroptions_getOutputScalingQuantities(PyPpcRadarOptions* self, PyObject* args)
+{
+  PyObject* result = NULL;
+  int i = 0, n = 0;
+  if (!PyArg_ParseTuple(args, ""))
+    return NULL;
+  n = PpcRadarOptions_getNumberOfOutputScalings(self->options);
+  result = PyList_New(0);
+  if (result == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < n; i++) {
+    PyObject* str = PyString_FromString(PpcRadarOptions_getOutputScalingQuantity(self->options, i));
+    if (str == NULL || PyList_Append(result, str) != 0) {
+      Py_XDECREF(str);
+      Py_DECREF(result);
+      return NULL;
+    }
+    Py_DECREF(str);
+  }
+  return result;
+}
+
+PyDoc_STRVAR(_pyppcro_getOutputScalingQuantities_doc,
+    "getOutputScalingQuantities() -> list of quantities that have a fixed scaling\n"
+    );
+
 /**
  * All methods a ppc radar options can have
  */
@@ -210,6 +304,8 @@ static struct PyMethodDef _pyppcradaroptions_methods[] =
   {"residualClutterTextureFilteringMaxZ", NULL, METH_VARARGS, NULL},
   {"residualFilterBinSize", NULL, METH_VARARGS, NULL},
   {"residualFilterRaySize", NULL, METH_VARARGS, NULL},
+  {"textureBinSize", NULL, METH_VARARGS, NULL},
+  {"textureRaySize", NULL, METH_VARARGS, NULL},
   {"minAttenuationMaskRHOHV", NULL, METH_VARARGS, NULL},
   {"minAttenuationMaskKDP", NULL, METH_VARARGS, NULL},
   {"minAttenuationMaskTH", NULL, METH_VARARGS, NULL},
@@ -224,7 +320,13 @@ static struct PyMethodDef _pyppcradaroptions_methods[] =
   {"meltingLayerBottomHeight", NULL, METH_VARARGS, NULL},
   {"meltingLayerHourThreshold", NULL, METH_VARARGS, NULL},
   {"invertPHIDP", NULL, METH_VARARGS, NULL},
+  {"numberOfThreads", NULL, METH_VARARGS, NULL},
+  {"processingPrecision", NULL, METH_VARARGS, NULL},
   {"setBand", (PyCFunction)_pyppcradaroptions_setBand, METH_VARARGS, _pyppcro_setBand_doc},
+  {"setOutputScaling", (PyCFunction)_pyppcradaroptions_setOutputScaling, METH_VARARGS, _pyppcro_setOutputScaling_doc},
+  {"getOutputScaling", (PyCFunction)_pyppcradaroptions_getOutputScaling, METH_VARARGS, _pyppcro_getOutputScaling_doc},
+  {"removeOutputScaling", (PyCFunction)_pyppcradaroptions_removeOutputScaling, METH_VARARGS, _pyppcro_removeOutputScaling_doc},
+  {"getOutputScalingQuantities", (PyCFunction)_pyppcradaroptions_getOutputScalingQuantities, METH_VARARGS, _pyppcro_getOutputScalingQuantities_doc},
   {NULL, NULL, 0, NULL} /* sentinel */
 };
 
@@ -333,6 +435,17 @@ static PyObject* _pyppcradaroptions_getattro(PyPpcRadarOptions* self, PyObject*
     return PyFloat_FromDouble(PpcRadarOptions_getMeltingLayerHourThreshold(self->options));
   } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "invertPHIDP") == 0) {
     return PyBool_FromLong(PpcRadarOptions_getInvertPHIDP(self->options));
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "numberOfThreads") == 0) {
+    return PyLong_FromLong(PpcRadarOptions_getNumberOfThreads(self->options));
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "processingPrecision") == 0) {
+    if (PpcRadarOptions_getProcessingPrecision(self->options) == RaveDataType_FLOAT) {
+      return PyString_FromString("float");
+    }
+    return PyString_FromString("double");
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "textureBinSize") == 0) {
+    return PyLong_FromLong(PpcRadarOptions_getTextureBinSize(self->options));
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "textureRaySize") == 0) {
+    return PyLong_FromLong(PpcRadarOptions_getTextureRaySize(self->options));
   }
   return PyObject_GenericGetAttr((PyObject*)self, name);
 }
@@ -716,6 +829,38 @@ static int _pyppcradaroptions_setattro(PyPpcRadarOptions* self, PyObject* name,
     } else {
       raiseException_gotoTag(done, PyExc_ValueError, "invertPHIDP must be of bool");
     }
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "numberOfThreads") == 0) {
+    if (PyLong_Check(val)) {
+      PpcRadarOptions_setNumberOfThreads(self->options, (long)PyLong_AsLong(val));
+    } else if (PyInt_Check(val)) {
+      PpcRadarOptions_setNumberOfThreads(self->options, (long)PyInt_AsLong(val));
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "numberOfThreads must be of integer");
+    }
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "processingPrecision") == 0) {
+    if (PyString_Check(val) && strcmp("double", PyString_AsString(val)) == 0) {
+      PpcRadarOptions_setProcessingPrecision(self->options, RaveDataType_DOUBLE);
+    } else if (PyString_Check(val) && strcmp("float", PyString_AsString(val)) == 0) {
+      PpcRadarOptions_setProcessingPrecision(self->options, RaveDataType_FLOAT);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "processingPrecision must be either double or float");
+    }
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "textureBinSize") == 0) {
+    if (PyLong_Check(val)) {
+      PpcRadarOptions_setTextureBinSize(self->options, (long)PyLong_AsLong(val));
+    } else if (PyInt_Check(val)) {
+      PpcRadarOptions_setTextureBinSize(self->options, (long)PyInt_AsLong(val));
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "textureBinSize must be of integer");
+    }
+  } else if (PY_COMPARE_ATTRO_NAME_WITH_STRING(name, "textureRaySize") == 0) {
+    if (PyLong_Check(val)) {
+      PpcRadarOptions_setTextureRaySize(self->options, (long)PyLong_AsLong(val));
+    } else if (PyInt_Check(val)) {
+      PpcRadarOptions_setTextureRaySize(self->options, (long)PyInt_AsLong(val));
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "textureRaySize must be of integer");
+    }
   } else {
     raiseException_gotoTag(done, PyExc_AttributeError, PY_RAVE_ATTRO_NAME_TO_STRING(name));
   }
@@ -761,6 +906,8 @@ PyDoc_STRVAR(_pyppcro_object_definition_doc,
     "residualClutterTextureFilteringMaxZ - Max Z value when creating the residual clutter mask, anything higher will be set to min value\n"
     "residualFilterBinSize        - number of bins used in the window when creating the residual mask\n"
     "residualFilterRaySize        - number of rays used in the window when creating the residual mask\n"
+    "textureBinSize               - number of bins in the texture window, an even size is increased by one\n"
+    "textureRaySize               - number of rays in the texture window, an even size is increased by one\n"
     "minZMedfilterThreshold       - min z threshold used in the median filter that is used by the residual clutter filter\n"
     "processingTextureThreshold   - threshold for the texture created in the pdp processing\n"
     "minWindow                    - min window size\n"
@@ -781,6 +928,8 @@ PyDoc_STRVAR(_pyppcro_object_definition_doc,
     "meltingLayerBottomHeight     - The melting layer bottom height\n"
     "meltingLayerHourThreshold    - The number of hours before default height should be used.\n"
     "invertPHIDP                  - if the PHIDP should be inverted (multiplied with -1) or not. Typically this can be needed if the RSP produces inverted values.\n"
+    "numberOfThreads              - Number of threads to use when processing a scan. Can be overridden with the environment variable PPC_NUMBER_OF_THREADS\n"
+    "processingPrecision          - Precision of the fields in the processing chain, double or float. float uses half the memory but the result differs slightly from double\n"
     "requestedFields              - '|' separated list of flags that defines what products should be added to the finished result.\n"
     "                               If the flag begins with a P, it means that the result is added as a parameter and the name of\n"
     "                               the parameter will be without the P_. If on the other hand the flag begins with a Q_ it means\n"
@@ -799,6 +948,9 @@ PyDoc_STRVAR(_pyppcro_object_definition_doc,
     "                                + Q_RESIDUAL_CLUTTER_MASK\n"
     "                                + Q_ATTENUATION_MASK\n"
     "                                + Q_ATTENUATION\n"
+    "\n"
+    "Output quantities can be given a fixed scaling with setOutputScaling(quantity, type, gain, offset), otherwise\n"
+    "they are scaled by the min and max of each scan. With the type float or double they are not quantized at all.\n"
     );
 
 
@@ -0,0 +1,682 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of baltrad-ppc.
+
+baltrad-ppc is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+baltrad-ppc is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with baltrad-ppc.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Benchmark of the polarimetric processing chain. Synthetic scans with TH, ZDR, VRADH, PHIDP, RHOHV and DBZH are
+ * generated for a number of geometries and each public kernel in pdp_processor.h as well as the complete processing
+ * is timed. The result is written as CSV or JSON so that it can be compared between releases.
+ *
+ * Usage: ppc_bench [-g <nrays>x<nbins>[,...]] [-r <repetitions>] [-t <threads>] [-v <nscans>] [-s <seed>] [-f csv|json] [-o <file>]
+ * @file
+ * @author agent <agent@local>
+ * @date 2026-10-16
+ */
+#include "pdp_processor.h"
+#include "pdp_stats.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+/**
+ * Default geometries, nrays x nbins
+ */
+#define PPC_BENCH_DEFAULT_GEOMETRIES "360x500,360x1000,720x2000"
+
+/**
+ * Max number of geometries that can be benchmarked in one run
+ */
+#define PPC_BENCH_MAX_GEOMETRIES 16
+
+/**
+ * Range bin size in meters of the synthetic scans
+ */
+#define PPC_BENCH_RSCALE 250.0
+
+/**
+ * Nodata used for the fields passed directly to the kernels
+ */
+#define PPC_BENCH_NODATA -999.0
+
+/**
+ * The physical fields of a synthetic scan
+ */
+typedef struct PpcBench_Fields {
+  RaveData2D_t* TH; /**< total reflectivity */
+  RaveData2D_t* ZDR; /**< differential reflectivity */
+  RaveData2D_t* VRADH; /**< radial velocity */
+  RaveData2D_t* PHIDP; /**< differential phase */
+  RaveData2D_t* RHOHV; /**< correlation coefficient */
+  RaveData2D_t* DBZH; /**< reflectivity */
+} PpcBench_Fields;
+
+/**
+ * Timing of one kernel
+ */
+typedef struct PpcBench_Result {
+  long nrays; /**< number of rays */
+  long nbins; /**< number of bins */
+  const char* kernel; /**< name of the kernel */
+  long repetitions; /**< number of repetitions */
+  double min; /**< min time in ms */
+  double mean; /**< mean time in ms */
+  double max; /**< max time in ms */
+} PpcBench_Result;
+
+/**
+ * State of the random number generator so that the same scans are generated every time
+ */
+static unsigned int PpcBench_seed = 12345;
+
+/**
+ * @returns a pseudo random number between 0 and 1
+ */
+static double PpcBench_random(void)
+{
+  PpcBench_seed ^= PpcBench_seed << 13;
+  PpcBench_seed ^= PpcBench_seed >> 17;
+  PpcBench_seed ^= PpcBench_seed << 5;
+  return (double)PpcBench_seed / 4294967295.0;
+}
+
+/**
+ * Releases the fields
+ * @param[in] fields - the fields
+ */
+static void PpcBench_releaseFields(PpcBench_Fields* fields)
+{
+  RAVE_OBJECT_RELEASE(fields->TH);
+  RAVE_OBJECT_RELEASE(fields->ZDR);
+  RAVE_OBJECT_RELEASE(fields->VRADH);
+  RAVE_OBJECT_RELEASE(fields->PHIDP);
+  RAVE_OBJECT_RELEASE(fields->RHOHV);
+  RAVE_OBJECT_RELEASE(fields->DBZH);
+}
+
+/**
+ * Creates a field using nodata
+ * @param[in] nbins - number of bins
+ * @param[in] nrays - number of rays
+ * @returns the field
+ */
+static RaveData2D_t* PpcBench_createField(long nbins, long nrays)
+{
+  RaveData2D_t* field = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
+  if (field != NULL) {
+    RaveData2D_useNodata(field, 1);
+    RaveData2D_setNodata(field, PPC_BENCH_NODATA);
+  }
+  return field;
+}
+
+/**
+ * Generates the physical fields of a synthetic scan. The scan contains a number of precipitation cells where
+ * PHIDP increases with KDP along the ray, ground clutter close to the radar and noise everywhere else.
+ * @param[in] nrays - number of rays
+ * @param[in] nbins - number of bins
+ * @param[out] fields - the generated fields
+ * @returns 1 on success otherwise 0
+ */
+static int PpcBench_generateFields(long nrays, long nbins, PpcBench_Fields* fields)
+{
+  double cellAzimuth[8], cellRange[8], cellSize[8], cellMax[8];
+  long ncells = 8, ci = 0, ri = 0, bi = 0;
+  double dr = PPC_BENCH_RSCALE / 1000.0;
+
+  memset(fields, 0, sizeof(PpcBench_Fields));
+  fields->TH = PpcBench_createField(nbins, nrays);
+  fields->ZDR = PpcBench_createField(nbins, nrays);
+  fields->VRADH = PpcBench_createField(nbins, nrays);
+  fields->PHIDP = PpcBench_createField(nbins, nrays);
+  fields->RHOHV = PpcBench_createField(nbins, nrays);
+  fields->DBZH = PpcBench_createField(nbins, nrays);
+  if (fields->TH == NULL || fields->ZDR == NULL || fields->VRADH == NULL ||
+      fields->PHIDP == NULL || fields->RHOHV == NULL || fields->DBZH == NULL) {
+    PpcBench_releaseFields(fields);
+    return 0;
+  }
+
+  for (ci = 0; ci < ncells; ci++) {
+    cellAzimuth[ci] = PpcBench_random() * 360.0;
+    cellRange[ci] = (0.1 + 0.8 * PpcBench_random()) * nbins * dr;
+    cellSize[ci] = 10.0 + 30.0 * PpcBench_random();
+    cellMax[ci] = 30.0 + 25.0 * PpcBench_random();
+  }
+
+  for (ri = 0; ri < nrays; ri++) {
+    double azimuth = 360.0 * ri / nrays;
+    double phidp = 30.0;
+    for (bi = 0; bi < nbins; bi++) {
+      double range = (bi + 0.5) * dr;
+      double zlin = 0.0, z = 0.0, zdr = 0.0, vrad = 0.0, rhohv = 0.0, kdp = 0.0;
+      for (ci = 0; ci < ncells; ci++) {
+        double da = fabs(azimuth - cellAzimuth[ci]);
+        double x = 0.0, y = 0.0;
+        if (da > 180.0) {
+          da = 360.0 - da;
+        }
+        x = range * da * M_PI / 180.0;
+        y = range - cellRange[ci];
+        zlin += pow(10.0, cellMax[ci] / 10.0) * exp(-(x*x + y*y) / (cellSize[ci] * cellSize[ci]));
+      }
+      z = (zlin > 0.0) ? 10.0 * log10(zlin) : -30.0;
+
+      if (range < 20.0 && PpcBench_random() < 0.05) {
+        /* Ground clutter */
+        z = 40.0 + 20.0 * PpcBench_random();
+        zdr = -2.0 + 6.0 * PpcBench_random();
+        vrad = 0.5 * (PpcBench_random() - 0.5);
+        rhohv = 0.3 + 0.5 * PpcBench_random();
+        phidp += 20.0 * (PpcBench_random() - 0.5);
+      } else if (z > 5.0) {
+        /* Precipitation */
+        z += 2.0 * (PpcBench_random() - 0.5);
+        zdr = 0.2 + 0.05 * (z - 10.0) + 0.3 * (PpcBench_random() - 0.5);
+        vrad = 15.0 * cos(azimuth * M_PI / 180.0) + 2.0 * (PpcBench_random() - 0.5);
+        rhohv = 0.97 + 0.025 * PpcBench_random();
+        kdp = 1.0e-5 * pow(pow(10.0, z / 10.0), 0.76);
+        phidp += 2.0 * kdp * dr + 3.0 * (PpcBench_random() - 0.5);
+      } else {
+        /* Noise */
+        z = -10.0 + 10.0 * PpcBench_random();
+        zdr = -4.0 + 8.0 * PpcBench_random();
+        vrad = 30.0 * (PpcBench_random() - 0.5);
+        rhohv = 0.2 + 0.6 * PpcBench_random();
+        phidp = 30.0 + 180.0 * PpcBench_random();
+      }
+      RaveData2D_setValueUnchecked(fields->TH, bi, ri, z);
+      RaveData2D_setValueUnchecked(fields->DBZH, bi, ri, z - 0.5 * PpcBench_random());
+      RaveData2D_setValueUnchecked(fields->ZDR, bi, ri, zdr);
+      RaveData2D_setValueUnchecked(fields->VRADH, bi, ri, vrad);
+      RaveData2D_setValueUnchecked(fields->RHOHV, bi, ri, rhohv);
+      RaveData2D_setValueUnchecked(fields->PHIDP, bi, ri, phidp);
+    }
+  }
+  return 1;
+}
+
+/**
+ * Adds a quantized parameter to the scan.
+ * @param[in] scan - the scan
+ * @param[in] quantity - the quantity
+ * @param[in] field - the physical values
+ * @param[in] gain - the gain
+ * @param[in] offset - the offset
+ * @returns 1 on success otherwise 0
+ */
+static int PpcBench_addParameter(PolarScan_t* scan, const char* quantity, RaveData2D_t* field, double gain, double offset)
+{
+  PolarScanParam_t* param = RAVE_OBJECT_NEW(&PolarScanParam_TYPE);
+  long nbins = RaveData2D_getXsize(field), nrays = RaveData2D_getYsize(field), ri = 0, bi = 0;
+  int result = 0;
+
+  if (param == NULL || !PolarScanParam_createData(param, nbins, nrays, RaveDataType_UCHAR) ||
+      !PolarScanParam_setQuantity(param, quantity)) {
+    goto done;
+  }
+  PolarScanParam_setGain(param, gain);
+  PolarScanParam_setOffset(param, offset);
+  PolarScanParam_setNodata(param, 255.0);
+  PolarScanParam_setUndetect(param, 0.0);
+  for (ri = 0; ri < nrays; ri++) {
+    for (bi = 0; bi < nbins; bi++) {
+      double v = 0.0;
+      RaveData2D_getValueUnchecked(field, bi, ri, &v);
+      v = round((v - offset) / gain);
+      if (v < 1.0) {
+        v = 1.0;
+      } else if (v > 254.0) {
+        v = 254.0;
+      }
+      PolarScanParam_setValue(param, bi, ri, v);
+    }
+  }
+  result = PolarScan_addParameter(scan, param);
+done:
+  RAVE_OBJECT_RELEASE(param);
+  return result;
+}
+
+/**
+ * Creates a synthetic scan from the fields.
+ * @param[in] fields - the physical fields
+ * @returns the scan or NULL on failure
+ */
+static PolarScan_t* PpcBench_createScan(PpcBench_Fields* fields)
+{
+  PolarScan_t *scan = NULL, *result = NULL;
+
+  scan = RAVE_OBJECT_NEW(&PolarScan_TYPE);
+  if (scan == NULL) {
+    goto done;
+  }
+  PolarScan_setLongitude(scan, 14.0 * M_PI / 180.0);
+  PolarScan_setLatitude(scan, 60.0 * M_PI / 180.0);
+  PolarScan_setHeight(scan, 100.0);
+  PolarScan_setElangle(scan, 0.5 * M_PI / 180.0);
+  PolarScan_setRscale(scan, PPC_BENCH_RSCALE);
+  PolarScan_setRstart(scan, 0.0);
+
+  if (!PpcBench_addParameter(scan, "TH", fields->TH, 0.5, -32.0) ||
+      !PpcBench_addParameter(scan, "DBZH", fields->DBZH, 0.5, -32.0) ||
+      !PpcBench_addParameter(scan, "ZDR", fields->ZDR, 0.1, -12.7) ||
+      !PpcBench_addParameter(scan, "VRADH", fields->VRADH, 0.5, -64.0) ||
+      !PpcBench_addParameter(scan, "PHIDP", fields->PHIDP, 1.5, 0.0) ||
+      !PpcBench_addParameter(scan, "RHOHV", fields->RHOHV, 1.0/254.0, 0.0)) {
+    goto done;
+  }
+  result = RAVE_OBJECT_COPY(scan);
+done:
+  RAVE_OBJECT_RELEASE(scan);
+  return result;
+}
+
+/**
+ * Creates a volume with nscans copies of the scan at different elevation angles.
+ * @param[in] scan - the scan
+ * @param[in] nscans - number of scans
+ * @returns the volume or NULL on failure
+ */
+static PolarVolume_t* PpcBench_createVolume(PolarScan_t* scan, long nscans)
+{
+  PolarVolume_t *pvol = NULL, *result = NULL;
+  PolarScan_t* copy = NULL;
+  long si = 0;
+
+  pvol = RAVE_OBJECT_NEW(&PolarVolume_TYPE);
+  if (pvol == NULL) {
+    goto done;
+  }
+  PolarVolume_setLongitude(pvol, PolarScan_getLongitude(scan));
+  PolarVolume_setLatitude(pvol, PolarScan_getLatitude(scan));
+  PolarVolume_setHeight(pvol, PolarScan_getHeight(scan));
+  for (si = 0; si < nscans; si++) {
+    copy = RAVE_OBJECT_CLONE(scan);
+    if (copy == NULL) {
+      goto done;
+    }
+    PolarScan_setElangle(copy, (0.5 + si) * M_PI / 180.0);
+    if (!PolarVolume_addScan(pvol, copy)) {
+      goto done;
+    }
+    RAVE_OBJECT_RELEASE(copy);
+  }
+  result = RAVE_OBJECT_COPY(pvol);
+done:
+  RAVE_OBJECT_RELEASE(copy);
+  RAVE_OBJECT_RELEASE(pvol);
+  return result;
+}
+
+/**
+ * Adds a timing to the result.
+ * @param[in,out] result - the result
+ * @param[in] ms - the time in ms
+ */
+static void PpcBench_addTiming(PpcBench_Result* result, double ms)
+{
+  if (result->repetitions == 0 || ms < result->min) {
+    result->min = ms;
+  }
+  if (result->repetitions == 0 || ms > result->max) {
+    result->max = ms;
+  }
+  result->mean = (result->mean * result->repetitions + ms) / (result->repetitions + 1);
+  result->repetitions++;
+}
+
+/**
+ * Prints one result
+ * @param[in] fp - the stream
+ * @param[in] format - csv or json
+ * @param[in] result - the result
+ * @param[in] first - if this is the first result
+ * @param[in] nthreads - number of threads
+ */
+static void PpcBench_printResult(FILE* fp, const char* format, PpcBench_Result* result, int first, long nthreads)
+{
+  if (strcmp(format, "json") == 0) {
+    fprintf(fp, "%s    {\"nrays\": %ld, \"nbins\": %ld, \"threads\": %ld, \"kernel\": \"%s\", \"repetitions\": %ld, \"min_ms\": %.3f, \"mean_ms\": %.3f, \"max_ms\": %.3f}",
+        first ? "" : ",\n", result->nrays, result->nbins, nthreads, result->kernel, result->repetitions, result->min, result->mean, result->max);
+  } else {
+    fprintf(fp, "%ld,%ld,%ld,%s,%ld,%.3f,%.3f,%.3f\n",
+        result->nrays, result->nbins, nthreads, result->kernel, result->repetitions, result->min, result->mean, result->max);
+  }
+}
+
+/**
+ * Starts the timing of a kernel
+ */
+#define PPC_BENCH_START(name) \
+  memset(&bench, 0, sizeof(PpcBench_Result)); \
+  bench.nrays = nrays; bench.nbins = nbins; bench.kernel = name; \
+  for (rep = 0; rep < repetitions; rep++) { \
+    long long starttime = PdpStats_now();
+
+/**
+ * Ends the timing of a kernel, status is the result of the call in the loop.
+ */
+#define PPC_BENCH_END(status) \
+    PpcBench_addTiming(&bench, (double)(PdpStats_now() - starttime) / 1000000.0); \
+    if (!(status)) { \
+      fprintf(stderr, "%s failed for %ldx%ld\n", bench.kernel, nrays, nbins); \
+      goto done; \
+    } \
+  } \
+  PpcBench_printResult(fp, format, &bench, first, nthreads); \
+  first = 0;
+
+/**
+ * Runs the benchmark for one geometry
+ * @param[in] fp - the stream to write the result to
+ * @param[in] format - csv or json
+ * @param[in] nrays - number of rays
+ * @param[in] nbins - number of bins
+ * @param[in] repetitions - number of times each kernel should be run
+ * @param[in] nthreads - number of threads
+ * @param[in] nscans - number of scans in the volume benchmark, 0 to skip it
+ * @param[in,out] pfirst - if no result has been printed yet
+ * @returns 1 on success otherwise 0
+ */
+static int PpcBench_run(FILE* fp, const char* format, long nrays, long nbins, long repetitions, long nthreads, long nscans, int* pfirst)
+{
+  PpcBench_Fields fields;
+  PpcBench_Result bench;
+  PdpProcessor_t* processor = NULL;
+  PpcRadarOptions_t* options = NULL;
+  PolarScan_t *scan = NULL, *result = NULL;
+  PolarVolume_t* pvol = NULL;
+  PdpStats_t* stats = NULL;
+  RaveData2D_t *texturePHIDP = NULL, *textureZ = NULL, *clutterMap = NULL, *tmp = NULL;
+  RaveData2D_t *outZ = NULL, *outQuality = NULL, *outClutterMask = NULL;
+  RaveData2D_t *pdpf = NULL, *kdp = NULL, *mask = NULL;
+  RaveData2D_t *attZ = NULL, *attZDR = NULL, *attPIA = NULL, *attDBZH = NULL, *zphi = NULL, *ah = NULL;
+  double dr = PPC_BENCH_RSCALE / 1000.0;
+  long rep = 0, ri = 0, bi = 0;
+  int status = 0, ok = 0, first = *pfirst, i = 0;
+
+  memset(&fields, 0, sizeof(PpcBench_Fields));
+  processor = RAVE_OBJECT_NEW(&PdpProcessor_TYPE);
+  if (processor == NULL || !PpcBench_generateFields(nrays, nbins, &fields)) {
+    fprintf(stderr, "Failed to generate synthetic fields for %ldx%ld\n", nrays, nbins);
+    goto done;
+  }
+  options = PdpProcessor_getRadarOptions(processor);
+  PpcRadarOptions_setNumberOfThreads(options, nthreads);
+  PpcRadarOptions_setRequestedFields(options, PpcRadarOptions_TH_CORR | PpcRadarOptions_ATT_TH_CORR | PpcRadarOptions_DBZH_CORR |
+      PpcRadarOptions_ATT_DBZH_CORR | PpcRadarOptions_KDP_CORR | PpcRadarOptions_RHOHV_CORR | PpcRadarOptions_PHIDP_CORR |
+      PpcRadarOptions_ZDR_CORR | PpcRadarOptions_ATT_ZDR_CORR | PpcRadarOptions_ZPHI_CORR |
+      PpcRadarOptions_QUALITY_RESIDUAL_CLUTTER_MASK | PpcRadarOptions_QUALITY_ATTENUATION_MASK);
+  scan = PpcBench_createScan(&fields);
+  clutterMap = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
+  if (scan == NULL || clutterMap == NULL) {
+    fprintf(stderr, "Failed to create synthetic scan for %ldx%ld\n", nrays, nbins);
+    goto done;
+  }
+  RaveData2D_useNodata(clutterMap, 1);
+  RaveData2D_setNodata(clutterMap, 0.0);
+
+  PPC_BENCH_START("texture")
+    RAVE_OBJECT_RELEASE(texturePHIDP);
+    texturePHIDP = PdpProcessor_texture(processor, fields.PHIDP);
+  PPC_BENCH_END(texturePHIDP != NULL)
+  textureZ = PdpProcessor_texture(processor, fields.TH);
+  if (textureZ == NULL) {
+    goto done;
+  }
+
+  PPC_BENCH_START("trap")
+    RAVE_OBJECT_RELEASE(tmp);
+    tmp = PdpProcessor_trap(processor, fields.TH, 20.0, 40.0, 5.0, 5.0);
+  PPC_BENCH_END(tmp != NULL)
+
+  PPC_BENCH_START("clutterID")
+    RAVE_OBJECT_RELEASE(tmp);
+    tmp = PdpProcessor_clutterID(processor, fields.TH, fields.VRADH, texturePHIDP, fields.RHOHV, textureZ, clutterMap, PPC_BENCH_NODATA, PPC_BENCH_NODATA);
+  PPC_BENCH_END(tmp != NULL)
+
+  PPC_BENCH_START("clutterCorrection")
+    RAVE_OBJECT_RELEASE(outZ);
+    RAVE_OBJECT_RELEASE(outQuality);
+    RAVE_OBJECT_RELEASE(outClutterMask);
+    status = PdpProcessor_clutterCorrection(processor, fields.TH, fields.VRADH, texturePHIDP, fields.RHOHV, textureZ, clutterMap,
+        PPC_BENCH_NODATA, PPC_BENCH_NODATA, PpcRadarOptions_getQualityThreshold(options), &outZ, &outQuality, &outClutterMask);
+  PPC_BENCH_END(status)
+
+  PPC_BENCH_START("medfilt")
+    RAVE_OBJECT_RELEASE(tmp);
+    tmp = PdpProcessor_medfilt(processor, fields.TH, PpcRadarOptions_getResidualThresholdZ(options), PPC_BENCH_NODATA,
+        PpcRadarOptions_getResidualFilterBinSize(options), PpcRadarOptions_getResidualFilterRaySize(options));
+  PPC_BENCH_END(tmp != NULL)
+
+  PPC_BENCH_START("residualClutterFilter")
+    RAVE_OBJECT_RELEASE(tmp);
+    tmp = PdpProcessor_residualClutterFilter(processor, fields.TH, PpcRadarOptions_getResidualThresholdZ(options),
+        PpcRadarOptions_getResidualThresholdTexture(options), PpcRadarOptions_getResidualFilterBinSize(options),
+        PpcRadarOptions_getResidualFilterRaySize(options));
+  PPC_BENCH_END(tmp != NULL)
+
+  PPC_BENCH_START("pdpProcessing")
+    RAVE_OBJECT_RELEASE(pdpf);
+    RAVE_OBJECT_RELEASE(kdp);
+    status = PdpProcessor_pdpProcessing(processor, fields.PHIDP, dr, (long)round(PpcRadarOptions_getPdpRWin1(options) / dr),
+        PpcRadarOptions_getPdpNrIterations(options), &pdpf, &kdp);
+  PPC_BENCH_END(status)
+
+  PPC_BENCH_START("pdpScript")
+    RAVE_OBJECT_RELEASE(pdpf);
+    RAVE_OBJECT_RELEASE(kdp);
+    status = PdpProcessor_pdpScript(processor, fields.PHIDP, dr, PpcRadarOptions_getPdpRWin1(options), PpcRadarOptions_getPdpRWin2(options),
+        PpcRadarOptions_getPdpNrIterations(options), &pdpf, &kdp);
+  PPC_BENCH_END(status)
+
+  /* The attenuation mask is where there is precipitation */
+  mask = RaveData2D_zeros(nbins, nrays, RaveDataType_DOUBLE);
+  if (mask == NULL) {
+    goto done;
+  }
+  for (ri = 0; ri < nrays; ri++) {
+    for (bi = 0; bi < nbins; bi++) {
+      double v = 0.0;
+      RaveData2D_getValueUnchecked(fields.RHOHV, bi, ri, &v);
+      if (v > 0.9) {
+        RaveData2D_setValueUnchecked(mask, bi, ri, 1.0);
+      }
+    }
+  }
+
+  PPC_BENCH_START("attenuation")
+    RAVE_OBJECT_RELEASE(attZ);
+    RAVE_OBJECT_RELEASE(attZDR);
+    RAVE_OBJECT_RELEASE(attPIA);
+    RAVE_OBJECT_RELEASE(attDBZH);
+    status = PdpProcessor_attenuation(processor, fields.TH, fields.ZDR, fields.DBZH, pdpf, mask,
+        PpcRadarOptions_getAttenuationGammaH(options), PpcRadarOptions_getAttenuationAlpha(options),
+        -32.0, -32.0, &attZ, &attZDR, &attPIA, &attDBZH);
+  PPC_BENCH_END(status)
+
+  PPC_BENCH_START("zphi")
+    RAVE_OBJECT_RELEASE(zphi);
+    RAVE_OBJECT_RELEASE(ah);
+    status = PdpProcessor_zphi(processor, fields.TH, pdpf, mask, dr, PpcRadarOptions_getBB(options),
+        PpcRadarOptions_getAttenuationGammaH(options), &zphi, &ah);
+  PPC_BENCH_END(status)
+
+  PPC_BENCH_START("process")
+    RAVE_OBJECT_RELEASE(result);
+    result = PdpProcessor_process(processor, scan, NULL);
+  PPC_BENCH_END(result != NULL)
+
+  /* The stages of the last processing */
+  stats = PdpProcessor_getLastStats(processor);
+  for (i = 0; stats != NULL && i < PdpStatsStage_NUMBER_OF_STAGES; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "process.%s", PdpStats_getStageName((PdpStatsStage)i));
+    memset(&bench, 0, sizeof(PpcBench_Result));
+    bench.nrays = nrays;
+    bench.nbins = nbins;
+    bench.kernel = name;
+    PpcBench_addTiming(&bench, PdpStats_getDuration(stats, (PdpStatsStage)i));
+    PpcBench_printResult(fp, format, &bench, first, nthreads);
+    first = 0;
+  }
+
+  if (nscans > 0) {
+    pvol = PpcBench_createVolume(scan, nscans);
+    if (pvol == NULL) {
+      goto done;
+    }
+    PPC_BENCH_START("processVolume")
+      status = PdpProcessor_processVolume(processor, pvol, NULL);
+    PPC_BENCH_END(status)
+  }
+
+  ok = 1;
+done:
+  *pfirst = first;
+  PpcBench_releaseFields(&fields);
+  RAVE_OBJECT_RELEASE(processor);
+  RAVE_OBJECT_RELEASE(options);
+  RAVE_OBJECT_RELEASE(scan);
+  RAVE_OBJECT_RELEASE(result);
+  RAVE_OBJECT_RELEASE(pvol);
+  RAVE_OBJECT_RELEASE(stats);
+  RAVE_OBJECT_RELEASE(texturePHIDP);
+  RAVE_OBJECT_RELEASE(textureZ);
+  RAVE_OBJECT_RELEASE(clutterMap);
+  RAVE_OBJECT_RELEASE(tmp);
+  RAVE_OBJECT_RELEASE(outZ);
+  RAVE_OBJECT_RELEASE(outQuality);
+  RAVE_OBJECT_RELEASE(outClutterMask);
+  RAVE_OBJECT_RELEASE(pdpf);
+  RAVE_OBJECT_RELEASE(kdp);
+  RAVE_OBJECT_RELEASE(mask);
+  RAVE_OBJECT_RELEASE(attZ);
+  RAVE_OBJECT_RELEASE(attZDR);
+  RAVE_OBJECT_RELEASE(attPIA);
+  RAVE_OBJECT_RELEASE(attDBZH);
+  RAVE_OBJECT_RELEASE(zphi);
+  RAVE_OBJECT_RELEASE(ah);
+  return ok;
+}
+
+/**
+ * Prints the usage
+ * @param[in] name - the program name
+ */
+static void PpcBench_usage(const char* name)
+{
+  fprintf(stderr, "Usage: %s [-g <nrays>x<nbins>[,...]] [-r <repetitions>] [-t <threads>] [-v <nscans>] [-s <seed>] [-f csv|json] [-o <file>]\n", name);
+  fprintf(stderr, "  -g  geometries to benchmark, default %s\n", PPC_BENCH_DEFAULT_GEOMETRIES);
+  fprintf(stderr, "  -r  number of times each kernel is run, default 3\n");
+  fprintf(stderr, "  -t  number of threads used by the processor, default 1\n");
+  fprintf(stderr, "  -v  number of scans in the volume when benchmarking processVolume, default 0 (not run)\n");
+  fprintf(stderr, "  -s  seed used when generating the synthetic scans\n");
+  fprintf(stderr, "  -f  output format, csv (default) or json\n");
+  fprintf(stderr, "  -o  output file, default stdout\n");
+}
+
+int main(int argc, char** argv)
+{
+  const char* geometries = PPC_BENCH_DEFAULT_GEOMETRIES;
+  const char* format = "csv";
+  const char* filename = NULL;
+  long nrays[PPC_BENCH_MAX_GEOMETRIES], nbins[PPC_BENCH_MAX_GEOMETRIES];
+  long ngeometries = 0, repetitions = 3, nthreads = 1, nscans = 0, gi = 0;
+  char *copy = NULL, *token = NULL, *saveptr = NULL;
+  FILE* fp = stdout;
+  int c = 0, first = 1, result = 1;
+
+  Rave_initializeDebugger();
+  Rave_setDebugLevel(RAVE_WARNING);
+
+  while ((c = getopt(argc, argv, "g:r:t:v:s:f:o:h")) != -1) {
+    switch (c) {
+    case 'g':
+      geometries = optarg;
+      break;
+    case 'r':
+      repetitions = atol(optarg);
+      break;
+    case 't':
+      nthreads = atol(optarg);
+      break;
+    case 'v':
+      nscans = atol(optarg);
+      break;
+    case 's':
+      PpcBench_seed = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    case 'f':
+      format = optarg;
+      break;
+    case 'o':
+      filename = optarg;
+      break;
+    default:
+      PpcBench_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (repetitions < 1 || nthreads < 1 || nscans < 0 || PpcBench_seed == 0 ||
+      (strcmp(format, "csv") != 0 && strcmp(format, "json") != 0)) {
+    PpcBench_usage(argv[0]);
+    return 1;
+  }
+
+  copy = strdup(geometries);
+  for (token = strtok_r(copy, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr)) {
+    if (ngeometries >= PPC_BENCH_MAX_GEOMETRIES ||
+        sscanf(token, "%ldx%ld", &nrays[ngeometries], &nbins[ngeometries]) != 2 ||
+        nrays[ngeometries] <= 0 || nbins[ngeometries] <= 0) {
+      fprintf(stderr, "Invalid geometry: %s\n", token);
+      free(copy);
+      return 1;
+    }
+    ngeometries++;
+  }
+  free(copy);
+
+  if (filename != NULL) {
+    fp = fopen(filename, "w");
+    if (fp == NULL) {
+      fprintf(stderr, "Failed to open %s\n", filename);
+      return 1;
+    }
+  }
+
+  if (strcmp(format, "json") == 0) {
+    fprintf(fp, "{\n  \"results\": [\n");
+  } else {
+    fprintf(fp, "nrays,nbins,threads,kernel,repetitions,min_ms,mean_ms,max_ms\n");
+  }
+  for (gi = 0; result && gi < ngeometries; gi++) {
+    result = PpcBench_run(fp, format, nrays[gi], nbins[gi], repetitions, nthreads, nscans, &first);
+  }
+  if (strcmp(format, "json") == 0) {
+    fprintf(fp, "\n  ]\n}\n");
+  }
+
+  if (fp != stdout) {
+    fclose(fp);
+  }
+  return result ? 0 : 1;
+}
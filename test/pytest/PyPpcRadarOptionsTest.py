@@ -494,6 +494,86 @@ class PyPpcRadarOptionsTest(unittest.TestCase):
     a.invertPHIDP = True
     self.assertEqual(True, a.invertPHIDP)
 
+  def testNumberOfThreads(self):
+    a = _ppcradaroptions.new()
+    
+    self.assertTrue("numberOfThreads" in dir(a))
+    
+    self.assertEqual(1, a.numberOfThreads)
+    a.numberOfThreads = 2
+    self.assertEqual(2, a.numberOfThreads)
+
+  def testProcessingPrecision(self):
+    a = _ppcradaroptions.new()
+    
+    self.assertTrue("processingPrecision" in dir(a))
+    
+    self.assertEqual("double", a.processingPrecision)
+    a.processingPrecision = "float"
+    self.assertEqual("float", a.processingPrecision)
+    a.processingPrecision = "double"
+    self.assertEqual("double", a.processingPrecision)
+    try:
+      a.processingPrecision = "int"
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+    self.assertEqual("double", a.processingPrecision)
+
+  def testTextureBinSize(self):
+    a = _ppcradaroptions.new()
+    
+    self.assertTrue("textureBinSize" in dir(a))
+    
+    self.assertEqual(3, a.textureBinSize)
+    a.textureBinSize = 5
+    self.assertEqual(5, a.textureBinSize)
+
+  def testTextureRaySize(self):
+    a = _ppcradaroptions.new()
+    
+    self.assertTrue("textureRaySize" in dir(a))
+    
+    self.assertEqual(3, a.textureRaySize)
+    a.textureRaySize = 5
+    self.assertEqual(5, a.textureRaySize)
+
+  def testOutputScaling(self):
+    a = _ppcradaroptions.new()
+    self.assertEqual(None, a.getOutputScaling("TH_CORR"))
+    self.assertEqual([], a.getOutputScalingQuantities())
+    a.setOutputScaling("TH_CORR", "uchar", 0.5, -32.0)
+    a.setOutputScaling("PHIDP_CORR", "ushort", 0.01, -0.5)
+    self.assertEqual(("uchar", 0.5, -32.0), a.getOutputScaling("TH_CORR"))
+    self.assertEqual(("ushort", 0.01, -0.5), a.getOutputScaling("PHIDP_CORR"))
+    self.assertEqual(["TH_CORR", "PHIDP_CORR"], a.getOutputScalingQuantities())
+    a.setOutputScaling("TH_CORR", "ushort", 0.01, -32.0)
+    self.assertEqual(("ushort", 0.01, -32.0), a.getOutputScaling("TH_CORR"))
+    a.removeOutputScaling("TH_CORR")
+    self.assertEqual(None, a.getOutputScaling("TH_CORR"))
+    self.assertEqual(["PHIDP_CORR"], a.getOutputScalingQuantities())
+
+  def testOutputScaling_float(self):
+    a = _ppcradaroptions.new()
+    a.setOutputScaling("KDP_CORR", "float")
+    a.setOutputScaling("ZPHI_CORR", "double", 0.5, -32.0)
+    self.assertEqual(("float", 1.0, 0.0), a.getOutputScaling("KDP_CORR"))
+    self.assertEqual(("double", 1.0, 0.0), a.getOutputScaling("ZPHI_CORR"))
+
+  def testOutputScaling_invalid(self):
+    a = _ppcradaroptions.new()
+    try:
+      a.setOutputScaling("TH_CORR", "int", 0.5, -32.0)
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+    try:
+      a.setOutputScaling("TH_CORR", "uchar", 0.0, -32.0)
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+    self.assertEqual(None, a.getOutputScaling("TH_CORR"))
+
 if __name__ == "__main__":
   #import sys;sys.argv = ['', 'Test.testName']
   unittest.main()
\ No newline at end of file
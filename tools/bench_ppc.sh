@@ -0,0 +1,49 @@
+#!/bin/sh
+############################################################
+# Description: Script that runs the benchmark with proper
+# settings in this build. All arguments are passed on to
+# the benchmark and it is executed in test/bench.
+#
+# Author(s):   agent <agent@local>
+#
+# Copyright:   Swedish Meteorological and Hydrological Institute, 2026
+#
+# History:  2026-10-16 Created by agent
+############################################################
+SCRIPTPATH="$( cd -- "$(dirname "$0")" >/dev/null 2>&1 ; pwd -P )"
+
+DEF_MK_FILE="${SCRIPTPATH}/../def.mk"
+
+if [ ! -f "${DEF_MK_FILE}" ]; then
+  echo "configure has not been run"
+  exit 255
+fi
+
+# RAVES MKF FILE
+RAVE_ROOT_DIR=`fgrep RAVE_ROOT_DIR "${DEF_MK_FILE}" | sed -e"s/\(RAVE_ROOT_DIR=[ \t]*\)//"`
+RAVE_ROOT_MKFILE="$RAVE_ROOT_DIR/mkf/def.mk"
+
+# HLHDFS MKF FILE
+HLHDF_MKFFILE=`fgrep HLHDF_HLDEF_MK_FILE "${RAVE_ROOT_MKFILE}" | sed -e"s/\(HLHDF_HLDEF_MK_FILE=[ \t]*\)//"`
+
+# Get HDF5s ld path from hlhdfs mkf file
+HDF5_LDPATH=`fgrep HDF5_LIBDIR "${HLHDF_MKFFILE}" | sed -e"s/\(HDF5_LIBDIR=[ \t]*-L\)//"`
+
+# Get HLHDFs libpath from raves mkf file
+HLHDF_LDPATH=`fgrep HLHDF_LIB_DIR "${DEF_MK_FILE}" | sed -e"s/\(HLHDF_LIB_DIR=[ \t]*\)//"`
+
+RAVE_LDPATH="${RAVE_ROOT_DIR}/lib"
+PPC_LDPATH="${SCRIPTPATH}/../ppc"
+
+case `uname -s` in
+ Darwin*|darwin*)
+   export DYLD_LIBRARY_PATH="${PPC_LDPATH}:${RAVE_LDPATH}:${HLHDF_LDPATH}:${HDF5_LDPATH}${DYLD_LIBRARY_PATH:+:$DYLD_LIBRARY_PATH}"
+   ;;
+ *)
+   export LD_LIBRARY_PATH="${PPC_LDPATH}:${RAVE_LDPATH}:${HLHDF_LDPATH}:${HDF5_LDPATH}${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}"
+   ;;
+esac
+
+cd "${SCRIPTPATH}/../test/bench" || exit 255
+
+./ppc_bench "$@"